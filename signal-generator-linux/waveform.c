@@ -0,0 +1,364 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "waveform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* internal functions */
+static int gcd(int a, int b);
+static int lcm(int a, int b);
+
+
+int waveform_init(waveform_t *this)
+{
+    memset(this, 0, sizeof(*this));
+    this->min_value = -8192;
+    this->max_value =  8191;
+    return 0;
+}
+
+int waveform_fini(waveform_t *this)
+{
+    free(this->samples);
+    this->samples = NULL;
+    return 0;
+}
+
+/* adds a component; the type is the option letter of the signal generator
+   (c: constant, s: sine, q: square, t: triangular, w: sweep) and the spec
+   is the argument of that option (for instance 1/100,1000 for a sine wave
+   at 1/100 the sample rate with an amplitude of 1000) */
+int waveform_add(waveform_t *this, char type, const char *spec)
+{
+    switch (type) {
+    case 'c':
+        if (this->num_constant_waveforms >= WAVEFORM_MAX_COMPONENTS) {
+            fprintf(stderr, "too many constant waveforms\n");
+            return -1;
+        }
+        {
+            constant_waveform_t *cw = &this->constant_waveforms[this->num_constant_waveforms];
+            if (sscanf(spec, "%lf", &cw->value) != 1) {
+                fprintf(stderr, "invalid constant waveform specification: %s\n", spec);
+                return -1;
+            }
+        }
+        this->num_constant_waveforms++;
+        break;
+    case 's':
+        if (this->num_sine_waveforms >= WAVEFORM_MAX_COMPONENTS) {
+            fprintf(stderr, "too many sine waveforms\n");
+            return -1;
+        }
+        {
+            sine_waveform_t *sw = &this->sine_waveforms[this->num_sine_waveforms];
+            sw->initial_phase = 0;
+            int nparams = sscanf(spec, "%d/%d,%lf,%lf", &sw->frequency_numerator, &sw->frequency_denominator, &sw->amplitude, &sw->initial_phase);
+            if (!(nparams == 3 || nparams == 4) || sw->frequency_denominator <= 0) {
+                fprintf(stderr, "invalid sine waveform specification: %s\n", spec);
+                return -1;
+            }
+        }
+        this->num_sine_waveforms++;
+        break;
+    case 'q':
+        if (this->num_square_waveforms >= WAVEFORM_MAX_COMPONENTS) {
+            fprintf(stderr, "too many square waveforms\n");
+            return -1;
+        }
+        {
+            square_waveform_t *qw = &this->square_waveforms[this->num_square_waveforms];
+            qw->initial_offset = 0;
+            int nparams = sscanf(spec, "%d/%d,%lf,%lf,%lf", &qw->frequency_numerator, &qw->frequency_denominator, &qw->amplitude, &qw->duty_cycle, &qw->initial_offset);
+            if (!(nparams == 3 || nparams == 4 || nparams == 5) || qw->frequency_denominator <= 0) {
+                fprintf(stderr, "invalid square waveform specification: %s\n", spec);
+                return -1;
+            }
+            if (nparams == 3) {
+                qw->duty_cycle = 0.5;
+            }
+        }
+        this->num_square_waveforms++;
+        break;
+    case 't':
+        if (this->num_triangular_waveforms >= WAVEFORM_MAX_COMPONENTS) {
+            fprintf(stderr, "too many triangular waveforms\n");
+            return -1;
+        }
+        {
+            triangular_waveform_t *tw = &this->triangular_waveforms[this->num_triangular_waveforms];
+            tw->initial_offset = 0;
+            int nparams = sscanf(spec, "%d/%d,%lf,%lf", &tw->frequency_numerator, &tw->frequency_denominator, &tw->amplitude, &tw->initial_offset);
+            if (!(nparams == 3 || nparams == 4) || tw->frequency_denominator <= 0) {
+                fprintf(stderr, "invalid triangular waveform specification: %s\n", spec);
+                return -1;
+            }
+        }
+        this->num_triangular_waveforms++;
+        break;
+    case 'w':
+        if (this->num_sweep_waveforms >= WAVEFORM_MAX_COMPONENTS) {
+            fprintf(stderr, "too many sweep waveforms\n");
+            return -1;
+        }
+        {
+            sweep_waveform_t *ww = &this->sweep_waveforms[this->num_sweep_waveforms];
+            ww->initial_phase = 0;
+            int nparams = sscanf(spec, "%d/%d,%lf,%d/%d,%d/%d,%lf", &ww->frequency_numerator, &ww->frequency_denominator, &ww->amplitude, &ww->flow_numerator, &ww->flow_denominator, &ww->fhigh_numerator, &ww->fhigh_denominator, &ww->initial_phase);
+            if (!(nparams == 7 || nparams == 8) || ww->frequency_denominator <= 0 || ww->flow_denominator <= 0 || ww->fhigh_denominator <= 0) {
+                fprintf(stderr, "invalid sweep waveform specification: %s\n", spec);
+                return -1;
+            }
+        }
+        this->num_sweep_waveforms++;
+        break;
+    default:
+        fprintf(stderr, "invalid waveform type: %c\n", type);
+        return -1;
+    }
+    return 0;
+}
+
+/* adds a component given as name:spec, with the names constant, sine,
+   square, triangular, and sweep (for instance sine:1/100,1000) */
+int waveform_parse(waveform_t *this, const char *spec)
+{
+    static const struct {
+        const char *name;
+        char type;
+    } types[] = {
+        { "constant",   'c' },
+        { "sine",       's' },
+        { "square",     'q' },
+        { "triangular", 't' },
+        { "sweep",      'w' },
+    };
+
+    const char *colon = strchr(spec, ':');
+    if (colon != NULL) {
+        size_t name_length = colon - spec;
+        for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+            if (strlen(types[i].name) == name_length && strncmp(spec, types[i].name, name_length) == 0) {
+                return waveform_add(this, types[i].type, colon + 1);
+            }
+        }
+    }
+    fprintf(stderr, "invalid waveform: %s (expected constant:, sine:, square:, triangular:, or sweep: followed by its parameters)\n", spec);
+    return -1;
+}
+
+/* pre-computes one period of the waveform */
+int waveform_build(waveform_t *this)
+{
+    int period_length = 1;
+    for (int i = 0; i < this->num_sine_waveforms; i++) {
+        period_length = lcm(period_length, this->sine_waveforms[i].frequency_denominator);
+        if (period_length > WAVEFORM_MAX_PERIOD_LENGTH) {
+            fprintf(stderr, "period too long - choose different denominators\n");
+            return -1;
+        }
+    }
+    for (int i = 0; i < this->num_square_waveforms; i++) {
+        period_length = lcm(period_length, this->square_waveforms[i].frequency_denominator);
+        if (period_length > WAVEFORM_MAX_PERIOD_LENGTH) {
+            fprintf(stderr, "period too long - choose different denominators\n");
+            return -1;
+        }
+    }
+    for (int i = 0; i < this->num_triangular_waveforms; i++) {
+        period_length = lcm(period_length, this->triangular_waveforms[i].frequency_denominator);
+        if (period_length > WAVEFORM_MAX_PERIOD_LENGTH) {
+            fprintf(stderr, "period too long - choose different denominators\n");
+            return -1;
+        }
+    }
+    for (int i = 0; i < this->num_sweep_waveforms; i++) {
+        int sweep_lcm = lcm(this->sweep_waveforms[i].frequency_denominator, this->sweep_waveforms[i].flow_denominator);
+        sweep_lcm = lcm(sweep_lcm, this->sweep_waveforms[i].fhigh_denominator);
+        period_length = lcm(period_length, sweep_lcm);
+        if (period_length > WAVEFORM_MAX_PERIOD_LENGTH) {
+            fprintf(stderr, "period too long - choose different denominators\n");
+            return -1;
+        }
+    }
+
+    /* DC components */
+    double dc = 0;
+    for (int i = 0; i < this->num_constant_waveforms; i++) {
+        constant_waveform_t *cw = &this->constant_waveforms[i];
+        dc += cw->value;
+    }
+    if (dc < this->min_value || dc > this->max_value) {
+        fprintf(stderr, "DC component out of range: %lf\n", dc);
+        return -1;
+    }
+
+    double *waveform = (double *) malloc(period_length * sizeof(double));
+    if (waveform == NULL) {
+        fprintf(stderr, "waveform_build - malloc() failed\n");
+        return -1;
+    }
+    for (int i = 0; i < period_length; i++) {
+        waveform[i] = dc;
+    }
+
+    /* sine wave components */
+    for (int i = 0; i < this->num_sine_waveforms; i++) {
+        sine_waveform_t *sw = &this->sine_waveforms[i];
+        int fd = sw->frequency_denominator;
+        double *swaveform = (double *) malloc(fd * sizeof(double));
+        double phase_offset = sw->initial_phase * M_PI / 180.0;
+        double delta_phase = 2.0 * M_PI * (double) sw->frequency_numerator / (double) fd;
+        for (int j = 0; j < fd; j++) {
+            swaveform[j] = sw->amplitude * sin(phase_offset + delta_phase * j);
+        }
+        for (int j = 0; j < period_length; j++) {
+            waveform[j] += swaveform[j % fd];
+        }
+        free(swaveform);
+    }
+
+    /* square wave components */
+    for (int i = 0; i < this->num_square_waveforms; i++) {
+        square_waveform_t *qw = &this->square_waveforms[i];
+        int fd = qw->frequency_denominator;
+        double *qwaveform = (double *) malloc(fd * sizeof(double));
+        int offset = (int) ((1.0 - qw->initial_offset) * fd) % fd;
+        int duty_cycle = qw->duty_cycle * fd;
+        for (int j = 0; j < fd; j++) {
+            int jj = (j + offset) * qw->frequency_numerator % fd;
+            if (jj < duty_cycle) {
+                qwaveform[j] = qw->amplitude;
+            } else {
+                qwaveform[j] = -qw->amplitude;
+            }
+        }
+        for (int j = 0; j < period_length; j++) {
+            waveform[j] += qwaveform[j % fd];
+        }
+        free(qwaveform);
+    }
+
+    /* triangular wave components */
+    for (int i = 0; i < this->num_triangular_waveforms; i++) {
+        triangular_waveform_t *tw = &this->triangular_waveforms[i];
+        int fd = tw->frequency_denominator;
+        double *twaveform = (double *) malloc(fd * sizeof(double));
+        /* start the triangular wave from near 0 (when initial_offest is 0) */
+        int offset = (int) ((1.25 - tw->initial_offset) * fd) % fd;
+        for (int j = 0; j < fd; j++) {
+            int jj = (j + offset) * tw->frequency_numerator % fd;
+            if (jj < fd / 2) {
+                twaveform[j] = tw->amplitude * (-1.0 + 4.0 * jj / fd);
+            } else {
+                twaveform[j] = tw->amplitude * (3.0 - 4.0 * jj / fd);
+            }
+        }
+        for (int j = 0; j < period_length; j++) {
+            waveform[j] += twaveform[j % fd];
+        }
+        free(twaveform);
+    }
+
+    /* sweep wave components */
+    for (int i = 0; i < this->num_sweep_waveforms; i++) {
+        sweep_waveform_t *ww = &this->sweep_waveforms[i];
+        int sweep_lcm = lcm(ww->frequency_denominator, ww->flow_denominator);
+        sweep_lcm = lcm(sweep_lcm, ww->fhigh_denominator);
+        double *wwaveform = (double *) malloc(sweep_lcm * sizeof(double));
+        double phase_offset = ww->initial_phase * M_PI / 180.0;
+        double half_period = ((double) ww->frequency_denominator / (double) ww->frequency_numerator) / 2.0;
+        double delta_phase_low = 2.0 * M_PI * half_period * (double) ww->flow_numerator / (double) ww->flow_denominator;
+        double delta_phase_high = 2.0 * M_PI * half_period * (double) ww->fhigh_numerator / (double) ww->fhigh_denominator;
+        double delta_omega = delta_phase_high - delta_phase_low;
+        double delta_phase_half_period = fmod((delta_phase_low + delta_phase_high) / 2.0, 2.0 * M_PI);
+
+        for (int j = 0; j < sweep_lcm; j++) {
+            double half_period_int;
+            double half_period_frac = modf((double) j / half_period, &half_period_int);
+            double phase = fmod(phase_offset + half_period_int * delta_phase_half_period, 2.0 * M_PI);
+            if ((int) half_period_int % 2 == 0) {
+                /* increasing frequency half period */
+                phase += (delta_phase_low + delta_omega * half_period_frac) * half_period_frac;
+            } else {
+                /* decreasing frequency half period */
+                phase += (delta_phase_high - delta_omega * half_period_frac) * half_period_frac;
+            }
+            wwaveform[j] = ww->amplitude * sin(phase);
+        }
+        for (int j = 0; j < period_length; j++) {
+            waveform[j] += wwaveform[j % sweep_lcm];
+        }
+        free(wwaveform);
+    }
+
+    /* convert to shorts and make sure the values are inside the boundaries */
+    short *samples = (short *) malloc(period_length * sizeof(short));
+    if (samples == NULL) {
+        fprintf(stderr, "waveform_build - malloc() failed\n");
+        free(waveform);
+        return -1;
+    }
+    int num_overflows = 0;
+    for (int i = 0; i < period_length; i++) {
+        long sample = lrint(waveform[i]);
+        if (sample < this->min_value) {
+            sample = this->min_value;
+            num_overflows++;
+        } else if (sample > this->max_value) {
+            sample = this->max_value;
+            num_overflows++;
+        }
+        samples[i] = sample;
+    }
+    free(waveform);
+
+    free(this->samples);
+    this->samples = samples;
+    this->period_length = period_length;
+    this->num_overflows = num_overflows;
+    this->position = 0;
+    return 0;
+}
+
+/* copies the next nsamples samples of the waveform (one period after the
+   other) into buffer */
+void waveform_fill(waveform_t *this, short *buffer, int nsamples)
+{
+    int buffer_start = 0;
+    while (buffer_start < nsamples) {
+        int samples_copied = this->period_length - this->position;
+        if (samples_copied > nsamples - buffer_start) {
+            samples_copied = nsamples - buffer_start;
+        }
+        memcpy(&buffer[buffer_start], &this->samples[this->position], samples_copied * sizeof(short));
+        this->position += samples_copied;
+        if (this->position == this->period_length) {
+            this->position = 0;
+        }
+        buffer_start += samples_copied;
+    }
+    return;
+}
+
+/* internal functions */
+static int gcd(int a, int b) {
+    while (1) {
+        int c = a % b;
+        if (c == 0)
+            return b;
+        a = b;
+        b = c;
+    }
+}
+
+static int lcm(int a, int b) {
+    return (a / gcd(a, b)) * b;
+}
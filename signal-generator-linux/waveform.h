@@ -0,0 +1,86 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _SIGNAL_GENERATOR_WAVEFORM_H_
+#define _SIGNAL_GENERATOR_WAVEFORM_H_
+
+/* waveform synthesis (shared by the signal generator and the streaming
+   client, which calls it in process with --gen).
+   The waveform is the sum of its components (constant, sine, square,
+   triangular, and sweep), each with a frequency that is a fraction of the
+   sample rate; waveform_build() pre-computes one whole period of the sum
+   (the lcm of the denominators) as 14 bit samples, and waveform_fill()
+   copies that period over and over into the buffers */
+
+enum { WAVEFORM_MAX_COMPONENTS = 10 };
+enum { WAVEFORM_MAX_PERIOD_LENGTH = 1000000000 };
+
+/* typedefs */
+typedef struct {
+    double value;
+} constant_waveform_t;
+
+typedef struct {
+    int frequency_numerator;
+    int frequency_denominator;
+    double amplitude;
+    double initial_phase;
+} sine_waveform_t;
+
+typedef struct {
+    int frequency_numerator;
+    int frequency_denominator;
+    double amplitude;
+    double duty_cycle;
+    double initial_offset;
+} square_waveform_t;
+
+typedef struct {
+    int frequency_numerator;
+    int frequency_denominator;
+    double amplitude;
+    double initial_offset;
+} triangular_waveform_t;
+
+typedef struct {
+    int frequency_numerator;
+    int frequency_denominator;
+    double amplitude;
+    int flow_numerator;
+    int flow_denominator;
+    int fhigh_numerator;
+    int fhigh_denominator;
+    double initial_phase;
+} sweep_waveform_t;
+
+typedef struct {
+    constant_waveform_t constant_waveforms[WAVEFORM_MAX_COMPONENTS];
+    int num_constant_waveforms;
+    sine_waveform_t sine_waveforms[WAVEFORM_MAX_COMPONENTS];
+    int num_sine_waveforms;
+    square_waveform_t square_waveforms[WAVEFORM_MAX_COMPONENTS];
+    int num_square_waveforms;
+    triangular_waveform_t triangular_waveforms[WAVEFORM_MAX_COMPONENTS];
+    int num_triangular_waveforms;
+    sweep_waveform_t sweep_waveforms[WAVEFORM_MAX_COMPONENTS];
+    int num_sweep_waveforms;
+    int min_value;
+    int max_value;
+    /* one period (after waveform_build()) */
+    short *samples;
+    int period_length;
+    int num_overflows;              /* samples clipped to min_value/max_value */
+    int position;                   /* next sample for waveform_fill() */
+} waveform_t;
+
+int waveform_init(waveform_t *this);
+int waveform_fini(waveform_t *this);
+int waveform_add(waveform_t *this, char type, const char *spec);
+int waveform_parse(waveform_t *this, const char *spec);
+int waveform_build(waveform_t *this);
+void waveform_fill(waveform_t *this, short *buffer, int nsamples);
+
+#endif /* _SIGNAL_GENERATOR_WAVEFORM_H_ */
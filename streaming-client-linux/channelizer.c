@@ -0,0 +1,219 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "channelizer.h"
+#include "filter_design.h"
+#include "io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const int taps_per_branch = 16;
+static const double kaiser_beta = 8.0;
+static const float sample_scale = 1.0f / 8192.0f;   /* 14 bit ADC full scale */
+
+/* internal functions */
+static void compute_output(channelizer_t *this, int output_index);
+
+
+int channelizer_init(channelizer_t *this, int num_channels, int oversample, sample_select_t input, const int *channels, int num_selected_channels, const char *output_prefix)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (!(oversample == 1 || oversample == 2)) {
+        fprintf(stderr, "channelizer_init - oversampling factor must be 1 or 2: %d\n", oversample);
+        return -1;
+    }
+    if (fft_init(&this->fft, num_channels) == -1) {
+        return -1;
+    }
+    if (num_selected_channels <= 0) {
+        fprintf(stderr, "channelizer_init - no channels selected\n");
+        channelizer_fini(this);
+        return -1;
+    }
+
+    this->num_channels = num_channels;
+    this->decimation = num_channels / oversample;
+    this->filter_length = num_channels * taps_per_branch;
+    this->input = input;
+
+    this->filter = (float *) malloc(this->filter_length * sizeof(float));
+    this->delay_line = (float *) calloc(2 * this->filter_length, sizeof(float));
+    this->branch_sums = (float *) malloc(num_channels * sizeof(float));
+    this->fft_buffer = (fft_complex_t *) malloc(num_channels * sizeof(fft_complex_t));
+    if (this->filter == NULL || this->delay_line == NULL || this->branch_sums == NULL || this->fft_buffer == NULL) {
+        fprintf(stderr, "channelizer_init - malloc() failed\n");
+        channelizer_fini(this);
+        return -1;
+    }
+    /* prototype lowpass with cutoff at half the channel spacing */
+    filter_design_lowpass(this->filter, this->filter_length, 0.5 / num_channels, kaiser_beta);
+
+    this->output_channels = (int *) malloc(num_selected_channels * sizeof(int));
+    this->output_filenos = (int *) malloc(num_selected_channels * sizeof(int));
+    this->output_buffers = (fft_complex_t **) calloc(num_selected_channels, sizeof(fft_complex_t *));
+    if (this->output_channels == NULL || this->output_filenos == NULL || this->output_buffers == NULL) {
+        fprintf(stderr, "channelizer_init - malloc() failed\n");
+        channelizer_fini(this);
+        return -1;
+    }
+    for (int i = 0; i < num_selected_channels; i++) {
+        if (channels[i] < 0 || channels[i] >= num_channels) {
+            fprintf(stderr, "channelizer_init - invalid channel %d: valid range is [0-%d]\n", channels[i], num_channels - 1);
+            channelizer_fini(this);
+            return -1;
+        }
+        char filename[1024];
+        snprintf(filename, sizeof(filename), "%s-ch%d.cf32", output_prefix, channels[i]);
+        int fileno = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fileno == -1) {
+            fprintf(stderr, "open(%s) for writing failed: %s\n", filename, strerror(errno));
+            channelizer_fini(this);
+            return -1;
+        }
+        this->output_channels[i] = channels[i];
+        this->output_filenos[i] = fileno;
+        this->num_outputs++;
+    }
+
+    return 0;
+}
+
+int channelizer_fini(channelizer_t *this)
+{
+    for (int i = 0; i < this->num_outputs; i++) {
+        close(this->output_filenos[i]);
+        free(this->output_buffers[i]);
+    }
+    this->num_outputs = 0;
+    free(this->output_buffers);
+    free(this->output_filenos);
+    free(this->output_channels);
+    free(this->fft_buffer);
+    free(this->branch_sums);
+    free(this->delay_line);
+    free(this->filter);
+    this->output_buffers = NULL;
+    this->output_filenos = NULL;
+    this->output_channels = NULL;
+    this->fft_buffer = NULL;
+    this->branch_sums = NULL;
+    this->delay_line = NULL;
+    this->filter = NULL;
+    fft_fini(&this->fft);
+    return 0;
+}
+
+int channelizer_process(channelizer_t *this, const short *samples, int nsamples)
+{
+    int start = this->input == SAMPLE_SELECT_ODD ? 1 : 0;
+    int stride = this->input == SAMPLE_SELECT_ALL ? 1 : 2;
+
+    /* make sure the output buffers can hold all the outputs for this block */
+    int max_outputs = nsamples / stride / this->decimation + 1;
+    if (max_outputs > this->output_buffer_size) {
+        for (int i = 0; i < this->num_outputs; i++) {
+            fft_complex_t *output_buffer = (fft_complex_t *) realloc(this->output_buffers[i], max_outputs * sizeof(fft_complex_t));
+            if (output_buffer == NULL) {
+                fprintf(stderr, "channelizer_process - realloc() failed\n");
+                return -1;
+            }
+            this->output_buffers[i] = output_buffer;
+        }
+        this->output_buffer_size = max_outputs;
+    }
+
+    int filter_length = this->filter_length;
+    int noutputs = 0;
+    for (int i = start; i < nsamples; i += stride) {
+        /* the delay line is stored twice so the last filter_length samples
+           are always contiguous (newest first) starting at delay_line_index */
+        if (this->delay_line_index == 0) {
+            this->delay_line_index = filter_length;
+        }
+        this->delay_line_index--;
+        float value = samples[i] * sample_scale;
+        this->delay_line[this->delay_line_index] = value;
+        this->delay_line[this->delay_line_index + filter_length] = value;
+
+        if (++this->decimation_phase == this->decimation) {
+            this->decimation_phase = 0;
+            compute_output(this, noutputs);
+            noutputs++;
+        }
+    }
+
+    if (noutputs > 0) {
+        for (int i = 0; i < this->num_outputs; i++) {
+            if (io_write_all(this->output_filenos[i], this->output_buffers[i], noutputs * sizeof(fft_complex_t)) == -1) {
+                return -1;
+            }
+        }
+        this->output_samples += noutputs;
+    }
+
+    return 0;
+}
+
+void channelizer_stats(channelizer_t *this)
+{
+    fprintf(stderr, "channelizer: %d channels, decimation %d, %d outputs\n", this->num_channels, this->decimation, this->num_outputs);
+    fprintf(stderr, "channelizer samples per channel: %llu\n", this->output_samples);
+    return;
+}
+
+
+/* internal functions */
+/* channel m at time t (multiple of the decimation) is:
+     y_m(t) = sum_l h[l] x[t-l] exp(-j 2 pi m (t-l) / M)
+            = exp(-j 2 pi m t / M) * sum_r u[r] exp(j 2 pi m r / M)
+   with the polyphase branch sums u[r] = sum_p h[r+pM] x[t-r-pM];
+   since u[] is real the last sum is the complex conjugate of FFT(u)[m] */
+static void compute_output(channelizer_t *this, int output_index)
+{
+    int num_channels = this->num_channels;
+    int num_branches = this->filter_length / num_channels;
+    const float *window = this->delay_line + this->delay_line_index;
+    float *branch_sums = this->branch_sums;
+
+    for (int r = 0; r < num_channels; r++) {
+        branch_sums[r] = 0.0f;
+    }
+    for (int p = 0; p < num_branches; p++) {
+        const float *h = this->filter + p * num_channels;
+        const float *x = window + p * num_channels;
+        for (int r = 0; r < num_channels; r++) {
+            branch_sums[r] += h[r] * x[r];
+        }
+    }
+
+    for (int r = 0; r < num_channels; r++) {
+        this->fft_buffer[r].re = branch_sums[r];
+        this->fft_buffer[r].im = 0.0f;
+    }
+    fft_forward(&this->fft, this->fft_buffer);
+
+    /* with 2x oversampling t mod M alternates between 0 and M/2, i.e.
+       odd channels flip sign every other output */
+    bool flip = this->output_phase != 0;
+    for (int i = 0; i < this->num_outputs; i++) {
+        int m = this->output_channels[i];
+        float sign = (flip && (m & 1)) ? -1.0f : 1.0f;
+        this->output_buffers[i][output_index].re = sign * this->fft_buffer[m].re;
+        this->output_buffers[i][output_index].im = -sign * this->fft_buffer[m].im;
+    }
+    if (this->decimation != num_channels) {
+        this->output_phase ^= 1;
+    }
+
+    return;
+}
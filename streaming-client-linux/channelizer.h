@@ -0,0 +1,45 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_CHANNELIZER_H_
+#define _STREAMING_CLIENT_CHANNELIZER_H_
+
+#include "fft.h"
+#include "types.h"
+
+/* polyphase filter bank channelizer: splits the real ADC stream into
+   num_channels uniform complex channels (channel m centered at m/num_channels
+   of the sample rate) decimated by num_channels (critically sampled) or
+   by num_channels/2 (2x oversampled); the selected channels are written as
+   complex float32 (cf32) to <output_prefix>-ch<m>.cf32 */
+
+typedef struct {
+    int num_channels;
+    int decimation;
+    int filter_length;
+    sample_select_t input;
+    float *filter;               /* prototype lowpass filter (filter_length taps) */
+    float *delay_line;           /* 2 * filter_length; newest sample first */
+    int delay_line_index;
+    int decimation_phase;
+    int output_phase;            /* output time mod num_channels is 0 or num_channels/2 */
+    float *branch_sums;
+    fft_t fft;
+    fft_complex_t *fft_buffer;
+    int num_outputs;
+    int *output_channels;
+    int *output_filenos;
+    fft_complex_t **output_buffers;
+    int output_buffer_size;
+    unsigned long long output_samples;
+} channelizer_t;
+
+int channelizer_init(channelizer_t *this, int num_channels, int oversample, sample_select_t input, const int *channels, int num_selected_channels, const char *output_prefix);
+int channelizer_fini(channelizer_t *this);
+int channelizer_process(channelizer_t *this, const short *samples, int nsamples);
+void channelizer_stats(channelizer_t *this);
+
+#endif /* _STREAMING_CLIENT_CHANNELIZER_H_ */
@@ -0,0 +1,179 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "correction.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int adc_min = -8192;   /* 14 bit ADC range */
+static const int adc_max = 8191;
+static const int q = 14;            /* fixed point fractional bits */
+
+
+int correction_init(correction_t *this, const double offset[2], const double gain[2], bool calibrating)
+{
+    memset(this, 0, sizeof(*this));
+    this->calibrating = calibrating;
+    for (int c = 0; c < 2; c++) {
+        if (!(gain[c] > 0.0 && gain[c] < 2.0)) {
+            fprintf(stderr, "correction_init - gain must be in (0,2): %lf\n", gain[c]);
+            return -1;
+        }
+        this->offset[c] = offset[c];
+        this->gain[c] = gain[c];
+        this->gain_q14[c] = lrint(gain[c] * (1 << q));
+        /* (x - offset) * gain = x * gain - offset * gain */
+        this->bias_q14[c] = lrint(offset[c] * gain[c] * (1 << q));
+    }
+    return 0;
+}
+
+int correction_fini(correction_t *this)
+{
+    (void)this;
+    return 0;
+}
+
+void correction_process(correction_t *this, short *samples, int nsamples)
+{
+    const int32_t gain_even = this->gain_q14[0];
+    const int32_t gain_odd = this->gain_q14[1];
+    const int32_t bias_even = this->bias_q14[0] - (1 << (q - 1));   /* rounding */
+    const int32_t bias_odd = this->bias_q14[1] - (1 << (q - 1));
+
+    int npairs = nsamples / 2;
+    for (int i = 0; i < npairs; i++) {
+        int32_t even = (samples[2 * i] * gain_even - bias_even) >> q;
+        int32_t odd = (samples[2 * i + 1] * gain_odd - bias_odd) >> q;
+        even = even < adc_min ? adc_min : even > adc_max ? adc_max : even;
+        odd = odd < adc_min ? adc_min : odd > adc_max ? adc_max : odd;
+        samples[2 * i] = even;
+        samples[2 * i + 1] = odd;
+    }
+    if (nsamples % 2 != 0) {
+        int32_t even = (samples[nsamples - 1] * gain_even - bias_even) >> q;
+        samples[nsamples - 1] = even < adc_min ? adc_min : even > adc_max ? adc_max : even;
+    }
+    return;
+}
+
+void correction_measure(correction_t *this, const short *samples, int nsamples)
+{
+    long long sum_even = 0;
+    long long sum_odd = 0;
+    int npairs = nsamples / 2;
+    for (int i = 0; i < npairs; i++) {
+        sum_even += samples[2 * i];
+        sum_odd += samples[2 * i + 1];
+    }
+    if (nsamples % 2 != 0) {
+        sum_even += samples[nsamples - 1];
+    }
+    this->sum[0] += sum_even;
+    this->sum[1] += sum_odd;
+    this->count[0] += nsamples - npairs;
+    this->count[1] += npairs;
+    return;
+}
+
+int correction_measured_offsets(const correction_t *this, double offset[2])
+{
+    if (this->count[0] == 0 || this->count[1] == 0) {
+        fprintf(stderr, "correction_measured_offsets - no samples measured\n");
+        return -1;
+    }
+    for (int c = 0; c < 2; c++) {
+        offset[c] = (double) this->sum[c] / this->count[c];
+    }
+    return 0;
+}
+
+void correction_stats(correction_t *this)
+{
+    if (this->calibrating) {
+        double offset[2];
+        if (correction_measured_offsets(this, offset) == 0) {
+            fprintf(stderr, "measured DC offsets: even=%.3lf odd=%.3lf (%llu samples)\n", offset[0], offset[1], this->count[0] + this->count[1]);
+        }
+    } else {
+        fprintf(stderr, "correction: even offset=%.3lf gain=%.5lf - odd offset=%.3lf gain=%.5lf\n", this->offset[0], this->gain[0], this->offset[1], this->gain[1]);
+    }
+    return;
+}
+
+/* returns 0 if found, 1 if there is no entry for the serial number, -1 on error */
+int correction_load(const char *calibration_file, const char *serial_number, double offset[2], double gain[2])
+{
+    FILE *fp = fopen(calibration_file, "r");
+    if (fp == NULL) {
+        if (errno == ENOENT) {
+            return 1;
+        }
+        fprintf(stderr, "fopen(%s) for reading failed: %s\n", calibration_file, strerror(errno));
+        return -1;
+    }
+
+    int status = 1;
+    char line[256];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char serial[128];
+        double o[2], g[2];
+        if (line[0] == '#' || sscanf(line, "%127s %lf %lf %lf %lf", serial, &o[0], &o[1], &g[0], &g[1]) != 5) {
+            continue;
+        }
+        if (strcmp(serial, serial_number) == 0) {
+            offset[0] = o[0];
+            offset[1] = o[1];
+            gain[0] = g[0];
+            gain[1] = g[1];
+            status = 0;
+        }
+    }
+    fclose(fp);
+    return status;
+}
+
+/* replace (or add) the entry for the serial number */
+int correction_save(const char *calibration_file, const char *serial_number, const double offset[2], const double gain[2])
+{
+    char tmp_file[1024];
+    snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", calibration_file);
+    FILE *out = fopen(tmp_file, "w");
+    if (out == NULL) {
+        fprintf(stderr, "fopen(%s) for writing failed: %s\n", tmp_file, strerror(errno));
+        return -1;
+    }
+
+    FILE *in = fopen(calibration_file, "r");
+    if (in != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), in) != NULL) {
+            char serial[128];
+            if (sscanf(line, "%127s", serial) == 1 && strcmp(serial, serial_number) == 0) {
+                continue;
+            }
+            fputs(line, out);
+        }
+        fclose(in);
+    } else {
+        fprintf(out, "# serial_number offset_even offset_odd gain_even gain_odd\n");
+    }
+    fprintf(out, "%s %.4lf %.4lf %.6lf %.6lf\n", serial_number, offset[0], offset[1], gain[0], gain[1]);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "fclose(%s) failed: %s\n", tmp_file, strerror(errno));
+        return -1;
+    }
+    if (rename(tmp_file, calibration_file) == -1) {
+        fprintf(stderr, "rename(%s, %s) failed: %s\n", tmp_file, calibration_file, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
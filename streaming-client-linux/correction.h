@@ -0,0 +1,42 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_CORRECTION_H_
+#define _STREAMING_CLIENT_CORRECTION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* DC offset and gain correction for the even and odd samples:
+       y = (x - offset) * gain
+   computed in Q14 fixed point and saturated to the 14 bit ADC range;
+   in calibration mode the samples are not changed and the mean of the even
+   and odd samples (i.e. their DC offset with a terminated input) is measured.
+   The calibration file has one line per device:
+       serial_number offset_even offset_odd gain_even gain_odd */
+
+typedef struct {
+    bool calibrating;
+    double offset[2];
+    double gain[2];
+    int32_t gain_q14[2];
+    int32_t bias_q14[2];
+    /* calibration */
+    long long sum[2];
+    unsigned long long count[2];
+} correction_t;
+
+int correction_init(correction_t *this, const double offset[2], const double gain[2], bool calibrating);
+int correction_fini(correction_t *this);
+void correction_process(correction_t *this, short *samples, int nsamples);
+void correction_measure(correction_t *this, const short *samples, int nsamples);
+int correction_measured_offsets(const correction_t *this, double offset[2]);
+void correction_stats(correction_t *this);
+
+int correction_load(const char *calibration_file, const char *serial_number, double offset[2], double gain[2]);
+int correction_save(const char *calibration_file, const char *serial_number, const double offset[2], const double gain[2]);
+
+#endif /* _STREAMING_CLIENT_CORRECTION_H_ */
@@ -0,0 +1,86 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "decimator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int decimator_init(decimator_t *this, int factor, sample_select_t input, int max_input_samples)
+{
+    memset(this, 0, sizeof(*this));
+    if (factor < 1 || factor > 65536) {
+        fprintf(stderr, "decimator_init - invalid decimation factor: %d\n", factor);
+        return -1;
+    }
+    this->factor = factor;
+    this->input = input;
+    this->stride = input == SAMPLE_SELECT_ALL ? 1 : 2;
+    this->phase = input == SAMPLE_SELECT_ODD ? 1 : 0;
+    this->output_capacity = max_input_samples / this->stride / factor + 1;
+    this->output = (short *) malloc(this->output_capacity * sizeof(short));
+    if (this->output == NULL) {
+        fprintf(stderr, "decimator_init - malloc() failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+int decimator_fini(decimator_t *this)
+{
+    free(this->output);
+    this->output = NULL;
+    return 0;
+}
+
+/* pipeline stage: the context is the decimator; the decimated block goes to
+   the outputs of the stage */
+int decimator_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    decimator_t *this = (decimator_t *) stage->context;
+    const short *samples = block->samples;
+    int stride = this->stride;
+    int factor = this->factor;
+    int count = this->count;
+    int sum = this->sum;
+    int noutput = 0;
+
+    for (int i = this->phase; i < block->nsamples; i += stride) {
+        sum += samples[i];
+        if (++count == factor) {
+            /* round to nearest */
+            this->output[noutput++] = (sum + (sum >= 0 ? factor / 2 : -factor / 2)) / factor;
+            sum = 0;
+            count = 0;
+            if (noutput == this->output_capacity) {
+                break;
+            }
+        }
+    }
+    this->count = count;
+    this->sum = sum;
+    this->input_samples += block->nsamples;
+    if (noutput == 0) {
+        return 0;
+    }
+
+    pipeline_block_t output = {
+        .samples = this->output,
+        .nsamples = noutput,
+        .sample_offset = this->output_offset
+    };
+    this->output_offset += noutput;
+    this->output_samples += noutput;
+    return pipeline_emit(stage, &output);
+}
+
+void decimator_stats(decimator_t *this)
+{
+    fprintf(stderr, "decimator: factor %d - %llu input samples, %llu output samples\n", this->factor, this->input_samples, this->output_samples);
+    return;
+}
@@ -0,0 +1,38 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_DECIMATOR_H_
+#define _STREAMING_CLIENT_DECIMATOR_H_
+
+#include "pipeline.h"
+#include "types.h"
+
+/* boxcar decimator for monitor streams: every output sample is the average
+   of factor consecutive input samples (of the selected ADC in DUAL-ADC mode).
+   Its alias rejection is poor, so it is meant for monitoring, not for
+   measurements */
+
+typedef struct {
+    int factor;
+    sample_select_t input;
+    int stride;
+    int phase;
+    int count;                      /* samples in the current average */
+    int sum;
+    short *output;
+    int output_capacity;
+    unsigned long long output_offset;
+    /* stats */
+    unsigned long long input_samples;
+    unsigned long long output_samples;
+} decimator_t;
+
+int decimator_init(decimator_t *this, int factor, sample_select_t input, int max_input_samples);
+int decimator_fini(decimator_t *this);
+int decimator_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+void decimator_stats(decimator_t *this);
+
+#endif /* _STREAMING_CLIENT_DECIMATOR_H_ */
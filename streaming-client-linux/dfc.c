@@ -7,6 +7,7 @@
 #include "dfc.h"
 
 #include <stdio.h>
+#include <unistd.h>
 
 const uint8_t* dfc_fx3_get_fw_version(dfc_t *this)
 {
@@ -121,3 +122,76 @@ int dfc_fx3_wakeup_dac(dfc_t *this)
 
     return 0;
 }
+
+/* set the DFC mode, power up the ADC or the DAC, start the Si5351 clock
+   (reference and samplerate in Hz) and then the FX3 */
+int dfc_configure(dfc_t *this, dfc_mode_t dfc_mode, double reference, double samplerate)
+{
+    int status;
+
+    if (!(dfc_mode == DFC_MODE_UNKNOWN || dfc_mode == UART_ONLY)) {
+        const uint8_t SETMODE = 0x90;
+        uint8_t data = dfc_mode;
+        status = usb_control_write(&this->usb_device, SETMODE, &data, sizeof(data));
+        if (status != 0) {
+            fprintf(stderr, "set DFC mode to %d failed\n", dfc_mode);
+            return -1;
+        }
+    }
+
+    /* wait a few ms before using the new mode */
+    usleep(20000);
+
+    uint8_t current_dfc_mode = dfc_fx3_get_mode(this);
+    fprintf(stderr, "DFC mode: %hhu\n", current_dfc_mode);
+
+    if (current_dfc_mode != dfc_mode) {
+        fprintf(stderr, "[ERROR] Current DFC mode: %hhu - expected: %d\n", current_dfc_mode, dfc_mode);
+        return -1;
+    }
+
+    if (dfc_mode == SINGLE_ADC || dfc_mode == DUAL_ADC) {
+        status = dfc_fx3_wakeup_adc(this);
+        if (status == -1) {
+            return -1;
+        }
+
+        status = dfc_fx3_shutdown_dac(this);
+        if (status == -1) {
+            return -1;
+        }
+    } else if (dfc_mode == DAC || dfc_mode == DAC_FX3_CLOCK) {
+        status = dfc_fx3_shutdown_adc(this);
+        if (status == -1) {
+            return -1;
+        }
+
+        status = dfc_fx3_wakeup_dac(this);
+        if (status == -1) {
+            return -1;
+        }
+#define _FX3_CLOCK_TEST_
+#ifdef _FX3_CLOCK_TEST_
+    } else if (dfc_mode == SINGLE_ADC_FX3_CLOCK) {
+        fprintf(stderr, "shutting down ADC\n");
+        status = dfc_fx3_shutdown_adc(this);
+        if (status == -1) {
+            return -1;
+        }
+#endif  /* _FX3_CLOCK_TEST_ */
+    }
+
+    if (!(dfc_mode == SINGLE_ADC_FX3_CLOCK || dfc_mode == DAC_FX3_CLOCK)) {
+        status = clock_start(&this->clock, &this->usb_device, reference, samplerate);
+        if (status == -1) {
+            return -1;
+        }
+    }
+
+    status = dfc_fx3_start(this);
+    if (status == -1) {
+        return -1;
+    }
+
+    return 0;
+}
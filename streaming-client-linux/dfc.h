@@ -10,6 +10,16 @@
 #include "usb.h"
 #include "clock.h"
 
+typedef enum {
+    UART_ONLY,
+    SINGLE_ADC,
+    DUAL_ADC,
+    DAC,
+    SINGLE_ADC_FX3_CLOCK,
+    DAC_FX3_CLOCK,
+    DFC_MODE_UNKNOWN = -1
+} dfc_mode_t;
+
 typedef struct {
     usb_device_t usb_device;
     dfcclock_t clock;
@@ -23,5 +33,6 @@ int dfc_fx3_shutdown_adc(dfc_t *this);
 int dfc_fx3_wakeup_adc(dfc_t *this);
 int dfc_fx3_shutdown_dac(dfc_t *this);
 int dfc_fx3_wakeup_dac(dfc_t *this);
+int dfc_configure(dfc_t *this, dfc_mode_t dfc_mode, double reference, double samplerate);
 
 #endif /* _STREAMING_CLIENT_DFC_H_ */
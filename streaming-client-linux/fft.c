@@ -0,0 +1,92 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "fft.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int fft_init(fft_t *this, int size)
+{
+    if (size < 2 || (size & (size - 1)) != 0) {
+        fprintf(stderr, "fft_init - size must be a power of 2: %d\n", size);
+        return -1;
+    }
+
+    this->size = size;
+    this->log2size = 0;
+    while ((1 << this->log2size) < size) {
+        this->log2size++;
+    }
+
+    this->bitrev = (int *) malloc(size * sizeof(int));
+    this->twiddles = (fft_complex_t *) malloc(size / 2 * sizeof(fft_complex_t));
+    if (this->bitrev == NULL || this->twiddles == NULL) {
+        fprintf(stderr, "fft_init - malloc() failed\n");
+        fft_fini(this);
+        return -1;
+    }
+
+    for (int i = 0; i < size; i++) {
+        int r = 0;
+        for (int b = 0; b < this->log2size; b++) {
+            r |= ((i >> b) & 1) << (this->log2size - 1 - b);
+        }
+        this->bitrev[i] = r;
+    }
+
+    /* twiddles[k] = exp(-j 2 pi k / size) */
+    for (int k = 0; k < size / 2; k++) {
+        double phase = -2.0 * M_PI * k / size;
+        this->twiddles[k].re = cos(phase);
+        this->twiddles[k].im = sin(phase);
+    }
+
+    return 0;
+}
+
+int fft_fini(fft_t *this)
+{
+    free(this->bitrev);
+    this->bitrev = NULL;
+    free(this->twiddles);
+    this->twiddles = NULL;
+    return 0;
+}
+
+/* X[k] = sum_n x[n] exp(-j 2 pi k n / size) */
+void fft_forward(const fft_t *this, fft_complex_t *data)
+{
+    int size = this->size;
+
+    for (int i = 0; i < size; i++) {
+        int j = this->bitrev[i];
+        if (i < j) {
+            fft_complex_t tmp = data[i];
+            data[i] = data[j];
+            data[j] = tmp;
+        }
+    }
+
+    for (int half = 1, stride = size / 2; half < size; half *= 2, stride /= 2) {
+        for (int start = 0; start < size; start += 2 * half) {
+            fft_complex_t *a = data + start;
+            fft_complex_t *b = data + start + half;
+            for (int k = 0; k < half; k++) {
+                fft_complex_t w = this->twiddles[k * stride];
+                float tre = b[k].re * w.re - b[k].im * w.im;
+                float tim = b[k].re * w.im + b[k].im * w.re;
+                b[k].re = a[k].re - tre;
+                b[k].im = a[k].im - tim;
+                a[k].re += tre;
+                a[k].im += tim;
+            }
+        }
+    }
+
+    return;
+}
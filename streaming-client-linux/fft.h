@@ -0,0 +1,28 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_FFT_H_
+#define _STREAMING_CLIENT_FFT_H_
+
+/* in-place radix-2 complex FFT (size must be a power of 2) */
+
+typedef struct {
+    float re;
+    float im;
+} fft_complex_t;
+
+typedef struct {
+    int size;
+    int log2size;
+    int *bitrev;
+    fft_complex_t *twiddles;
+} fft_t;
+
+int fft_init(fft_t *this, int size);
+int fft_fini(fft_t *this);
+void fft_forward(const fft_t *this, fft_complex_t *data);
+
+#endif /* _STREAMING_CLIENT_FFT_H_ */
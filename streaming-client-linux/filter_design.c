@@ -0,0 +1,51 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "filter_design.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/* internal functions */
+static double bessel_i0(double x);
+
+
+void filter_design_lowpass(float *filter, int filter_length, double cutoff, double kaiser_beta)
+{
+    double center = (filter_length - 1) / 2.0;
+    double i0_beta = bessel_i0(kaiser_beta);
+    double sum = 0.0;
+    double *h = (double *) malloc(filter_length * sizeof(double));
+    for (int i = 0; i < filter_length; i++) {
+        double t = i - center;
+        double sinc = t == 0.0 ? 1.0 : sin(2.0 * M_PI * cutoff * t) / (2.0 * M_PI * cutoff * t);
+        double r = 2.0 * t / (filter_length - 1);
+        double window = bessel_i0(kaiser_beta * sqrt(1.0 - r * r)) / i0_beta;
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+    for (int i = 0; i < filter_length; i++) {
+        filter[i] = h[i] / sum;
+    }
+    free(h);
+    return;
+}
+
+
+/* internal functions */
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < 1e-12 * sum) {
+            break;
+        }
+    }
+    return sum;
+}
@@ -0,0 +1,16 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_FILTER_DESIGN_H_
+#define _STREAMING_CLIENT_FILTER_DESIGN_H_
+
+/* FIR filter design shared by the channelizer (RX) and the interpolator (TX):
+   Kaiser windowed sinc lowpass with the cutoff in cycles/sample (0.5 is
+   Nyquist) and unity gain at DC */
+
+void filter_design_lowpass(float *filter, int filter_length, double cutoff, double kaiser_beta);
+
+#endif /* _STREAMING_CLIENT_FILTER_DESIGN_H_ */
@@ -0,0 +1,86 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "history.h"
+#include "io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int history_init(history_t *this, int capacity)
+{
+    this->buffer = NULL;
+    this->capacity = capacity;
+    this->index = 0;
+    this->fill = 0;
+    this->end_offset = 0;
+    if (capacity > 0) {
+        this->buffer = (short *) malloc(capacity * sizeof(short));
+        if (this->buffer == NULL) {
+            fprintf(stderr, "history_init - malloc() failed\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int history_fini(history_t *this)
+{
+    free(this->buffer);
+    this->buffer = NULL;
+    return 0;
+}
+
+void history_update(history_t *this, const short *samples, int nsamples)
+{
+    int capacity = this->capacity;
+    this->end_offset += nsamples;
+    if (capacity == 0) {
+        return;
+    }
+    if (nsamples >= capacity) {
+        memcpy(this->buffer, samples + nsamples - capacity, capacity * sizeof(short));
+        this->index = 0;
+        this->fill = capacity;
+        return;
+    }
+    int n1 = nsamples < capacity - this->index ? nsamples : capacity - this->index;
+    memcpy(this->buffer + this->index, samples, n1 * sizeof(short));
+    memcpy(this->buffer, samples + n1, (nsamples - n1) * sizeof(short));
+    this->index = (this->index + nsamples) % capacity;
+    this->fill = this->fill + nsamples < capacity ? this->fill + nsamples : capacity;
+    return;
+}
+
+/* stream offset of the oldest sample still available */
+unsigned long long history_start_offset(const history_t *this)
+{
+    return this->end_offset - this->fill;
+}
+
+/* write the samples from start_offset (clamped to what is available) up to
+   the newest one; returns the number of samples written or -1 */
+int history_write(const history_t *this, int fileno, unsigned long long start_offset)
+{
+    if (start_offset < history_start_offset(this)) {
+        start_offset = history_start_offset(this);
+    }
+    if (start_offset >= this->end_offset) {
+        return 0;
+    }
+    int n = this->end_offset - start_offset;
+    int capacity = this->capacity;
+    int first = (this->index - n + capacity) % capacity;
+    int n1 = n < capacity - first ? n : capacity - first;
+    if (io_write_all(fileno, this->buffer + first, n1 * sizeof(short)) == -1) {
+        return -1;
+    }
+    if (n > n1 && io_write_all(fileno, this->buffer, (n - n1) * sizeof(short)) == -1) {
+        return -1;
+    }
+    return n;
+}
@@ -0,0 +1,27 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_HISTORY_H_
+#define _STREAMING_CLIENT_HISTORY_H_
+
+/* ring buffer with the most recent samples of the RX stream, used to write
+   out samples from before the current block (pre-trigger, padding) */
+
+typedef struct {
+    short *buffer;
+    int capacity;
+    int index;                          /* next write position */
+    int fill;
+    unsigned long long end_offset;      /* stream offset after the newest sample */
+} history_t;
+
+int history_init(history_t *this, int capacity);
+int history_fini(history_t *this);
+void history_update(history_t *this, const short *samples, int nsamples);
+unsigned long long history_start_offset(const history_t *this);
+int history_write(const history_t *this, int fileno, unsigned long long start_offset);
+
+#endif /* _STREAMING_CLIENT_HISTORY_H_ */
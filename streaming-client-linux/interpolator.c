@@ -0,0 +1,124 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "interpolator.h"
+#include "filter_design.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int taps_per_phase = 32;     /* multiple of 4 (see filter_chunk()) */
+static const double kaiser_beta = 8.0;
+static const int max_factor = 1000;
+
+/* input samples filtered at a time (the outputs of one phase stay in L1) */
+#define CHUNK_SAMPLES 256
+
+/* the FIR is the hot spot at the DAC rate (taps_per_phase multiply-adds for
+   each output sample): on x86-64 it is also built for AVX/FMA, and the
+   version for the CPU is selected when the program is loaded */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define FIR_TARGET_CLONES __attribute__((target_clones("fma", "default")))
+#else
+#define FIR_TARGET_CLONES
+#endif
+
+/* internal functions */
+static void filter_chunk(const float *restrict filter, int factor, int taps, const float *restrict input, int ninput, float *restrict output);
+
+
+int interpolator_init(interpolator_t *this, int factor, int max_input_samples)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (factor < 2 || factor > max_factor) {
+        fprintf(stderr, "interpolator_init - interpolation factor must be between 2 and %d: %d\n", max_factor, factor);
+        return -1;
+    }
+
+    this->factor = factor;
+    this->taps_per_phase = taps_per_phase;
+    this->max_input_samples = max_input_samples;
+
+    int filter_length = factor * taps_per_phase;
+    float *prototype = (float *) malloc(filter_length * sizeof(float));
+    this->filter = (float *) malloc(filter_length * sizeof(float));
+    this->delay_line = (float *) calloc(taps_per_phase - 1 + max_input_samples, sizeof(float));
+    if (prototype == NULL || this->filter == NULL || this->delay_line == NULL) {
+        fprintf(stderr, "interpolator_init - malloc() failed\n");
+        free(prototype);
+        interpolator_fini(this);
+        return -1;
+    }
+    this->input = this->delay_line + taps_per_phase - 1;
+
+    /* cutoff at the input Nyquist frequency, and gain factor so that each
+       phase has unity gain at DC */
+    filter_design_lowpass(prototype, filter_length, 0.5 / factor, kaiser_beta);
+    for (int p = 0; p < factor; p++) {
+        for (int k = 0; k < taps_per_phase; k++) {
+            this->filter[p * taps_per_phase + k] = prototype[k * factor + p] * factor;
+        }
+    }
+    free(prototype);
+
+    return 0;
+}
+
+int interpolator_fini(interpolator_t *this)
+{
+    free(this->delay_line);
+    this->delay_line = NULL;
+    this->input = NULL;
+    free(this->filter);
+    this->filter = NULL;
+    return 0;
+}
+
+/* filters the ninput samples in this->input into ninput * factor output samples */
+void interpolator_process(interpolator_t *this, int ninput, float *output)
+{
+    int history = this->taps_per_phase - 1;
+    for (int n = 0; n < ninput; n += CHUNK_SAMPLES) {
+        int nchunk = ninput - n < CHUNK_SAMPLES ? ninput - n : CHUNK_SAMPLES;
+        filter_chunk(this->filter, this->factor, this->taps_per_phase, this->input + n, nchunk, output + n * this->factor);
+    }
+    memmove(this->delay_line, this->delay_line + ninput, history * sizeof(float));
+    return;
+}
+
+
+/* internal functions */
+/* output sample n * factor + p is phase p of the filter applied to the input
+   up to sample n: y_p[n] = sum_k h[k * factor + p] x[n-k].
+   Each phase is computed for the whole chunk four taps at a time, so the
+   inner loops run along the input samples, with no reductions, and the
+   compiler vectorizes them (four taps instead of one load and store y[]
+   a quarter of the times) */
+static void FIR_TARGET_CLONES filter_chunk(const float *restrict filter, int factor, int taps, const float *restrict input, int ninput, float *restrict output)
+{
+    float y[CHUNK_SAMPLES];
+    for (int p = 0; p < factor; p++) {
+        const float *h = filter + p * taps;
+        for (int i = 0; i < ninput; i++) {
+            y[i] = h[0] * input[i] + h[1] * input[i - 1] + h[2] * input[i - 2] + h[3] * input[i - 3];
+        }
+        for (int k = 4; k < taps; k += 4) {
+            float h0 = h[k];
+            float h1 = h[k + 1];
+            float h2 = h[k + 2];
+            float h3 = h[k + 3];
+            for (int i = 0; i < ninput; i++) {
+                y[i] += h0 * input[i - k] + h1 * input[i - k - 1] + h2 * input[i - k - 2] + h3 * input[i - k - 3];
+            }
+        }
+        for (int i = 0; i < ninput; i++) {
+            output[i * factor + p] = y[i];
+        }
+    }
+    return;
+}
@@ -0,0 +1,31 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_INTERPOLATOR_H_
+#define _STREAMING_CLIENT_INTERPOLATOR_H_
+
+/* polyphase FIR interpolator for TX: every input sample becomes factor
+   output samples, one for each phase of the filter (a Kaiser windowed sinc
+   with cutoff at the input Nyquist frequency), so a low rate input can be
+   sent at the DAC sample rate.
+   The caller writes the input samples to this->input (up to
+   max_input_samples at a time), and interpolator_process() filters them;
+   the last samples are kept as the history for the next block */
+
+typedef struct {
+    int factor;
+    int taps_per_phase;
+    float *filter;                  /* filter[p * taps_per_phase + k] = h[k * factor + p] */
+    float *delay_line;              /* history (taps_per_phase - 1) + input */
+    float *input;
+    int max_input_samples;
+} interpolator_t;
+
+int interpolator_init(interpolator_t *this, int factor, int max_input_samples);
+int interpolator_fini(interpolator_t *this);
+void interpolator_process(interpolator_t *this, int ninput, float *output);
+
+#endif /* _STREAMING_CLIENT_INTERPOLATOR_H_ */
@@ -0,0 +1,47 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "io.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* write the whole buffer, retrying on partial writes */
+int io_write_all(int fileno, const void *buffer, size_t length)
+{
+    const uint8_t *data = (const uint8_t *)buffer;
+    size_t remaining = length;
+    while (remaining > 0) {
+        ssize_t written = write(fileno, data + (length - remaining), remaining);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "write to output file failed - error: %s\n", strerror(errno));
+            return -1;
+        }
+        remaining -= written;
+    }
+    return 0;
+}
+
+/* pipeline stage writing the samples to a file; the context points to the
+   file descriptor, which is set to -1 after a write error */
+int io_write_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    int *fileno = (int *) stage->context;
+    if (*fileno < 0) {
+        return 0;
+    }
+    if (io_write_all(*fileno, block->samples, block->nsamples * sizeof(short)) == -1) {
+        fprintf(stderr, "stage %s - stopped writing\n", stage->name);
+        *fileno = -1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_IO_H_
+#define _STREAMING_CLIENT_IO_H_
+
+#include <stddef.h>
+#include "pipeline.h"
+
+int io_write_all(int fileno, const void *buffer, size_t length);
+int io_write_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+
+#endif /* _STREAMING_CLIENT_IO_H_ */
@@ -0,0 +1,537 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "libdfc.h"
+#include "dfc.h"
+#include "stream.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* FX3 streamer: 1024 byte packets with a burst of 16 */
+static const int LOOPBACK_PACKET_SIZE = 16384;
+
+/* a queue of buffer indexes */
+typedef struct {
+    int *indexes;
+    int size;
+    int head;
+    int count;
+} libdfc_queue_t;
+
+struct libdfc_device {
+    dfc_t dfc;
+    bool loopback;
+    libdfc_mode_t mode;
+    stream_direction_t direction;
+    double samplerate;
+    bool configured;
+    bool started;
+    bool allocated;             /* buffers from the last start */
+    libdfc_callback_t callback;
+    void *callback_context;
+    stream_t stream;
+    /* loopback */
+    bool throttle;
+    int num_buffers;
+    int buffer_size;
+    uint8_t **buffers;
+    libdfc_queue_t ready;       /* buffers for the user */
+    libdfc_queue_t pending;     /* buffers for the loopback thread */
+    pthread_mutex_t mutex;
+    pthread_cond_t ready_cond;
+    pthread_cond_t pending_cond;
+    pthread_t thread;
+    bool running;
+    bool stop;
+    bool overflow;
+    unsigned long long overflows;
+    unsigned long long sample_offset;
+};
+
+/* internal functions */
+static int libdfc_loopback_start(libdfc_device_t *device, int num_packets_per_transfer, int num_transfers);
+static void libdfc_loopback_stop(libdfc_device_t *device);
+static void libdfc_free_buffers(libdfc_device_t *device);
+static int libdfc_stream_callback(void *context, uint8_t *buffer, int length);
+static void *libdfc_loopback_thread(void *arg);
+static void queue_push(libdfc_queue_t *queue, int index);
+static int queue_pop(libdfc_queue_t *queue);
+
+
+int libdfc_api_version(void)
+{
+    return LIBDFC_API_VERSION;
+}
+
+libdfc_device_t *libdfc_open(const char *firmware_file)
+{
+    return libdfc_open_serial(NULL, firmware_file);
+}
+
+/* serial_number: the FX3 to use (NULL: the first one found); firmware_file
+   NULL: the FX3s in DFU mode are not flashed (see libdfc.h) */
+libdfc_device_t *libdfc_open_serial(const char *serial_number, const char *firmware_file)
+{
+    libdfc_device_t *device = (libdfc_device_t *) calloc(1, sizeof(libdfc_device_t));
+    if (device == NULL) {
+        fprintf(stderr, "libdfc_open_serial - calloc() failed\n");
+        return NULL;
+    }
+    if (usb_init(&device->dfc.usb_device, firmware_file, serial_number) == -1) {
+        free(device);
+        return NULL;
+    }
+    fprintf(stderr, "DFC FW version: %s\n", dfc_fx3_get_fw_version(&device->dfc));
+    return device;
+}
+
+libdfc_device_t *libdfc_open_loopback(bool throttle)
+{
+    libdfc_device_t *device = (libdfc_device_t *) calloc(1, sizeof(libdfc_device_t));
+    if (device == NULL) {
+        fprintf(stderr, "libdfc_open_loopback - calloc() failed\n");
+        return NULL;
+    }
+    device->loopback = true;
+    device->throttle = throttle;
+    pthread_mutex_init(&device->mutex, NULL);
+    pthread_cond_init(&device->ready_cond, NULL);
+    pthread_cond_init(&device->pending_cond, NULL);
+    return device;
+}
+
+void libdfc_close(libdfc_device_t *device)
+{
+    if (device == NULL) {
+        return;
+    }
+    if (device->started) {
+        libdfc_stop(device);
+    }
+    libdfc_free_buffers(device);
+    if (device->loopback) {
+        pthread_cond_destroy(&device->pending_cond);
+        pthread_cond_destroy(&device->ready_cond);
+        pthread_mutex_destroy(&device->mutex);
+    } else {
+        if (device->configured) {
+            dfc_fx3_stop(&device->dfc);
+        }
+        usb_close(&device->dfc.usb_device);
+    }
+    free(device);
+    return;
+}
+
+/* samplerate, reference_clock in Hz; reference_ppm is the correction for the reference clock */
+int libdfc_configure(libdfc_device_t *device, libdfc_mode_t mode, double samplerate, double reference_clock, double reference_ppm)
+{
+    if (device->started) {
+        fprintf(stderr, "libdfc_configure - the device is streaming\n");
+        return -1;
+    }
+    if (!(mode == LIBDFC_SINGLE_ADC || mode == LIBDFC_DUAL_ADC || mode == LIBDFC_DAC || mode == LIBDFC_SINGLE_ADC_FX3_CLOCK || mode == LIBDFC_DAC_FX3_CLOCK)) {
+        fprintf(stderr, "libdfc_configure - invalid DFC mode: %d\n", mode);
+        return -1;
+    }
+    stream_direction_t direction = mode == LIBDFC_DAC || mode == LIBDFC_DAC_FX3_CLOCK ? STREAM_TX : STREAM_RX;
+    if (!device->loopback) {
+        if (device->configured) {
+            dfc_fx3_stop(&device->dfc);
+            device->configured = false;
+        }
+        if (usb_open(&device->dfc.usb_device, 0, 0, 0, -1, direction) == -1) {
+            return -1;
+        }
+        if (dfc_configure(&device->dfc, (dfc_mode_t) mode, reference_clock * (1.0 + 1e-6 * reference_ppm), samplerate) == -1) {
+            return -1;
+        }
+    }
+    device->mode = mode;
+    device->direction = direction;
+    device->samplerate = samplerate;
+    device->configured = true;
+    return 0;
+}
+
+/* callback mode (NULL: back to libdfc_acquire_buffer()/libdfc_release_buffer());
+   only while the device is not streaming */
+int libdfc_set_callback(libdfc_device_t *device, libdfc_callback_t callback, void *context)
+{
+    if (device->started) {
+        fprintf(stderr, "libdfc_set_callback - the device is streaming\n");
+        return -1;
+    }
+    device->callback = callback;
+    device->callback_context = context;
+    return 0;
+}
+
+int libdfc_start(libdfc_device_t *device, int num_packets_per_transfer, int num_transfers)
+{
+    if (!device->configured) {
+        fprintf(stderr, "libdfc_start - the device is not configured\n");
+        return -1;
+    }
+    if (device->started) {
+        fprintf(stderr, "libdfc_start - the device is already streaming\n");
+        return -1;
+    }
+    libdfc_free_buffers(device);
+    /* already set for the TX callback filling the first buffers, which
+       may hold them and release them from within */
+    device->started = true;
+    if (device->loopback) {
+        if (libdfc_loopback_start(device, num_packets_per_transfer, num_transfers) == -1) {
+            device->started = false;
+            return -1;
+        }
+        return 0;
+    }
+    if (stream_init(&device->stream, device->direction, -1, &device->dfc.usb_device, num_packets_per_transfer, num_transfers, false) == -1) {
+        device->started = false;
+        return -1;
+    }
+    device->allocated = true;
+    device->stream.direct = true;
+    device->stream.event_thread = true;
+    if (device->callback != NULL) {
+        device->stream.direct_callback = libdfc_stream_callback;
+        device->stream.direct_context = device;
+    }
+    if (stream_start(&device->stream) == -1) {
+        stream_stop(&device->stream);
+        libdfc_free_buffers(device);
+        device->started = false;
+        return -1;
+    }
+    return 0;
+}
+
+/* the buffers stay valid (for a user still looking at them) until the
+   next libdfc_start() or libdfc_close() */
+int libdfc_stop(libdfc_device_t *device)
+{
+    if (!device->started) {
+        return 0;
+    }
+    device->started = false;
+    if (device->loopback) {
+        libdfc_loopback_stop(device);
+        return 0;
+    }
+    return stream_stop(&device->stream);
+}
+
+bool libdfc_is_rx(const libdfc_device_t *device)
+{
+    return device->direction == STREAM_RX;
+}
+
+int libdfc_num_buffers(const libdfc_device_t *device)
+{
+    return device->loopback ? device->num_buffers : device->stream.num_concurrent_transfers;
+}
+
+/* in bytes */
+int libdfc_buffer_size(const libdfc_device_t *device)
+{
+    return device->loopback ? device->buffer_size : device->stream.transfer_size;
+}
+
+/* in bytes */
+int libdfc_packet_size(const libdfc_device_t *device)
+{
+    return device->loopback ? LOOPBACK_PACKET_SIZE : device->dfc.usb_device.packet_size;
+}
+
+void *libdfc_buffer(const libdfc_device_t *device, int index)
+{
+    if (index < 0 || index >= libdfc_num_buffers(device)) {
+        return NULL;
+    }
+    return device->loopback ? device->buffers[index] : device->stream.buffers[index];
+}
+
+/* the other way around (-1 if it is not one of the transfer buffers) */
+int libdfc_buffer_index(const libdfc_device_t *device, const void *buffer)
+{
+    int num_buffers = libdfc_num_buffers(device);
+    for (int index = 0; index < num_buffers; index++) {
+        if (libdfc_buffer(device, index) == buffer) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/* returns the buffer index, LIBDFC_TIMEOUT, or -1 once the device is stopped */
+int libdfc_acquire_buffer(libdfc_device_t *device, void **buffer, int *length, long timeout_us)
+{
+    if (!device->started) {
+        return -1;
+    }
+    if (!device->loopback) {
+        uint8_t *transfer_buffer;
+        int index = stream_acquire_buffer(&device->stream, &transfer_buffer, length, timeout_us);
+        if (index >= 0) {
+            *buffer = transfer_buffer;
+        }
+        return index == STREAM_TIMEOUT ? LIBDFC_TIMEOUT : index;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&device->mutex);
+    while (device->ready.count == 0) {
+        if (device->stop) {
+            pthread_mutex_unlock(&device->mutex);
+            return -1;
+        }
+        if (pthread_cond_timedwait(&device->ready_cond, &device->mutex, &deadline) == ETIMEDOUT && device->ready.count == 0) {
+            pthread_mutex_unlock(&device->mutex);
+            return LIBDFC_TIMEOUT;
+        }
+    }
+    int index = queue_pop(&device->ready);
+    pthread_mutex_unlock(&device->mutex);
+    *buffer = device->buffers[index];
+    *length = device->buffer_size;
+    return index;
+}
+
+/* length (in bytes) is only used for TX */
+int libdfc_release_buffer(libdfc_device_t *device, int index, int length)
+{
+    if (!device->started) {
+        /* the buffers are gone with the stream */
+        return 0;
+    }
+    if (!device->loopback) {
+        return stream_release_buffer(&device->stream, index, length);
+    }
+    if (index < 0 || index >= device->num_buffers) {
+        fprintf(stderr, "libdfc_release_buffer - invalid buffer index: %d\n", index);
+        return -1;
+    }
+    pthread_mutex_lock(&device->mutex);
+    if (device->direction == STREAM_TX && length == 0) {
+        /* nothing to send: the buffer is free again */
+        queue_push(&device->ready, index);
+        pthread_cond_signal(&device->ready_cond);
+    } else {
+        queue_push(&device->pending, index);
+        pthread_cond_signal(&device->pending_cond);
+    }
+    pthread_mutex_unlock(&device->mutex);
+    return 0;
+}
+
+bool libdfc_overflow(libdfc_device_t *device)
+{
+    if (!device->loopback) {
+        return stream_overflow(&device->stream);
+    }
+    pthread_mutex_lock(&device->mutex);
+    bool overflow = device->overflow;
+    device->overflow = false;
+    pthread_mutex_unlock(&device->mutex);
+    return overflow;
+}
+
+
+/* internal functions */
+static int libdfc_loopback_start(libdfc_device_t *device, int num_packets_per_transfer, int num_transfers)
+{
+    device->num_buffers = num_transfers;
+    device->buffer_size = num_packets_per_transfer * LOOPBACK_PACKET_SIZE;
+    device->buffers = (uint8_t **) calloc(num_transfers, sizeof(uint8_t *));
+    device->ready.indexes = (int *) malloc(num_transfers * sizeof(int));
+    device->pending.indexes = (int *) malloc(num_transfers * sizeof(int));
+    device->allocated = true;
+    if (device->buffers == NULL || device->ready.indexes == NULL || device->pending.indexes == NULL) {
+        fprintf(stderr, "libdfc_loopback_start - malloc() failed\n");
+        libdfc_free_buffers(device);
+        return -1;
+    }
+    for (int i = 0; i < num_transfers; i++) {
+        device->buffers[i] = (uint8_t *) calloc(1, device->buffer_size);
+        if (device->buffers[i] == NULL) {
+            fprintf(stderr, "libdfc_loopback_start - malloc() failed\n");
+            libdfc_free_buffers(device);
+            return -1;
+        }
+    }
+    device->ready.size = num_transfers;
+    device->ready.head = 0;
+    device->ready.count = 0;
+    device->pending.size = num_transfers;
+    device->pending.head = 0;
+    device->pending.count = 0;
+    /* RX: all the buffers are 'in flight'; TX: all the buffers are free
+       (with a callback they are filled right away, as with the hardware) */
+    for (int i = 0; i < num_transfers; i++) {
+        if (device->direction == STREAM_RX) {
+            queue_push(&device->pending, i);
+        } else if (device->callback == NULL) {
+            queue_push(&device->ready, i);
+        } else if (device->callback(device->callback_context, device->buffers[i], device->buffer_size) > 0) {
+            queue_push(&device->pending, i);
+        }
+    }
+    device->stop = false;
+    device->overflow = false;
+    device->overflows = 0;
+    device->sample_offset = 0;
+    int status = pthread_create(&device->thread, NULL, libdfc_loopback_thread, device);
+    if (status != 0) {
+        fprintf(stderr, "libdfc_loopback_start - pthread_create() failed: %s\n", strerror(status));
+        libdfc_free_buffers(device);
+        return -1;
+    }
+    device->running = true;
+    return 0;
+}
+
+static void libdfc_loopback_stop(libdfc_device_t *device)
+{
+    if (device->running) {
+        pthread_mutex_lock(&device->mutex);
+        device->stop = true;
+        pthread_cond_broadcast(&device->pending_cond);
+        pthread_cond_broadcast(&device->ready_cond);
+        pthread_mutex_unlock(&device->mutex);
+        pthread_join(device->thread, NULL);
+        device->running = false;
+        fprintf(stderr, "loopback: %llu samples - %s: %llu\n", device->sample_offset, device->direction == STREAM_RX ? "overflows" : "underflows", device->overflows);
+    }
+    return;
+}
+
+static void libdfc_free_buffers(libdfc_device_t *device)
+{
+    if (!device->allocated) {
+        return;
+    }
+    device->allocated = false;
+    if (!device->loopback) {
+        stream_fini(&device->stream);
+        return;
+    }
+    if (device->buffers != NULL) {
+        for (int i = 0; i < device->num_buffers; i++) {
+            free(device->buffers[i]);
+        }
+    }
+    free(device->buffers);
+    free(device->ready.indexes);
+    free(device->pending.indexes);
+    device->buffers = NULL;
+    device->ready.indexes = NULL;
+    device->pending.indexes = NULL;
+    return;
+}
+
+/* plays the part of the FX3: every block period it takes the next pending
+   buffer (RX: fills it, TX: 'sends' it) and hands it back to the user */
+static void *libdfc_loopback_thread(void *arg)
+{
+    libdfc_device_t *device = (libdfc_device_t *) arg;
+    int nsamples = device->buffer_size / sizeof(short);
+    long long block_time = device->samplerate > 0 ? (long long) (1e9 * nsamples / device->samplerate) : 0;
+    bool throttle = device->throttle && block_time > 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    pthread_mutex_lock(&device->mutex);
+    while (!device->stop) {
+        if (throttle) {
+            pthread_mutex_unlock(&device->mutex);
+            next.tv_nsec += block_time;
+            next.tv_sec += next.tv_nsec / 1000000000;
+            next.tv_nsec %= 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+            pthread_mutex_lock(&device->mutex);
+            if (device->stop) {
+                break;
+            }
+            if (device->pending.count == 0) {
+                /* the user is holding all the buffers */
+                device->overflow = true;
+                device->overflows++;
+                if (device->direction == STREAM_RX) {
+                    device->sample_offset += nsamples;
+                }
+                continue;
+            }
+        } else if (device->pending.count == 0) {
+            pthread_cond_wait(&device->pending_cond, &device->mutex);
+            continue;
+        }
+        int index = queue_pop(&device->pending);
+        pthread_mutex_unlock(&device->mutex);
+        if (device->direction == STREAM_RX) {
+            short *samples = (short *) device->buffers[index];
+            unsigned short offset = (unsigned short) device->sample_offset;
+            for (int i = 0; i < nsamples; i++) {
+                samples[i] = (short) (offset + i);
+            }
+        }
+        int length = 0;
+        if (device->callback != NULL) {
+            length = device->callback(device->callback_context, device->buffers[index], device->buffer_size);
+        }
+        pthread_mutex_lock(&device->mutex);
+        device->sample_offset += nsamples;
+        if (device->callback == NULL) {
+            queue_push(&device->ready, index);
+            pthread_cond_signal(&device->ready_cond);
+        } else if (length == LIBDFC_HOLD) {
+            /* the user gives it back with libdfc_release_buffer() */
+        } else if (length < 0) {
+            /* the user ended the stream; libdfc_stop() still has to be called */
+            break;
+        } else if (device->direction == STREAM_RX || length > 0) {
+            queue_push(&device->pending, index);
+        }
+    }
+    pthread_mutex_unlock(&device->mutex);
+    return NULL;
+}
+
+static int libdfc_stream_callback(void *context, uint8_t *buffer, int length)
+{
+    libdfc_device_t *device = (libdfc_device_t *) context;
+    int status = device->callback(device->callback_context, buffer, length);
+    return status == LIBDFC_HOLD ? STREAM_HOLD : status;
+}
+
+static void queue_push(libdfc_queue_t *queue, int index)
+{
+    queue->indexes[(queue->head + queue->count) % queue->size] = index;
+    queue->count++;
+    return;
+}
+
+static int queue_pop(libdfc_queue_t *queue)
+{
+    int index = queue->indexes[queue->head];
+    queue->head = (queue->head + 1) % queue->size;
+    queue->count--;
+    return index;
+}
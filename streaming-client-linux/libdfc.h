@@ -0,0 +1,130 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _LIBDFC_H_
+#define _LIBDFC_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* C API of libdfc, to stream samples from/to the DFC transceiver from
+   another program (for instance the SoapySDR module in soapy_dfc.cpp, or
+   the C++ wrapper in libdfc.hpp). The transfer buffers are handed out
+   directly, without copies, either pulled by the user:
+   - RX: libdfc_acquire_buffer() returns the next buffer full of samples;
+     libdfc_release_buffer() gives it back to the USB side
+   - TX: libdfc_acquire_buffer() returns a free buffer; after filling it
+     with DAC words (i.e. the 14 bit samples shifted left by 2 bits, since
+     the DAC is connected to bits 2:15), libdfc_release_buffer() sends it
+     (with a length of 0 the buffer is just free again)
+   The device handles the libusb events on a thread of its own, and
+   libdfc_overflow() tells (once) if samples were lost (RX) or the DAC ran
+   out of samples (TX) because the user was holding all the buffers.
+   After libdfc_stop() the buffers can still be read (releasing them is a
+   no-op) until the next libdfc_start() or libdfc_close().
+
+   Or, with libdfc_set_callback() before libdfc_start(), pushed to a
+   callback as soon as they are ready, on the thread handling the libusb
+   events (so the callback should not block):
+   - RX: callback(context, samples, length) returns 0, or -1 to end the
+     stream
+   - TX: callback(context, buffer, length) fills the buffer with up to
+     length bytes of DAC words and returns how many bytes to send (0 takes
+     the buffer out of circulation, -1 ends the stream)
+   Either callback can also return LIBDFC_HOLD to keep the buffer after it
+   returns (for instance to hand it to another thread or to a coroutine, see
+   libdfc_coro.hpp); libdfc_release_buffer() with its index (from
+   libdfc_buffer_index()) gives it back.
+   In all cases libdfc_stop() is what stops the device.
+
+   The stream code keeps some of its state in globals, so only one DFC
+   transceiver per process can be streaming at any time (the loopback
+   devices are not limited).
+
+   The loopback device has no hardware behind it: its RX buffers are filled
+   with a ramp (sample n is (short) n), its TX buffers are just consumed, at
+   the configured sample rate or, without throttling, as fast as the user
+   can go (to benchmark the code on top of this API).
+
+   Typical use:
+       libdfc_device_t *device = libdfc_open("fx3-firmware.img");
+       libdfc_configure(device, LIBDFC_SINGLE_ADC, 64e6, 27e6, 0);
+       libdfc_start(device, 16, 16);
+       while (...) {
+           void *buffer;
+           int length;
+           int index = libdfc_acquire_buffer(device, &buffer, &length, 1000000);
+           if (index < 0) { ... LIBDFC_TIMEOUT or stopped ... }
+           ... use the length bytes of samples in buffer ...
+           libdfc_release_buffer(device, index, 0);
+       }
+       libdfc_stop(device);
+       libdfc_close(device);
+*/
+
+/* bumped when the API changes in a way that is not backward compatible */
+#define LIBDFC_API_VERSION 1
+
+#if defined(__GNUC__)
+#define LIBDFC_API __attribute__ ((visibility ("default")))
+#else
+#define LIBDFC_API
+#endif
+
+typedef struct libdfc_device libdfc_device_t;
+
+/* same values as the DFC firmware modes */
+typedef enum {
+    LIBDFC_SINGLE_ADC = 1,
+    LIBDFC_DUAL_ADC = 2,
+    LIBDFC_DAC = 3,
+    LIBDFC_SINGLE_ADC_FX3_CLOCK = 4,
+    LIBDFC_DAC_FX3_CLOCK = 5
+} libdfc_mode_t;
+
+#define LIBDFC_TIMEOUT -2
+#define LIBDFC_HOLD -3
+
+typedef int (*libdfc_callback_t)(void *context, void *buffer, int length);
+
+LIBDFC_API int libdfc_api_version(void);
+/* libdfc_open(): the first FX3 running the streamer firmware, or else the
+   first FX3 in DFU mode, after uploading firmware_file to it.
+   libdfc_open_serial(): the FX3 with serial_number. The serial number comes
+   from the streamer firmware, so it is matched first against the FX3s
+   already running it. Only when none of them has it, and firmware_file is
+   not NULL (the opt-in), are the FX3s in DFU mode flashed one at a time
+   until one of them has it; the ones flashed before it keep running the
+   streamer firmware. With firmware_file NULL no FX3 is ever flashed */
+LIBDFC_API libdfc_device_t *libdfc_open(const char *firmware_file);
+LIBDFC_API libdfc_device_t *libdfc_open_serial(const char *serial_number, const char *firmware_file);
+LIBDFC_API libdfc_device_t *libdfc_open_loopback(bool throttle);
+LIBDFC_API void libdfc_close(libdfc_device_t *device);
+LIBDFC_API int libdfc_configure(libdfc_device_t *device, libdfc_mode_t mode, double samplerate, double reference_clock, double reference_ppm);
+LIBDFC_API int libdfc_set_callback(libdfc_device_t *device, libdfc_callback_t callback, void *context);
+LIBDFC_API int libdfc_start(libdfc_device_t *device, int num_packets_per_transfer, int num_transfers);
+LIBDFC_API int libdfc_stop(libdfc_device_t *device);
+LIBDFC_API bool libdfc_is_rx(const libdfc_device_t *device);
+LIBDFC_API int libdfc_num_buffers(const libdfc_device_t *device);
+/* libdfc_buffer_size(): bytes per buffer, after libdfc_start();
+   libdfc_packet_size(): bytes per USB packet burst, once configured - each
+   buffer is num_packets_per_transfer of them */
+LIBDFC_API int libdfc_buffer_size(const libdfc_device_t *device);
+LIBDFC_API int libdfc_packet_size(const libdfc_device_t *device);
+LIBDFC_API void *libdfc_buffer(const libdfc_device_t *device, int index);
+LIBDFC_API int libdfc_buffer_index(const libdfc_device_t *device, const void *buffer);
+LIBDFC_API int libdfc_acquire_buffer(libdfc_device_t *device, void **buffer, int *length, long timeout_us);
+LIBDFC_API int libdfc_release_buffer(libdfc_device_t *device, int index, int length);
+LIBDFC_API bool libdfc_overflow(libdfc_device_t *device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LIBDFC_H_ */
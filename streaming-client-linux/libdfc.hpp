@@ -0,0 +1,280 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _LIBDFC_HPP_
+#define _LIBDFC_HPP_
+
+#include "libdfc.h"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/* header-only C++ wrapper for libdfc (see libdfc.h). libdfc::device and
+   libdfc::block are move-only handles: the device is stopped and closed,
+   and the buffer of a block is given back (RX: resubmitted, TX: free again
+   unless submitted), when they go out of scope. A block must not outlive
+   its device.
+
+   Typical use:
+       auto device = libdfc::device::open("fx3-firmware.img");
+       device.configure(LIBDFC_SINGLE_ADC, 64e6);
+       device.start();
+       while (...) {
+           libdfc::block block = device.acquire(1000000);
+           if (!block) { ... timeout ... }
+           ... use block.samples()[0 .. block.num_samples()-1] ...
+       }
+       device.stop();
+
+   or, with a callback (called on the libusb event thread):
+       device.set_callback([&](void *buffer, int length) { ...; return 0; });
+       device.start();
+
+   block.view<T>() gives the samples as the sample type of the DFC mode, so
+   that the layout is known at compile time and the loops over them need no
+   even/odd tests:
+       for (const libdfc::dual_adc_frame &frame : block.view<libdfc::dual_adc_frame>()) {
+           ... frame.a, frame.b ...
+       }
+   (libdfc::sample_type<mode>::type is the sample type of a mode)
+*/
+
+namespace libdfc {
+
+class error : public std::runtime_error {
+public:
+    explicit error(const std::string &what) : std::runtime_error("libdfc: " + what) {}
+};
+
+/* SINGLE-ADC */
+struct single_adc_sample {
+    short value;
+};
+
+/* DUAL-ADC: the two ADCs are interleaved */
+struct dual_adc_frame {
+    short a;        /* ADC A (even samples) */
+    short b;        /* ADC B (odd samples) */
+};
+
+/* DAC: 14 bit samples in bits 2:15 of the DAC words */
+struct dac_sample {
+    short word;
+    short value() const noexcept { return static_cast<short>(word >> 2); }
+    void set(short value) noexcept { word = static_cast<short>(static_cast<unsigned short>(value) << 2); }
+};
+
+template <libdfc_mode_t mode> struct sample_type;
+template <> struct sample_type<LIBDFC_SINGLE_ADC> { typedef single_adc_sample type; };
+template <> struct sample_type<LIBDFC_DUAL_ADC> { typedef dual_adc_frame type; };
+template <> struct sample_type<LIBDFC_DAC> { typedef dac_sample type; };
+template <> struct sample_type<LIBDFC_SINGLE_ADC_FX3_CLOCK> { typedef single_adc_sample type; };
+template <> struct sample_type<LIBDFC_DAC_FX3_CLOCK> { typedef dac_sample type; };
+
+/* contiguous view of the samples of a block (usable as a std::span in C++20) */
+template <typename T>
+class span {
+public:
+    span() noexcept {}
+    span(T *data, std::size_t size) noexcept : data_(data), size_(size) {}
+
+    T *data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    T &operator[](std::size_t i) const noexcept { return data_[i]; }
+    T *begin() const noexcept { return data_; }
+    T *end() const noexcept { return data_ + size_; }
+
+private:
+    T *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+class block {
+public:
+    block() noexcept {}
+    block(block &&other) noexcept { swap(other); }
+    block &operator=(block &&other) noexcept {
+        block(std::move(other)).swap(*this);
+        return *this;
+    }
+    block(const block &) = delete;
+    block &operator=(const block &) = delete;
+    ~block() { release(); }
+
+    explicit operator bool() const noexcept { return device_ != nullptr; }
+    int index() const noexcept { return index_; }
+    void *data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return length_; }     /* bytes */
+    short *samples() const noexcept { return static_cast<short *>(data_); }
+    std::size_t num_samples() const noexcept { return length_ / sizeof(short); }
+
+    /* the samples as single_adc_sample, dual_adc_frame, or dac_sample */
+    template <typename T>
+    span<T> view() const noexcept {
+        static_assert(std::is_standard_layout<T>::value && sizeof(T) % sizeof(short) == 0, "not a sample type");
+        return span<T>(static_cast<T *>(data_), length_ / sizeof(T));
+    }
+
+    /* give the buffer back now (TX: without sending it) */
+    void release() noexcept {
+        if (device_ != nullptr) {
+            libdfc_release_buffer(device_, index_, 0);
+            device_ = nullptr;
+        }
+    }
+
+    /* takes over a buffer kept by a callback with LIBDFC_HOLD */
+    static block adopt(libdfc_device_t *device, void *data, int length) noexcept {
+        return block(device, libdfc_buffer_index(device, data), data, length);
+    }
+
+    /* TX: send the first length bytes (DAC words) */
+    void submit(std::size_t length) {
+        if (device_ == nullptr) {
+            throw error("submit() of an empty block");
+        }
+        libdfc_device_t *device = device_;
+        device_ = nullptr;
+        if (libdfc_release_buffer(device, index_, static_cast<int>(length)) == -1) {
+            throw error("unable to submit the buffer");
+        }
+    }
+
+    void swap(block &other) noexcept {
+        std::swap(device_, other.device_);
+        std::swap(index_, other.index_);
+        std::swap(data_, other.data_);
+        std::swap(length_, other.length_);
+    }
+
+private:
+    friend class device;
+    block(libdfc_device_t *device, int index, void *data, int length) noexcept
+        : device_(device), index_(index), data_(data), length_(length) {}
+
+    libdfc_device_t *device_ = nullptr;
+    int index_ = -1;
+    void *data_ = nullptr;
+    std::size_t length_ = 0;
+};
+
+class device {
+public:
+    /* see libdfc_set_callback() for the arguments and the return value */
+    using callback = std::function<int(void *buffer, int length)>;
+
+    static device open(const char *firmware_file = "fx3-firmware.img") {
+        return device(libdfc_open(firmware_file));
+    }
+    /* the FX3s in DFU mode are only flashed with a firmware_file (see
+       libdfc_open_serial()) */
+    static device open_serial(const std::string &serial_number, const char *firmware_file = nullptr) {
+        return device(libdfc_open_serial(serial_number.c_str(), firmware_file));
+    }
+    static device loopback(bool throttle = true) {
+        return device(libdfc_open_loopback(throttle));
+    }
+
+    device() noexcept {}
+    device(device &&other) noexcept { swap(other); }
+    device &operator=(device &&other) noexcept {
+        device(std::move(other)).swap(*this);
+        return *this;
+    }
+    device(const device &) = delete;
+    device &operator=(const device &) = delete;
+    /* the callback is still needed while libdfc_close() stops the stream */
+    ~device() { libdfc_close(device_); }
+
+    explicit operator bool() const noexcept { return device_ != nullptr; }
+    libdfc_device_t *get() const noexcept { return device_; }
+
+    void configure(libdfc_mode_t mode, double samplerate, double reference_clock = 27e6, double reference_ppm = 0) {
+        check(libdfc_configure(valid(), mode, samplerate, reference_clock, reference_ppm), "unable to configure the DFC transceiver");
+    }
+
+    void set_callback(callback function) {
+        std::unique_ptr<callback> new_callback;
+        if (function) {
+            new_callback.reset(new callback(std::move(function)));
+        }
+        check(libdfc_set_callback(valid(), new_callback ? &device::trampoline : nullptr, new_callback.get()), "unable to set the callback");
+        callback_ = std::move(new_callback);
+    }
+
+    void start(int num_packets_per_transfer = 16, int num_transfers = 16) {
+        check(libdfc_start(valid(), num_packets_per_transfer, num_transfers), "unable to start streaming");
+    }
+
+    void stop() {
+        check(libdfc_stop(valid()), "error while stopping the stream");
+    }
+
+    /* an empty block on timeout */
+    block acquire(long timeout_us) {
+        void *buffer;
+        int length;
+        int index = libdfc_acquire_buffer(valid(), &buffer, &length, timeout_us);
+        if (index == LIBDFC_TIMEOUT) {
+            return block();
+        }
+        check(index, "the device is not streaming");
+        return block(device_, index, buffer, length);
+    }
+
+    bool overflow() { return libdfc_overflow(valid()); }
+    bool is_rx() const { return libdfc_is_rx(valid()); }
+    int num_buffers() const { return libdfc_num_buffers(valid()); }
+    int buffer_size() const { return libdfc_buffer_size(valid()); }
+    int packet_size() const { return libdfc_packet_size(valid()); }
+
+    void swap(device &other) noexcept {
+        std::swap(device_, other.device_);
+        std::swap(callback_, other.callback_);
+    }
+
+private:
+    explicit device(libdfc_device_t *device) : device_(device) {
+        if (device_ == nullptr) {
+            throw error("unable to open the DFC transceiver");
+        }
+    }
+
+    libdfc_device_t *valid() const {
+        if (device_ == nullptr) {
+            throw error("no device");
+        }
+        return device_;
+    }
+
+    static void check(int status, const char *what) {
+        if (status < 0) {
+            throw error(what);
+        }
+    }
+
+    /* exceptions must not get to the C side */
+    static int trampoline(void *context, void *buffer, int length) {
+        try {
+            return (*static_cast<callback *>(context))(buffer, length);
+        } catch (...) {
+            return -1;
+        }
+    }
+
+    libdfc_device_t *device_ = nullptr;
+    std::unique_ptr<callback> callback_;
+};
+
+} // namespace libdfc
+
+#endif /* _LIBDFC_HPP_ */
@@ -0,0 +1,182 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _LIBDFC_CORO_HPP_
+#define _LIBDFC_CORO_HPP_
+
+#include "libdfc.hpp"
+
+#include <concepts>
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <utility>
+
+/* C++20 coroutine interface on top of libdfc.hpp (header-only).
+
+   The device callback keeps each buffer (LIBDFC_HOLD) and hands it to the
+   coroutine waiting in co_await stream.next_block(), without copies; the
+   coroutine is resumed through the executor, i.e. any callable taking a
+   std::coroutine_handle<> (for instance one that posts the handle to the
+   thread pool or event loop of the service). With inline_executor the
+   coroutine runs right on the libusb event thread: no thread hop at all,
+   but then it must not block. The buffer goes back to the device when the
+   block is destroyed (TX: block.submit() sends it).
+
+       libdfc::coro::stream stream(device, executor);
+       device.start();
+       ...
+       // in a coroutine
+       while (libdfc::block block = co_await stream.next_block()) {
+           ... block.samples(), block.num_samples() ...
+       }
+       ...
+       device.stop();
+       stream.close();      // the coroutine gets an empty block
+
+   spans() is an async generator of sample spans over the same blocks
+   (each span is valid until the next co_await):
+       auto spans = stream.spans();
+       while (co_await spans.next()) {
+           std::span<short> samples = spans.value();
+           ...
+       }
+
+   Only one coroutine at a time can wait on a stream. The stream must be
+   created before device.start() and destroyed after device.stop().
+*/
+
+namespace libdfc::coro {
+
+struct inline_executor {
+    void operator()(std::coroutine_handle<> handle) const { handle.resume(); }
+};
+
+template <typename Executor = inline_executor>
+    requires std::invocable<Executor &, std::coroutine_handle<>>
+class stream {
+public:
+    class block_awaiter {
+    public:
+        explicit block_awaiter(stream &stream) noexcept : stream_(stream) {}
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(stream_.mutex_);
+            if (!stream_.ready_.empty()) {
+                result_ = std::move(stream_.ready_.front());
+                stream_.ready_.pop_front();
+                return false;
+            }
+            if (stream_.closed_) {
+                return false;
+            }
+            if (stream_.waiter_) {
+                throw error("only one coroutine at a time can wait for the next block");
+            }
+            stream_.waiter_ = handle;
+            stream_.waiter_result_ = &result_;
+            return true;
+        }
+        block await_resume() noexcept { return std::move(result_); }
+
+    private:
+        stream &stream_;
+        block result_;
+    };
+
+    class span_generator {
+    public:
+        class next_awaiter {
+        public:
+            next_awaiter(span_generator &generator) noexcept : generator_(generator), awaiter_(generator.stream_) {}
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) { return awaiter_.await_suspend(handle); }
+            bool await_resume() noexcept {
+                generator_.current_ = awaiter_.await_resume();
+                return static_cast<bool>(generator_.current_);
+            }
+
+        private:
+            span_generator &generator_;
+            block_awaiter awaiter_;
+        };
+
+        explicit span_generator(stream &stream) noexcept : stream_(stream) {}
+        /* gives the previous block back; co_await-ing it is false at the end */
+        next_awaiter next() noexcept {
+            current_.release();
+            return next_awaiter(*this);
+        }
+        std::span<short> value() const noexcept { return { current_.samples(), current_.num_samples() }; }
+
+    private:
+        stream &stream_;
+        block current_;
+    };
+
+    explicit stream(device &device, Executor executor = Executor())
+        : device_(device), executor_(std::move(executor)) {
+        device_.set_callback([this](void *buffer, int length) { return on_buffer(buffer, length); });
+    }
+    stream(const stream &) = delete;
+    stream &operator=(const stream &) = delete;
+    ~stream() {
+        close();
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.clear();
+        libdfc_set_callback(device_.get(), nullptr, nullptr);
+    }
+
+    block_awaiter next_block() noexcept { return block_awaiter(*this); }
+    span_generator spans() noexcept { return span_generator(*this); }
+
+    /* wakes up the waiting coroutine with an empty block (once the blocks
+       already received are consumed, next_block() returns empty blocks) */
+    void close() {
+        std::coroutine_handle<> waiter;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            waiter = std::exchange(waiter_, nullptr);
+        }
+        if (waiter) {
+            executor_(waiter);
+        }
+    }
+
+private:
+    /* on the libusb event thread */
+    int on_buffer(void *buffer, int length) {
+        block ready = block::adopt(device_.get(), buffer, length);
+        std::coroutine_handle<> waiter;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (waiter_) {
+                *waiter_result_ = std::move(ready);
+                waiter = std::exchange(waiter_, nullptr);
+            } else {
+                ready_.push_back(std::move(ready));
+            }
+        }
+        if (waiter) {
+            executor_(waiter);
+        }
+        return LIBDFC_HOLD;
+    }
+
+    device &device_;
+    Executor executor_;
+    std::mutex mutex_;
+    std::deque<block> ready_;
+    std::coroutine_handle<> waiter_;
+    block *waiter_result_ = nullptr;
+    bool closed_ = false;
+};
+
+} // namespace libdfc::coro
+
+#endif /* _LIBDFC_CORO_HPP_ */
@@ -0,0 +1,89 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "nco.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* small enough to stay in L1 */
+static const int table_size = 1024;
+
+/* internal functions */
+static inline void mix_segment(const float *restrict table_re, const float *restrict table_im, float base_re, float base_im, const float *i, const float *q, int stride, float *restrict output, int nsamples);
+
+
+int nco_init(nco_t *this, double frequency)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (!(frequency > -0.5 && frequency < 0.5)) {
+        fprintf(stderr, "nco_init - frequency must be between -0.5 and 0.5 cycles/sample: %g\n", frequency);
+        return -1;
+    }
+
+    this->frequency = frequency;
+    this->phase = 0.0;
+    this->table_size = table_size;
+    this->table_re = (float *) malloc(table_size * sizeof(float));
+    this->table_im = (float *) malloc(table_size * sizeof(float));
+    if (this->table_re == NULL || this->table_im == NULL) {
+        fprintf(stderr, "nco_init - malloc() failed\n");
+        nco_fini(this);
+        return -1;
+    }
+    for (int k = 0; k < table_size; k++) {
+        /* k * frequency modulo 1, so the argument stays small */
+        double cycles = k * frequency - floor(k * frequency);
+        this->table_re[k] = (float) cos(2.0 * M_PI * cycles);
+        this->table_im[k] = (float) sin(2.0 * M_PI * cycles);
+    }
+    return 0;
+}
+
+int nco_fini(nco_t *this)
+{
+    free(this->table_im);
+    this->table_im = NULL;
+    free(this->table_re);
+    this->table_re = NULL;
+    return 0;
+}
+
+/* one loop for each stride, so that the loads are contiguous (separate I
+   and Q) or a plain even/odd deinterleave (interleaved I/Q) */
+void nco_mix(nco_t *this, const float *i, const float *q, int stride, float *output, int nsamples)
+{
+    for (int k = 0; k < nsamples; k += this->table_size) {
+        int nsegment = nsamples - k < this->table_size ? nsamples - k : this->table_size;
+        float base_re = (float) cos(2.0 * M_PI * this->phase);
+        float base_im = (float) sin(2.0 * M_PI * this->phase);
+        if (stride == 2) {
+            mix_segment(this->table_re, this->table_im, base_re, base_im, i + 2 * k, q + 2 * k, 2, output + k, nsegment);
+        } else {
+            mix_segment(this->table_re, this->table_im, base_re, base_im, i + k, q + k, 1, output + k, nsegment);
+        }
+        this->phase += nsegment * this->frequency;
+        this->phase -= floor(this->phase);
+    }
+    return;
+}
+
+
+/* internal functions */
+/* the oscillator is base * table[k] (complex multiply), and the output is
+   the real part of (i + j q) times the oscillator */
+static inline void mix_segment(const float *restrict table_re, const float *restrict table_im, float base_re, float base_im, const float *i, const float *q, int stride, float *restrict output, int nsamples)
+{
+    for (int k = 0; k < nsamples; k++) {
+        float lo_re = base_re * table_re[k] - base_im * table_im[k];
+        float lo_im = base_re * table_im[k] + base_im * table_re[k];
+        output[k] = i[k * stride] * lo_re - q[k * stride] * lo_im;
+    }
+    return;
+}
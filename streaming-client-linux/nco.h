@@ -0,0 +1,35 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_NCO_H_
+#define _STREAMING_CLIENT_NCO_H_
+
+/* numerically controlled oscillator and mixer for the TX up-conversion:
+   the real part of the complex baseband samples (I/Q) multiplied by
+   exp(j 2 pi f n), i.e. I cos(2 pi f n) - Q sin(2 pi f n), is the signal at
+   the IF frequency f (in cycles/sample).
+   The phase is kept in double precision and carried from block to block,
+   so the IF is phase continuous (and it does not drift) across blocks; at
+   the beginning of each segment of table_size samples the oscillator is
+   exp(j 2 pi phase), and within the segment it is that times a table of
+   exp(j 2 pi f k), i.e. a complex multiply per sample instead of a sin()
+   and a cos() */
+
+typedef struct {
+    double frequency;               /* cycles/sample */
+    double phase;                   /* cycles [0, 1) at the next sample */
+    int table_size;
+    float *table_re;                /* cos(2 pi f k) */
+    float *table_im;                /* sin(2 pi f k) */
+} nco_t;
+
+int nco_init(nco_t *this, double frequency);
+int nco_fini(nco_t *this);
+/* i and q are the real and imaginary parts of the input, with samples
+   every stride floats (1 for separate arrays, 2 for interleaved I/Q) */
+void nco_mix(nco_t *this, const float *i, const float *q, int stride, float *output, int nsamples);
+
+#endif /* _STREAMING_CLIENT_NCO_H_ */
@@ -0,0 +1,256 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+/* example client of the network server: receive the RX stream sent by
+   streaming-client --net-tcp PORT or --net-udp HOST:PORT, check the sample
+   count in each packet for losses, and write the samples (in host byte
+   order) to a file (or stdout) */
+
+#include "vrt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static volatile bool stop = false;
+
+static void sig_stop(int signum);
+static int open_socket(const char *source);
+static int read_packet(int fd, bool stream, uint8_t *packet);
+static int write_all(int fileno, const void *buffer, size_t length);
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case '?':
+            /* invalid option */
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-o output file|-] tcp:<host>:<port>|udp:<port>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int output_fileno = -1;
+    if (output != NULL) {
+        if (strcmp(output, "-") == 0) {
+            output_fileno = STDOUT_FILENO;
+        } else {
+            output_fileno = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (output_fileno == -1) {
+                fprintf(stderr, "open(%s) for writing failed: %s\n", output, strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    int fd = open_socket(argv[optind]);
+    if (fd == -1) {
+        return EXIT_FAILURE;
+    }
+    bool stream = strncmp(argv[optind], "tcp:", 4) == 0;
+
+    struct sigaction sigact;
+    sigact.sa_handler = sig_stop;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    (void)sigaction(SIGINT, &sigact, NULL);
+    (void)sigaction(SIGTERM, &sigact, NULL);
+
+    static uint8_t packet[VRT_MAX_PACKET_SIZE];
+    static short samples[VRT_MAX_PACKET_SIZE / sizeof(short)];
+    unsigned long long packets = 0;
+    unsigned long long received = 0;
+    unsigned long long lost = 0;
+    unsigned long long gaps = 0;
+    uint64_t expected = 0;
+    while (!stop) {
+        int length = read_packet(fd, stream, packet);
+        if (length <= 0) {
+            break;
+        }
+        unsigned int packet_count;
+        uint32_t stream_id;
+        uint32_t seconds;
+        uint64_t sample_count;
+        int nsamples = vrt_read_header(packet, length, &packet_count, &stream_id, &seconds, &sample_count);
+        if (nsamples == -1) {
+            fprintf(stderr, "invalid packet (%d bytes)\n", length);
+            continue;
+        }
+        if (packets > 0 && sample_count != expected) {
+            if (sample_count > expected) {
+                fprintf(stderr, "gap: %llu samples lost before sample %llu\n", (unsigned long long) (sample_count - expected), (unsigned long long) sample_count);
+                lost += sample_count - expected;
+            } else {
+                fprintf(stderr, "out of order packet: sample %llu (expected %llu)\n", (unsigned long long) sample_count, (unsigned long long) expected);
+            }
+            gaps++;
+        }
+        const uint16_t *in = (const uint16_t *) (packet + VRT_HEADER_SIZE);
+        uint16_t *out = (uint16_t *) samples;
+        for (int i = 0; i < nsamples; i++) {
+            out[i] = (uint16_t) ((in[i] << 8) | (in[i] >> 8));
+        }
+        if (output_fileno >= 0) {
+            if (write_all(output_fileno, samples, nsamples * sizeof(short)) == -1) {
+                break;
+            }
+        }
+        expected = sample_count + nsamples;
+        received += nsamples;
+        packets++;
+    }
+
+    fprintf(stderr, "packets: %llu - samples: %llu - lost samples: %llu in %llu gaps\n", packets, received, lost, gaps);
+    close(fd);
+    if (output_fileno >= 0 && output_fileno != STDOUT_FILENO) {
+        close(output_fileno);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* internal functions */
+static void sig_stop(int signum __attribute__((unused)))
+{
+    stop = true;
+}
+
+static int open_socket(const char *source)
+{
+    char host[256];
+    const char *port;
+    bool tcp;
+    if (strncmp(source, "tcp:", 4) == 0) {
+        const char *colon = strrchr(source + 4, ':');
+        if (colon == NULL) {
+            fprintf(stderr, "invalid source: %s\n", source);
+            return -1;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int) (colon - source - 4), source + 4);
+        port = colon + 1;
+        tcp = true;
+    } else if (strncmp(source, "udp:", 4) == 0) {
+        snprintf(host, sizeof(host), "::");
+        port = source + 4;
+        tcp = false;
+    } else {
+        fprintf(stderr, "invalid source (tcp:<host>:<port> or udp:<port>): %s\n", source);
+        return -1;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = tcp ? AF_UNSPEC : AF_INET6;
+    hints.ai_socktype = tcp ? SOCK_STREAM : SOCK_DGRAM;
+    hints.ai_flags = tcp ? 0 : AI_PASSIVE;
+    struct addrinfo *result;
+    int status = getaddrinfo(host, port, &hints, &result);
+    if (status != 0) {
+        fprintf(stderr, "getaddrinfo(%s) failed: %s\n", source, gai_strerror(status));
+        return -1;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd == -1) {
+        fprintf(stderr, "socket() failed: %s\n", strerror(errno));
+        freeaddrinfo(result);
+        return -1;
+    }
+    if (tcp) {
+        status = connect(fd, result->ai_addr, result->ai_addrlen);
+    } else {
+        /* large receive buffer, since the packets arrive in bursts */
+        int off = 0;
+        int buffer_size = 8 * 1024 * 1024;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+        status = bind(fd, result->ai_addr, result->ai_addrlen);
+    }
+    freeaddrinfo(result);
+    if (status == -1) {
+        fprintf(stderr, "%s(%s) failed: %s\n", tcp ? "connect" : "bind", source, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* one packet: a datagram for UDP; the header and then the rest for TCP */
+static int read_packet(int fd, bool stream, uint8_t *packet)
+{
+    if (!stream) {
+        ssize_t length;
+        do {
+            length = recv(fd, packet, VRT_MAX_PACKET_SIZE, 0);
+        } while (length == -1 && errno == EINTR && !stop);
+        if (length == -1 && errno != EINTR) {
+            fprintf(stderr, "recv() failed: %s\n", strerror(errno));
+        }
+        return length;
+    }
+
+    int length = VRT_HEADER_SIZE;
+    for (int received = 0; received < length; ) {
+        ssize_t n = recv(fd, packet + received, length - received, 0);
+        if (n == 0) {
+            return 0;
+        } else if (n == -1) {
+            if (errno == EINTR && !stop) {
+                continue;
+            }
+            if (errno != EINTR) {
+                fprintf(stderr, "recv() failed: %s\n", strerror(errno));
+            }
+            return -1;
+        }
+        received += n;
+        if (received == VRT_HEADER_SIZE) {
+            /* packet size (in 32 bit words) from the header */
+            length = 4 * ((packet[2] << 8) | packet[3]);
+            if (length < VRT_HEADER_SIZE) {
+                fprintf(stderr, "invalid packet size: %d\n", length);
+                return -1;
+            }
+        }
+    }
+    return length;
+}
+
+static int write_all(int fileno, const void *buffer, size_t length)
+{
+    const char *data = (const char *) buffer;
+    while (length > 0) {
+        ssize_t written = write(fileno, data, length);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "write to output file failed - error: %s\n", strerror(errno));
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
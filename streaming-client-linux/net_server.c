@@ -0,0 +1,466 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+/* accept4(), sendmmsg() */
+#define _GNU_SOURCE
+
+#include "net_server.h"
+#include "vrt.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_MAX_SEGMENTS
+#define UDP_MAX_SEGMENTS 64
+#endif
+
+/* internal functions */
+static void net_server_accept(net_server_t *this);
+static void net_server_send_tcp(net_server_t *this, net_client_t *client, int num_packets);
+static void net_server_send_udp(net_server_t *this, net_client_t *client, int num_packets);
+static void net_server_close_client(net_server_t *this, net_client_t *client);
+static void address_to_string(const struct sockaddr *address, socklen_t address_length, char *name, int size);
+
+
+int net_server_init(net_server_t *this, net_server_protocol_t protocol, const char *bind_address, int port, int payload_size, int max_block_size, uint32_t stream_id)
+{
+    memset(this, 0, sizeof(*this));
+    this->fd = -1;
+    if (payload_size <= 0 || payload_size % 4 != 0 || VRT_HEADER_SIZE + payload_size > VRT_MAX_PACKET_SIZE - 28) {
+        fprintf(stderr, "net_server_init - invalid payload size: %d (it must be a multiple of 4)\n", payload_size);
+        return -1;
+    }
+    this->protocol = protocol;
+    this->payload_size = payload_size;
+    this->packet_size = VRT_HEADER_SIZE + payload_size;
+    this->stream_id = stream_id;
+
+    this->max_packets = (max_block_size + payload_size - 1) / payload_size;
+    this->packets = (uint8_t *) malloc((size_t) this->max_packets * this->packet_size);
+    this->packet_lengths = (int *) calloc(this->max_packets, sizeof(int));
+    this->messages = (struct mmsghdr *) calloc(this->max_packets, sizeof(struct mmsghdr));
+    this->iovecs = (struct iovec *) calloc(this->max_packets, sizeof(struct iovec));
+    if (this->packets == NULL || this->packet_lengths == NULL || this->messages == NULL || this->iovecs == NULL) {
+        fprintf(stderr, "net_server_init - malloc() failed\n");
+        net_server_fini(this);
+        return -1;
+    }
+
+    this->fd = socket(AF_INET6, (protocol == NET_SERVER_TCP ? SOCK_STREAM : SOCK_DGRAM) | SOCK_NONBLOCK, 0);
+    if (this->fd == -1) {
+        fprintf(stderr, "net_server_init - socket() failed: %s\n", strerror(errno));
+        net_server_fini(this);
+        return -1;
+    }
+    /* dual stack: IPv4 clients show up as ::ffff:a.b.c.d */
+    int off = 0;
+    setsockopt(this->fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    if (protocol == NET_SERVER_TCP) {
+        int on = 1;
+        setsockopt(this->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in6 address;
+        memset(&address, 0, sizeof(address));
+        address.sin6_family = AF_INET6;
+        address.sin6_port = htons(port);
+        address.sin6_addr = in6addr_any;
+        if (bind_address != NULL) {
+            char mapped[INET6_ADDRSTRLEN + 8];
+            snprintf(mapped, sizeof(mapped), "%s%s", strchr(bind_address, ':') == NULL ? "::ffff:" : "", bind_address);
+            if (inet_pton(AF_INET6, mapped, &address.sin6_addr) != 1) {
+                fprintf(stderr, "net_server_init - invalid bind address: %s\n", bind_address);
+                net_server_fini(this);
+                return -1;
+            }
+        }
+        if (bind(this->fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+            fprintf(stderr, "net_server_init - bind() to port %d failed: %s\n", port, strerror(errno));
+            net_server_fini(this);
+            return -1;
+        }
+        if (listen(this->fd, NET_SERVER_MAX_CLIENTS) == -1) {
+            fprintf(stderr, "net_server_init - listen() failed: %s\n", strerror(errno));
+            net_server_fini(this);
+            return -1;
+        }
+        fprintf(stderr, "network server listening on TCP port %d\n", port);
+    } else {
+        /* find out if the kernel can do UDP segmentation offload */
+        int gso_size = this->packet_size;
+        this->use_gso = setsockopt(this->fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size)) == 0;
+        if (this->use_gso) {
+            /* set per send with a control message, since the last packet of a block may be shorter */
+            gso_size = 0;
+            setsockopt(this->fd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size));
+        }
+    }
+    return 0;
+}
+
+/* UDP destination as host:port (or [ipv6]:port) */
+int net_server_add_destination(net_server_t *this, const char *destination)
+{
+    char host[256];
+    const char *port;
+    if (destination[0] == '[') {
+        const char *end = strchr(destination, ']');
+        if (end == NULL || end[1] != ':') {
+            fprintf(stderr, "net_server_add_destination - invalid destination: %s\n", destination);
+            return -1;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int) (end - destination - 1), destination + 1);
+        port = end + 2;
+    } else {
+        const char *colon = strrchr(destination, ':');
+        if (colon == NULL) {
+            fprintf(stderr, "net_server_add_destination - invalid destination (host:port): %s\n", destination);
+            return -1;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int) (colon - destination), destination);
+        port = colon + 1;
+    }
+
+    net_client_t *client = NULL;
+    for (int i = 0; i < NET_SERVER_MAX_CLIENTS; i++) {
+        if (!this->clients[i].active) {
+            client = &this->clients[i];
+            break;
+        }
+    }
+    if (client == NULL) {
+        fprintf(stderr, "net_server_add_destination - too many destinations\n");
+        return -1;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_V4MAPPED | AI_ALL;
+    struct addrinfo *result;
+    int status = getaddrinfo(host, port, &hints, &result);
+    if (status != 0) {
+        fprintf(stderr, "net_server_add_destination - getaddrinfo(%s) failed: %s\n", destination, gai_strerror(status));
+        return -1;
+    }
+    memset(client, 0, sizeof(*client));
+    memcpy(&client->address, result->ai_addr, result->ai_addrlen);
+    client->address_length = result->ai_addrlen;
+    client->fd = -1;
+    client->active = true;
+    snprintf(client->name, sizeof(client->name), "%s", destination);
+    freeaddrinfo(result);
+    return 0;
+}
+
+int net_server_fini(net_server_t *this)
+{
+    for (int i = 0; i < NET_SERVER_MAX_CLIENTS; i++) {
+        if (this->clients[i].active) {
+            net_server_close_client(this, &this->clients[i]);
+        }
+    }
+    if (this->fd >= 0) {
+        close(this->fd);
+        this->fd = -1;
+    }
+    free(this->iovecs);
+    free(this->messages);
+    free(this->packet_lengths);
+    free(this->packets);
+    this->iovecs = NULL;
+    this->messages = NULL;
+    this->packet_lengths = NULL;
+    this->packets = NULL;
+    return 0;
+}
+
+/* split a block into packets and send them to every client */
+int net_server_send(net_server_t *this, const short *samples, int nsamples)
+{
+    if (this->protocol == NET_SERVER_TCP) {
+        net_server_accept(this);
+    }
+    if (nsamples == 0) {
+        return 0;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    int max_samples = this->payload_size / sizeof(short);
+    int num_packets = 0;
+    for (int start = 0; start < nsamples && num_packets < this->max_packets; start += max_samples) {
+        int n = nsamples - start < max_samples ? nsamples - start : max_samples;
+        uint8_t *packet = this->packets + (size_t) num_packets * this->packet_size;
+        int length = vrt_write_header(packet, this->packet_count++, n, this->stream_id, now.tv_sec, this->sample_count + start);
+        /* byte swap to big endian */
+        uint16_t *out = (uint16_t *) (packet + VRT_HEADER_SIZE);
+        const uint16_t *in = (const uint16_t *) (samples + start);
+        for (int i = 0; i < n; i++) {
+            out[i] = (uint16_t) ((in[i] << 8) | (in[i] >> 8));
+        }
+        if (n % 2 != 0) {
+            out[n] = 0;
+        }
+        this->packet_lengths[num_packets] = length;
+        num_packets++;
+    }
+    this->sample_count += nsamples;
+    this->blocks++;
+    this->packets_total += num_packets;
+
+    for (int i = 0; i < NET_SERVER_MAX_CLIENTS; i++) {
+        net_client_t *client = &this->clients[i];
+        if (!client->active) {
+            continue;
+        }
+        if (this->protocol == NET_SERVER_TCP) {
+            net_server_send_tcp(this, client, num_packets);
+        } else {
+            net_server_send_udp(this, client, num_packets);
+        }
+    }
+    return 0;
+}
+
+/* pipeline stage: the context is the network server */
+int net_server_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    return net_server_send((net_server_t *) stage->context, block->samples, block->nsamples);
+}
+
+void net_server_stats(net_server_t *this)
+{
+    fprintf(stderr, "network server (%s%s): %llu blocks, %llu packets of up to %d B", this->protocol == NET_SERVER_TCP ? "TCP" : "UDP",
+            this->protocol == NET_SERVER_UDP ? (this->use_gso ? " with GSO" : " with sendmmsg") : "", this->blocks, this->packets_total, this->packet_size);
+    if (this->protocol == NET_SERVER_TCP) {
+        fprintf(stderr, ", %u connections", this->connections);
+    }
+    fprintf(stderr, "\n");
+    for (int i = 0; i < NET_SERVER_MAX_CLIENTS; i++) {
+        net_client_t *client = &this->clients[i];
+        if (client->active) {
+            fprintf(stderr, "network client %s: %llu packets sent (%llu B), %llu packets dropped\n", client->name, client->packets_sent, client->bytes_sent, client->packets_dropped);
+        }
+    }
+    return;
+}
+
+
+/* internal functions */
+static void net_server_accept(net_server_t *this)
+{
+    while (true) {
+        struct sockaddr_storage address;
+        socklen_t address_length = sizeof(address);
+        int fd = accept4(this->fd, (struct sockaddr *) &address, &address_length, SOCK_NONBLOCK);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "net_server_accept - accept() failed: %s\n", strerror(errno));
+            }
+            return;
+        }
+        net_client_t *client = NULL;
+        for (int i = 0; i < NET_SERVER_MAX_CLIENTS; i++) {
+            if (!this->clients[i].active) {
+                client = &this->clients[i];
+                break;
+            }
+        }
+        if (client == NULL) {
+            fprintf(stderr, "net_server_accept - too many clients; connection refused\n");
+            close(fd);
+            continue;
+        }
+        memset(client, 0, sizeof(*client));
+        client->pending = (uint8_t *) malloc(this->packet_size);
+        if (client->pending == NULL) {
+            fprintf(stderr, "net_server_accept - malloc() failed\n");
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->address = address;
+        client->address_length = address_length;
+        client->active = true;
+        address_to_string((struct sockaddr *) &address, address_length, client->name, sizeof(client->name));
+        this->connections++;
+        fprintf(stderr, "network client %s connected\n", client->name);
+    }
+}
+
+/* whole packets only: a packet that does not fit in the socket buffer is
+   finished with the next block, and the ones after it are dropped */
+static void net_server_send_tcp(net_server_t *this, net_client_t *client, int num_packets)
+{
+    if (client->pending_length > 0) {
+        ssize_t sent = send(client->fd, client->pending, client->pending_length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            net_server_close_client(this, client);
+            return;
+        }
+        if (sent > 0) {
+            client->bytes_sent += sent;
+            client->pending_length -= sent;
+            memmove(client->pending, client->pending + sent, client->pending_length);
+        }
+        if (client->pending_length > 0) {
+            client->packets_dropped += num_packets;
+            return;
+        }
+    }
+
+    /* the packets are back to back except (possibly) the last one */
+    size_t total = (size_t) (num_packets - 1) * this->packet_size + this->packet_lengths[num_packets - 1];
+    ssize_t sent = send(client->fd, this->packets, total, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            client->packets_dropped += num_packets;
+        } else {
+            net_server_close_client(this, client);
+        }
+        return;
+    }
+    client->bytes_sent += sent;
+    int complete = sent / this->packet_size;
+    if (complete >= num_packets) {
+        client->packets_sent += num_packets;
+        return;
+    }
+    client->packets_sent += complete + 1;
+    client->packets_dropped += num_packets - complete - 1;
+    int partial = sent - complete * this->packet_size;
+    client->pending_length = this->packet_lengths[complete] - partial;
+    memcpy(client->pending, this->packets + (size_t) complete * this->packet_size + partial, client->pending_length);
+    return;
+}
+
+static void net_server_send_udp(net_server_t *this, net_client_t *client, int num_packets)
+{
+    int unsent = 0;     /* first packet not yet sent (or dropped) */
+    if (this->use_gso) {
+        /* one send per batch of packets; the kernel (or the NIC) splits them */
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        /* a GSO send is still limited to the size of a single datagram */
+        int max_segments = (VRT_MAX_PACKET_SIZE - 1 - 48) / this->packet_size;
+        if (max_segments > UDP_MAX_SEGMENTS) {
+            max_segments = UDP_MAX_SEGMENTS;
+        }
+        for (int first = 0; first < num_packets; first += max_segments) {
+            int count = num_packets - first < max_segments ? num_packets - first : max_segments;
+            struct iovec iov;
+            iov.iov_base = this->packets + (size_t) first * this->packet_size;
+            iov.iov_len = (size_t) (count - 1) * this->packet_size + this->packet_lengths[first + count - 1];
+            struct msghdr message;
+            memset(&message, 0, sizeof(message));
+            message.msg_name = &client->address;
+            message.msg_namelen = client->address_length;
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            if (count > 1) {
+                memset(control, 0, sizeof(control));
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+                struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t gso_size = this->packet_size;
+                memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            }
+            ssize_t sent = sendmsg(this->fd, &message, MSG_DONTWAIT);
+            if (sent == -1) {
+                if (errno == EIO || errno == EINVAL) {
+                    /* no GSO on this route after all: this batch and the
+                       ones after it go with sendmmsg() */
+                    this->use_gso = false;
+                    break;
+                }
+                client->packets_dropped += count;
+            } else {
+                client->bytes_sent += sent;
+                client->packets_sent += count;
+            }
+            unsent = first + count;
+        }
+        if (this->use_gso) {
+            return;
+        }
+    }
+
+    for (int i = unsent; i < num_packets; i++) {
+        this->iovecs[i].iov_base = this->packets + (size_t) i * this->packet_size;
+        this->iovecs[i].iov_len = this->packet_lengths[i];
+        struct msghdr *message = &this->messages[i].msg_hdr;
+        memset(message, 0, sizeof(*message));
+        message->msg_name = &client->address;
+        message->msg_namelen = client->address_length;
+        message->msg_iov = &this->iovecs[i];
+        message->msg_iovlen = 1;
+    }
+    int first = unsent;
+    while (first < num_packets) {
+        int sent = sendmmsg(this->fd, &this->messages[first], num_packets - first, MSG_DONTWAIT);
+        if (sent <= 0) {
+            if (sent == -1 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        for (int i = first; i < first + sent; i++) {
+            client->bytes_sent += this->packet_lengths[i];
+        }
+        first += sent;
+    }
+    client->packets_sent += first - unsent;
+    client->packets_dropped += num_packets - first;
+    return;
+}
+
+static void net_server_close_client(net_server_t *this __attribute__((unused)), net_client_t *client)
+{
+    if (client->pending_length > 0) {
+        /* the partially sent packet never made it */
+        client->packets_sent--;
+        client->packets_dropped++;
+        client->pending_length = 0;
+    }
+    if (client->fd >= 0) {
+        fprintf(stderr, "network client %s disconnected - %llu packets sent, %llu packets dropped\n", client->name, client->packets_sent, client->packets_dropped);
+        close(client->fd);
+        client->fd = -1;
+    }
+    free(client->pending);
+    client->pending = NULL;
+    client->active = false;
+    return;
+}
+
+static void address_to_string(const struct sockaddr *address, socklen_t address_length, char *name, int size)
+{
+    char host[INET6_ADDRSTRLEN];
+    char port[8];
+    if (getnameinfo(address, address_length, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0) {
+        snprintf(name, size, "?");
+        return;
+    }
+    snprintf(name, size, "%s:%s", host, port);
+    return;
+}
@@ -0,0 +1,71 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_NET_SERVER_H_
+#define _STREAMING_CLIENT_NET_SERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include "pipeline.h"
+
+/* network server for the RX stream: the samples are sent in VITA-49 style
+   IF data packets (see vrt.h) to the clients connected over TCP, or to a
+   list of UDP destinations. UDP packets are sent in batches, with a single
+   UDP GSO send when the kernel supports it, or with sendmmsg() otherwise.
+   The server never waits for a client: when a client's socket buffer is
+   full, the packets are dropped for that client and counted */
+
+#define NET_SERVER_MAX_CLIENTS 16
+
+typedef enum {
+    NET_SERVER_TCP,
+    NET_SERVER_UDP
+} net_server_protocol_t;
+
+typedef struct {
+    bool active;
+    int fd;                             /* TCP only */
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    char name[80];
+    uint8_t *pending;                   /* TCP: rest of a partially sent packet */
+    int pending_length;
+    /* stats */
+    unsigned long long packets_sent;
+    unsigned long long packets_dropped;
+    unsigned long long bytes_sent;
+} net_client_t;
+
+typedef struct {
+    net_server_protocol_t protocol;
+    int fd;                             /* listening socket (TCP) or sending socket (UDP) */
+    int payload_size;                   /* bytes per packet */
+    int packet_size;                    /* header + payload */
+    uint32_t stream_id;
+    unsigned int packet_count;          /* 4 bit VITA-49 packet counter */
+    unsigned long long sample_count;
+    uint8_t *packets;                   /* the packets of the current block, back to back */
+    int max_packets;
+    int *packet_lengths;
+    struct mmsghdr *messages;
+    struct iovec *iovecs;
+    bool use_gso;
+    net_client_t clients[NET_SERVER_MAX_CLIENTS];
+    /* stats */
+    unsigned long long blocks;
+    unsigned long long packets_total;
+    unsigned int connections;
+} net_server_t;
+
+int net_server_init(net_server_t *this, net_server_protocol_t protocol, const char *bind_address, int port, int payload_size, int max_block_size, uint32_t stream_id);
+int net_server_add_destination(net_server_t *this, const char *destination);
+int net_server_fini(net_server_t *this);
+int net_server_send(net_server_t *this, const short *samples, int nsamples);
+int net_server_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+void net_server_stats(net_server_t *this);
+
+#endif /* _STREAMING_CLIENT_NET_SERVER_H_ */
@@ -0,0 +1,137 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "overload.h"
+
+#include <string.h>
+#include <time.h>
+
+static const short adc_min = -8192;   /* 14 bit ADC rails */
+static const short adc_max = 8191;
+
+/* internal functions */
+static void log_event(overload_t *this, bool start, unsigned long long offset);
+
+
+int overload_init(overload_t *this, int margin, FILE *log_file)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (margin < 0 || margin >= adc_max) {
+        fprintf(stderr, "overload_init - invalid margin: %d\n", margin);
+        return -1;
+    }
+
+    this->rail_low = adc_min + margin;
+    this->rail_high = adc_max - margin;
+    this->log_file = log_file;
+    return 0;
+}
+
+int overload_fini(overload_t *this)
+{
+    if (this->overloaded) {
+        log_event(this, false, this->stream_offset);
+        this->overloaded = false;
+    }
+    return 0;
+}
+
+void overload_process(overload_t *this, const short *samples, int nsamples)
+{
+    unsigned int clipped[2];
+    overload_count(this, samples, nsamples, clipped);
+    overload_update(this, clipped, nsamples);
+    return;
+}
+
+/* clipped even/odd samples in a block; no state is changed, so blocks can be
+   counted in parallel and then passed to overload_update() in order */
+void overload_count(const overload_t *this, const short *samples, int nsamples, unsigned int clipped[2])
+{
+    short low = this->rail_low;
+    short high = this->rail_high;
+
+    unsigned int clipped_even = 0;
+    unsigned int clipped_odd = 0;
+    int npairs = nsamples / 2;
+    for (int i = 0; i < npairs; i++) {
+        short even = samples[2 * i];
+        short odd = samples[2 * i + 1];
+        clipped_even += (even <= low) | (even >= high);
+        clipped_odd += (odd <= low) | (odd >= high);
+    }
+    if (nsamples % 2 != 0) {
+        short even = samples[nsamples - 1];
+        clipped_even += (even <= low) | (even >= high);
+    }
+    clipped[0] = clipped_even;
+    clipped[1] = clipped_odd;
+    return;
+}
+
+void overload_update(overload_t *this, const unsigned int clipped_samples[2], int nsamples)
+{
+    unsigned int clipped_even = clipped_samples[0];
+    unsigned int clipped_odd = clipped_samples[1];
+    unsigned int clipped = clipped_even + clipped_odd;
+    if (clipped > 0) {
+        if (!this->overloaded) {
+            this->overloaded = true;
+            this->event_start = this->stream_offset;
+            this->event_clipped = 0;
+            this->events++;
+            log_event(this, true, this->stream_offset);
+        }
+        this->event_clipped += clipped;
+        this->overloaded_transfers++;
+    } else if (this->overloaded) {
+        log_event(this, false, this->stream_offset);
+        this->overloaded = false;
+    }
+
+    this->clipped_even += clipped_even;
+    this->clipped_odd += clipped_odd;
+    this->samples += nsamples;
+    this->transfers++;
+    this->stream_offset += nsamples;
+    return;
+}
+
+/* fraction of samples clipped so far */
+double overload_clip_rate(const overload_t *this)
+{
+    return this->samples > 0 ? (double) (this->clipped_even + this->clipped_odd) / this->samples : 0.0;
+}
+
+void overload_stats(overload_t *this)
+{
+    unsigned long long even_samples = (this->samples + 1) / 2;
+    unsigned long long odd_samples = this->samples / 2;
+    fprintf(stderr, "overload events: %u\n", this->events);
+    fprintf(stderr, "overloaded transfers: %llu/%llu\n", this->overloaded_transfers, this->transfers);
+    fprintf(stderr, "clipped even samples: %llu (%.3g%%)\n", this->clipped_even, even_samples > 0 ? 100.0 * this->clipped_even / even_samples : 0.0);
+    fprintf(stderr, "clipped odd samples: %llu (%.3g%%)\n", this->clipped_odd, odd_samples > 0 ? 100.0 * this->clipped_odd / odd_samples : 0.0);
+    return;
+}
+
+
+/* internal functions */
+static void log_event(overload_t *this, bool start, unsigned long long offset)
+{
+    if (this->log_file == NULL) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (start) {
+        fprintf(this->log_file, "%.6f overload start at sample %llu\n", now.tv_sec + 1e-9 * now.tv_nsec, offset);
+    } else {
+        fprintf(this->log_file, "%.6f overload end at sample %llu - %llu clipped samples in %llu samples\n", now.tv_sec + 1e-9 * now.tv_nsec, offset, this->event_clipped, offset - this->event_start);
+    }
+    fflush(this->log_file);
+    return;
+}
@@ -0,0 +1,43 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_OVERLOAD_H_
+#define _STREAMING_CLIENT_OVERLOAD_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/* overload (clipping) detector: counts the even and odd samples within
+   margin of the 14 bit ADC rails in every transfer; an overload event starts
+   with the first transfer with clipped samples and ends with the first
+   transfer without them; each event is logged with its host timestamp */
+
+typedef struct {
+    short rail_low;
+    short rail_high;
+    FILE *log_file;
+    bool overloaded;
+    unsigned long long stream_offset;   /* raw samples before the current transfer */
+    unsigned long long event_start;     /* raw offset of the current event */
+    unsigned long long event_clipped;   /* clipped samples in the current event */
+    /* stats */
+    unsigned long long samples;
+    unsigned long long clipped_even;
+    unsigned long long clipped_odd;
+    unsigned long long transfers;
+    unsigned long long overloaded_transfers;
+    unsigned int events;
+} overload_t;
+
+int overload_init(overload_t *this, int margin, FILE *log_file);
+int overload_fini(overload_t *this);
+void overload_process(overload_t *this, const short *samples, int nsamples);
+void overload_count(const overload_t *this, const short *samples, int nsamples, unsigned int clipped[2]);
+void overload_update(overload_t *this, const unsigned int clipped[2], int nsamples);
+double overload_clip_rate(const overload_t *this);
+void overload_stats(overload_t *this);
+
+#endif /* _STREAMING_CLIENT_OVERLOAD_H_ */
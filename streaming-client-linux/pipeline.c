@@ -0,0 +1,230 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* internal functions */
+static void *pipeline_worker(void *arg);
+
+
+int pipeline_stage_init(pipeline_stage_t *this, const char *name, pipeline_stage_function_t process, void *context)
+{
+    memset(this, 0, sizeof(*this));
+    this->name = name;
+    this->process = process;
+    this->context = context;
+    return 0;
+}
+
+/* run the stage on its own thread, with a queue of queue_depth blocks */
+int pipeline_stage_set_worker(pipeline_stage_t *this, int queue_depth, int block_capacity, bool drop_when_full)
+{
+    if (queue_depth <= 0 || block_capacity <= 0) {
+        fprintf(stderr, "pipeline_stage_set_worker - invalid queue depth/block capacity for stage %s: %d/%d\n", this->name, queue_depth, block_capacity);
+        return -1;
+    }
+    this->queue = (pipeline_block_t *) calloc(queue_depth, sizeof(pipeline_block_t));
+    if (this->queue == NULL) {
+        fprintf(stderr, "pipeline_stage_set_worker - calloc() failed\n");
+        return -1;
+    }
+    for (int i = 0; i < queue_depth; i++) {
+        this->queue[i].samples = (short *) malloc(block_capacity * sizeof(short));
+        if (this->queue[i].samples == NULL) {
+            fprintf(stderr, "pipeline_stage_set_worker - malloc() failed\n");
+            for (int j = 0; j < i; j++) {
+                free(this->queue[j].samples);
+            }
+            free(this->queue);
+            this->queue = NULL;
+            return -1;
+        }
+    }
+    this->on_worker = true;
+    this->drop_when_full = drop_when_full;
+    this->queue_depth = queue_depth;
+    this->block_capacity = block_capacity;
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->cond, NULL);
+    return 0;
+}
+
+int pipeline_stage_fini(pipeline_stage_t *this)
+{
+    if (this->on_worker) {
+        for (int i = 0; i < this->queue_depth; i++) {
+            free(this->queue[i].samples);
+        }
+        free(this->queue);
+        this->queue = NULL;
+        pthread_cond_destroy(&this->cond);
+        pthread_mutex_destroy(&this->mutex);
+        this->on_worker = false;
+    }
+    return 0;
+}
+
+int pipeline_connect(pipeline_stage_t *from, pipeline_stage_t *to)
+{
+    if (to->input != NULL) {
+        fprintf(stderr, "pipeline_connect - stage %s already has an input (%s)\n", to->name, to->input->name);
+        return -1;
+    }
+    if (from->num_outputs == PIPELINE_MAX_OUTPUTS) {
+        fprintf(stderr, "pipeline_connect - too many outputs for stage %s\n", from->name);
+        return -1;
+    }
+    from->outputs[from->num_outputs++] = to;
+    to->input = from;
+    return 0;
+}
+
+/* start the worker threads of this stage and of the stages downstream */
+int pipeline_start(pipeline_stage_t *this)
+{
+    for (int i = 0; i < this->num_outputs; i++) {
+        if (pipeline_start(this->outputs[i]) == -1) {
+            return -1;
+        }
+    }
+    if (this->on_worker && !this->running) {
+        this->stop = false;
+        int status = pthread_create(&this->worker, NULL, pipeline_worker, this);
+        if (status != 0) {
+            fprintf(stderr, "pipeline_start - pthread_create() failed for stage %s: %s\n", this->name, strerror(status));
+            return -1;
+        }
+        this->running = true;
+    }
+    return 0;
+}
+
+/* drain and stop the worker threads, upstream first */
+int pipeline_stop(pipeline_stage_t *this)
+{
+    bool ok = true;
+    if (this->running) {
+        pthread_mutex_lock(&this->mutex);
+        this->stop = true;
+        pthread_cond_signal(&this->cond);
+        pthread_mutex_unlock(&this->mutex);
+        pthread_join(this->worker, NULL);
+        this->running = false;
+        ok = !this->failed;
+    }
+    for (int i = 0; i < this->num_outputs; i++) {
+        if (pipeline_stop(this->outputs[i]) == -1) {
+            ok = false;
+        }
+    }
+    return ok ? 0 : -1;
+}
+
+/* hand a block to a stage: process it now, or queue a copy for its worker */
+int pipeline_push(pipeline_stage_t *this, pipeline_block_t *block)
+{
+    if (!this->on_worker) {
+        this->blocks++;
+        return this->process(this, block);
+    }
+
+    pthread_mutex_lock(&this->mutex);
+    if (this->failed) {
+        pthread_mutex_unlock(&this->mutex);
+        return -1;
+    }
+    if (this->queue_count == this->queue_depth) {
+        if (this->drop_when_full || !this->running) {
+            this->blocks_dropped++;
+            pthread_mutex_unlock(&this->mutex);
+            return 0;
+        }
+        while (this->queue_count == this->queue_depth && !this->failed) {
+            pthread_cond_wait(&this->cond, &this->mutex);
+        }
+        if (this->failed) {
+            pthread_mutex_unlock(&this->mutex);
+            return -1;
+        }
+    }
+    pipeline_block_t *slot = &this->queue[(this->queue_head + this->queue_count) % this->queue_depth];
+    pthread_mutex_unlock(&this->mutex);
+
+    /* the slot is not visible to the worker until queue_count is incremented */
+    int nsamples = block->nsamples < this->block_capacity ? block->nsamples : this->block_capacity;
+    memcpy(slot->samples, block->samples, nsamples * sizeof(short));
+    slot->nsamples = nsamples;
+    slot->sample_offset = block->sample_offset;
+
+    pthread_mutex_lock(&this->mutex);
+    this->queue_count++;
+    if (this->queue_count > this->max_queue_count) {
+        this->max_queue_count = this->queue_count;
+    }
+    pthread_cond_broadcast(&this->cond);
+    pthread_mutex_unlock(&this->mutex);
+    return 0;
+}
+
+/* pass a block on to all the outputs of a stage */
+int pipeline_emit(pipeline_stage_t *this, pipeline_block_t *block)
+{
+    for (int i = 0; i < this->num_outputs; i++) {
+        if (pipeline_push(this->outputs[i], block) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void pipeline_stats(pipeline_stage_t *this)
+{
+    if (this->on_worker) {
+        fprintf(stderr, "stage %s: %llu blocks, %llu dropped - max queue: %d/%d\n", this->name, this->blocks, this->blocks_dropped, this->max_queue_count, this->queue_depth);
+    }
+    for (int i = 0; i < this->num_outputs; i++) {
+        pipeline_stats(this->outputs[i]);
+    }
+    return;
+}
+
+
+/* internal functions */
+static void *pipeline_worker(void *arg)
+{
+    pipeline_stage_t *this = (pipeline_stage_t *) arg;
+
+    pthread_mutex_lock(&this->mutex);
+    while (true) {
+        while (this->queue_count == 0 && !this->stop) {
+            pthread_cond_wait(&this->cond, &this->mutex);
+        }
+        if (this->queue_count == 0) {
+            break;
+        }
+        pipeline_block_t *block = &this->queue[this->queue_head];
+        pthread_mutex_unlock(&this->mutex);
+
+        int status = this->process(this, block);
+
+        pthread_mutex_lock(&this->mutex);
+        this->blocks++;
+        this->queue_head = (this->queue_head + 1) % this->queue_depth;
+        this->queue_count--;
+        pthread_cond_broadcast(&this->cond);
+        if (status == -1) {
+            /* stop here; pipeline_push() reports the failure upstream */
+            this->failed = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&this->mutex);
+    return NULL;
+}
@@ -0,0 +1,71 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_PIPELINE_H_
+#define _STREAMING_CLIENT_PIPELINE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+
+/* RX processing graph: a tree of stages rooted at the stream. Each stage has
+   one input and any number of outputs; its process function receives a block
+   of samples and passes blocks on to its outputs with pipeline_emit() - the
+   same block (no copy) or a new one it owns (e.g. a decimator).
+   An inline stage runs in the caller's thread; a worker stage has its own
+   thread and queue of blocks (copied on the way in), so a slow sink does not
+   hold up the others: when its queue is full the block is either dropped
+   (and accounted for) or the caller waits, depending on the stage */
+
+#define PIPELINE_MAX_OUTPUTS 8
+
+typedef struct {
+    short *samples;
+    int nsamples;
+    unsigned long long sample_offset;   /* in the stream seen by this stage */
+} pipeline_block_t;
+
+typedef struct pipeline_stage pipeline_stage_t;
+
+typedef int (*pipeline_stage_function_t)(pipeline_stage_t *stage, pipeline_block_t *block);
+
+struct pipeline_stage {
+    const char *name;
+    pipeline_stage_function_t process;
+    void *context;
+    pipeline_stage_t *input;
+    pipeline_stage_t *outputs[PIPELINE_MAX_OUTPUTS];
+    int num_outputs;
+    /* worker stages only */
+    bool on_worker;
+    bool drop_when_full;
+    int queue_depth;
+    int block_capacity;                 /* in samples */
+    pipeline_block_t *queue;
+    int queue_head;
+    int queue_count;
+    bool stop;
+    bool running;
+    bool failed;
+    pthread_t worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    /* stats */
+    unsigned long long blocks;
+    unsigned long long blocks_dropped;
+    int max_queue_count;
+};
+
+int pipeline_stage_init(pipeline_stage_t *this, const char *name, pipeline_stage_function_t process, void *context);
+int pipeline_stage_set_worker(pipeline_stage_t *this, int queue_depth, int block_capacity, bool drop_when_full);
+int pipeline_stage_fini(pipeline_stage_t *this);
+int pipeline_connect(pipeline_stage_t *from, pipeline_stage_t *to);
+int pipeline_start(pipeline_stage_t *this);
+int pipeline_stop(pipeline_stage_t *this);
+int pipeline_push(pipeline_stage_t *this, pipeline_block_t *block);
+int pipeline_emit(pipeline_stage_t *this, pipeline_block_t *block);
+void pipeline_stats(pipeline_stage_t *this);
+
+#endif /* _STREAMING_CLIENT_PIPELINE_H_ */
@@ -0,0 +1,707 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+/* Python bindings (module 'dfc') on top of the C API in libdfc.h.
+
+   The blocks handed out by the device support the buffer protocol (format
+   'h', i.e. int16), so numpy.frombuffer()/numpy.asarray() give a view of
+   the USB transfer buffer itself, without copies. A buffer goes back to
+   the USB side when the block (and every view of it) is gone, or when
+   block.release() is called (or the with block: ends), which raises
+   BufferError while there are views of it, like memoryview.release().
+
+       import dfc, numpy as np
+       device = dfc.Device(firmware='fx3-firmware.img')
+       device.configure('SINGLE-ADC', 64e6)
+       device.start()
+       for block in device:
+           samples = np.frombuffer(block, dtype=np.int16)
+           ...
+       device.stop()
+
+   TX: each block is a free buffer; fill it with 14 bit samples and call
+   device.submit(block) (the samples are saturated to 14 bits and shifted
+   for the DAC in place), or let device.write(samples) do the copying.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "libdfc.h"
+#include "sample_kernels.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* wait in slices, so that Ctrl-C is noticed */
+static const long WAIT_SLICE_US = 100000;
+
+typedef struct {
+    PyObject_HEAD
+    libdfc_device_t *device;
+    bool streaming;
+    bool closing;               /* close() called while still in use */
+    int outstanding;            /* block objects alive */
+    int waiting;                /* threads waiting in acquire */
+} DeviceObject;
+
+typedef struct {
+    PyObject_HEAD
+    DeviceObject *device;
+    int index;
+    uint8_t *buffer;
+    Py_ssize_t length;          /* bytes */
+    Py_ssize_t nsamples;
+    Py_ssize_t stride;
+    int exports;                /* views from Block_getbuffer() alive */
+    bool released;
+} BlockObject;
+
+static const struct {
+    const char *name;
+    libdfc_mode_t mode;
+} dfc_mode_names[] = {
+    { "SINGLE-ADC", LIBDFC_SINGLE_ADC },
+    { "DUAL-ADC", LIBDFC_DUAL_ADC },
+    { "DAC", LIBDFC_DAC },
+    { "SINGLE-ADC-FX3-CLOCK", LIBDFC_SINGLE_ADC_FX3_CLOCK },
+    { "DAC-FX3-CLOCK", LIBDFC_DAC_FX3_CLOCK }
+};
+
+static PyTypeObject DeviceType;
+static PyTypeObject BlockType;
+
+/* internal functions */
+static int device_check_open(DeviceObject *self);
+static void device_free(DeviceObject *self);
+static void device_free_if_unused(DeviceObject *self);
+static PyObject *device_acquire(DeviceObject *self, double timeout, bool iterating);
+static void block_give_back(BlockObject *self, int length);
+
+
+/* Block */
+static void Block_dealloc(BlockObject *self)
+{
+    DeviceObject *device = self->device;
+    if (!self->released) {
+        block_give_back(self, 0);
+    }
+    device->outstanding--;
+    device_free_if_unused(device);
+    Py_DECREF(device);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static int Block_getbuffer(BlockObject *self, Py_buffer *view, int flags)
+{
+    if (self->released) {
+        PyErr_SetString(PyExc_BufferError, "the block was released");
+        view->obj = NULL;
+        return -1;
+    }
+    Py_INCREF(self);
+    view->obj = (PyObject *) self;
+    view->buf = self->buffer;
+    view->len = self->length;
+    view->readonly = 0;
+    view->itemsize = sizeof(short);
+    view->format = (flags & PyBUF_FORMAT) ? "h" : NULL;
+    view->ndim = 1;
+    view->shape = (flags & PyBUF_ND) ? &self->nsamples : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &self->stride : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    self->exports++;
+    return 0;
+}
+
+static void Block_releasebuffer(BlockObject *self, Py_buffer *Py_UNUSED(view))
+{
+    self->exports--;
+}
+
+static PyObject *Block_release(BlockObject *self, PyObject *Py_UNUSED(args))
+{
+    if (self->exports > 0) {
+        PyErr_Format(PyExc_BufferError, "the block has %d exported view(s)", self->exports);
+        return NULL;
+    }
+    if (!self->released) {
+        block_give_back(self, 0);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Block_enter(BlockObject *self, PyObject *Py_UNUSED(args))
+{
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+static PyObject *Block_exit(BlockObject *self, PyObject *Py_UNUSED(args))
+{
+    return Block_release(self, NULL);
+}
+
+static Py_ssize_t Block_length(BlockObject *self)
+{
+    return self->nsamples;
+}
+
+static PyObject *Block_get_index(BlockObject *self, void *Py_UNUSED(closure))
+{
+    return PyLong_FromLong(self->index);
+}
+
+static PyObject *Block_get_released(BlockObject *self, void *Py_UNUSED(closure))
+{
+    return PyBool_FromLong(self->released);
+}
+
+static PyBufferProcs Block_as_buffer = {
+    .bf_getbuffer = (getbufferproc) Block_getbuffer,
+    .bf_releasebuffer = (releasebufferproc) Block_releasebuffer,
+};
+
+static PySequenceMethods Block_as_sequence = {
+    .sq_length = (lenfunc) Block_length,
+};
+
+static PyMethodDef Block_methods[] = {
+    { "release", (PyCFunction) Block_release, METH_NOARGS, "give the buffer back to the device now (BufferError while there are views of it)" },
+    { "__enter__", (PyCFunction) Block_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction) Block_exit, METH_VARARGS, NULL },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef Block_getset[] = {
+    { "index", (getter) Block_get_index, NULL, "index of the transfer buffer", NULL },
+    { "released", (getter) Block_get_released, NULL, "True once the buffer went back to the device", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject BlockType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dfc.Block",
+    .tp_doc = PyDoc_STR("a transfer buffer (int16 samples) - supports the buffer protocol"),
+    .tp_basicsize = sizeof(BlockObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor) Block_dealloc,
+    .tp_as_buffer = &Block_as_buffer,
+    .tp_as_sequence = &Block_as_sequence,
+    .tp_methods = Block_methods,
+    .tp_getset = Block_getset,
+};
+
+
+/* Device */
+static int Device_init(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "firmware", "loopback", "throttle", NULL };
+    const char *firmware_file = "fx3-firmware.img";
+    int loopback = 0;
+    int throttle = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s$pp", kwlist, &firmware_file, &loopback, &throttle)) {
+        return -1;
+    }
+    if (self->device != NULL) {
+        PyErr_SetString(PyExc_RuntimeError, "the device is already open");
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    self->device = loopback ? libdfc_open_loopback(throttle) : libdfc_open(firmware_file);
+    Py_END_ALLOW_THREADS
+    if (self->device == NULL) {
+        PyErr_SetString(PyExc_OSError, "unable to open the DFC transceiver");
+        return -1;
+    }
+    return 0;
+}
+
+static void Device_dealloc(DeviceObject *self)
+{
+    /* the blocks hold a reference, so they are all gone by now */
+    device_free(self);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+static PyObject *Device_configure(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "mode", "samplerate", "reference", "ppm", NULL };
+    PyObject *mode_object;
+    double samplerate;
+    double reference_clock = 27e6;
+    double reference_ppm = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "Od|dd", kwlist, &mode_object, &samplerate, &reference_clock, &reference_ppm)) {
+        return NULL;
+    }
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    long mode = -1;
+    if (PyUnicode_Check(mode_object)) {
+        const char *mode_name = PyUnicode_AsUTF8(mode_object);
+        if (mode_name == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i < sizeof(dfc_mode_names) / sizeof(dfc_mode_names[0]); i++) {
+            if (strcmp(mode_name, dfc_mode_names[i].name) == 0) {
+                mode = dfc_mode_names[i].mode;
+            }
+        }
+    } else {
+        mode = PyLong_AsLong(mode_object);
+        if (mode == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+    }
+    if (mode < LIBDFC_SINGLE_ADC || mode > LIBDFC_DAC_FX3_CLOCK) {
+        PyErr_Format(PyExc_ValueError, "invalid DFC mode: %R", mode_object);
+        return NULL;
+    }
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = libdfc_configure(self->device, (libdfc_mode_t) mode, samplerate, reference_clock, reference_ppm);
+    Py_END_ALLOW_THREADS
+    if (status == -1) {
+        PyErr_SetString(PyExc_OSError, "unable to configure the DFC transceiver");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *Device_start(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "packets", "transfers", NULL };
+    int num_packets_per_transfer = 16;
+    int num_concurrent_transfers = 16;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii", kwlist, &num_packets_per_transfer, &num_concurrent_transfers)) {
+        return NULL;
+    }
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    if (num_packets_per_transfer <= 0 || num_concurrent_transfers <= 0) {
+        PyErr_SetString(PyExc_ValueError, "packets and transfers must be positive");
+        return NULL;
+    }
+    /* starting again reallocates the buffers */
+    if (self->outstanding > 0) {
+        PyErr_Format(PyExc_BufferError, "%d block(s) from the previous run still in use", self->outstanding);
+        return NULL;
+    }
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = libdfc_start(self->device, num_packets_per_transfer, num_concurrent_transfers);
+    Py_END_ALLOW_THREADS
+    if (status == -1) {
+        PyErr_SetString(PyExc_OSError, "unable to start streaming");
+        return NULL;
+    }
+    self->streaming = true;
+    Py_RETURN_NONE;
+}
+
+static PyObject *Device_stop(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+    if (self->device == NULL || !self->streaming) {
+        Py_RETURN_NONE;
+    }
+    self->streaming = false;
+    int status;
+    Py_BEGIN_ALLOW_THREADS
+    status = libdfc_stop(self->device);
+    Py_END_ALLOW_THREADS
+    if (status == -1) {
+        PyErr_SetString(PyExc_OSError, "error while stopping the stream");
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+/* the device is closed for good once the last block is gone */
+static PyObject *Device_close(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+    if (self->device == NULL || self->closing) {
+        Py_RETURN_NONE;
+    }
+    PyObject *result = Device_stop(self, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    Py_DECREF(result);
+    self->closing = true;
+    device_free_if_unused(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *Device_enter(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+    Py_INCREF(self);
+    return (PyObject *) self;
+}
+
+static PyObject *Device_exit(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+    PyObject *result = Device_close(self, NULL);
+    if (result == NULL) {
+        return NULL;
+    }
+    Py_DECREF(result);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *Device_acquire(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "timeout", NULL };
+    PyObject *timeout_object = Py_None;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &timeout_object)) {
+        return NULL;
+    }
+    double timeout = -1;
+    if (timeout_object != Py_None) {
+        timeout = PyFloat_AsDouble(timeout_object);
+        if (timeout == -1 && PyErr_Occurred()) {
+            return NULL;
+        }
+        if (timeout < 0) {
+            PyErr_SetString(PyExc_ValueError, "timeout must be non-negative");
+            return NULL;
+        }
+    }
+    return device_acquire(self, timeout, false);
+}
+
+static PyObject *Device_iternext(DeviceObject *self)
+{
+    return device_acquire(self, -1, true);
+}
+
+static PyObject *Device_submit(DeviceObject *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "block", "nsamples", NULL };
+    BlockObject *block;
+    Py_ssize_t nsamples = -1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|n", kwlist, &BlockType, &block, &nsamples)) {
+        return NULL;
+    }
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    if (libdfc_is_rx(self->device)) {
+        PyErr_SetString(PyExc_RuntimeError, "submit() is for TX");
+        return NULL;
+    }
+    if (block->device != self || block->released) {
+        PyErr_SetString(PyExc_ValueError, "the block is not a free buffer of this device");
+        return NULL;
+    }
+    if (nsamples < 0) {
+        nsamples = block->nsamples;
+    } else if (nsamples > block->nsamples) {
+        PyErr_Format(PyExc_ValueError, "nsamples larger than the block (%zd)", block->nsamples);
+        return NULL;
+    }
+    /* saturate and shift in place: the DAC is connected to bits 2:15 */
+    short *samples = (short *) block->buffer;
+    Py_BEGIN_ALLOW_THREADS
+    sample_kernels_s16_to_dac(samples, samples, nsamples);
+    Py_END_ALLOW_THREADS
+    block_give_back(block, nsamples * sizeof(short));
+    Py_RETURN_NONE;
+}
+
+/* copies (saturated and shifted) 14 bit samples into as many buffers as needed */
+static PyObject *Device_write(DeviceObject *self, PyObject *args)
+{
+    PyObject *samples_object;
+    if (!PyArg_ParseTuple(args, "O", &samples_object)) {
+        return NULL;
+    }
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    if (libdfc_is_rx(self->device)) {
+        PyErr_SetString(PyExc_RuntimeError, "write() is for TX");
+        return NULL;
+    }
+    Py_buffer view;
+    if (PyObject_GetBuffer(samples_object, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == -1) {
+        return NULL;
+    }
+    /* int16 samples, or raw bytes */
+    const char *format = view.format == NULL ? "B" : view.format;
+    size_t format_length = strlen(format);
+    bool is_short = view.itemsize == sizeof(short) && format_length > 0 && format[format_length - 1] == 'h' && strchr(format, '>') == NULL && strchr(format, '!') == NULL;
+    bool is_bytes = view.itemsize == 1 && view.len % sizeof(short) == 0;
+    if (!is_short && !is_bytes) {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_TypeError, "the samples must be int16 (format '%s')", format);
+        return NULL;
+    }
+    const short *input = (const short *) view.buf;
+    Py_ssize_t total = view.len / sizeof(short);
+    Py_ssize_t written = 0;
+    while (written < total) {
+        BlockObject *block = (BlockObject *) device_acquire(self, -1, true);
+        if (block == NULL) {
+            if (PyErr_Occurred()) {
+                PyBuffer_Release(&view);
+                return NULL;
+            }
+            /* stopped */
+            break;
+        }
+        Py_ssize_t n = total - written < block->nsamples ? total - written : block->nsamples;
+        short *samples = (short *) block->buffer;
+        Py_BEGIN_ALLOW_THREADS
+        sample_kernels_s16_to_dac(input + written, samples, n);
+        Py_END_ALLOW_THREADS
+        block_give_back(block, n * sizeof(short));
+        Py_DECREF(block);
+        written += n;
+    }
+    PyBuffer_Release(&view);
+    return PyLong_FromSsize_t(written);
+}
+
+static PyObject *Device_overflow(DeviceObject *self, PyObject *Py_UNUSED(args))
+{
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    return PyBool_FromLong(libdfc_overflow(self->device));
+}
+
+static PyObject *Device_get_rx(DeviceObject *self, void *Py_UNUSED(closure))
+{
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    return PyBool_FromLong(libdfc_is_rx(self->device));
+}
+
+static PyObject *Device_get_num_buffers(DeviceObject *self, void *Py_UNUSED(closure))
+{
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    return PyLong_FromLong(libdfc_num_buffers(self->device));
+}
+
+static PyObject *Device_get_buffer_size(DeviceObject *self, void *Py_UNUSED(closure))
+{
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    return PyLong_FromLong(libdfc_buffer_size(self->device));
+}
+
+static PyMethodDef Device_methods[] = {
+    { "configure", (PyCFunction) (void (*)(void)) Device_configure, METH_VARARGS | METH_KEYWORDS, "configure(mode, samplerate, reference=27e6, ppm=0)" },
+    { "start", (PyCFunction) (void (*)(void)) Device_start, METH_VARARGS | METH_KEYWORDS, "start(packets=16, transfers=16)" },
+    { "stop", (PyCFunction) Device_stop, METH_NOARGS, "stop streaming (the blocks still around can be read)" },
+    { "close", (PyCFunction) Device_close, METH_NOARGS, "stop and close the device" },
+    { "acquire", (PyCFunction) (void (*)(void)) Device_acquire, METH_VARARGS | METH_KEYWORDS, "acquire(timeout=None) -> the next block (RX: samples, TX: free buffer), None on timeout" },
+    { "submit", (PyCFunction) (void (*)(void)) Device_submit, METH_VARARGS | METH_KEYWORDS, "submit(block, nsamples=None) - TX: send the 14 bit samples in the block" },
+    { "write", (PyCFunction) Device_write, METH_VARARGS, "write(samples) -> number of samples sent - TX: copy the 14 bit int16 samples into the buffers" },
+    { "overflow", (PyCFunction) Device_overflow, METH_NOARGS, "True (once) if samples were lost (RX) or the DAC ran out of samples (TX)" },
+    { "__enter__", (PyCFunction) Device_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction) Device_exit, METH_VARARGS, NULL },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyGetSetDef Device_getset[] = {
+    { "rx", (getter) Device_get_rx, NULL, "True for the ADC modes", NULL },
+    { "num_buffers", (getter) Device_get_num_buffers, NULL, "number of transfer buffers", NULL },
+    { "buffer_size", (getter) Device_get_buffer_size, NULL, "size of a transfer buffer in bytes", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+static PyTypeObject DeviceType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dfc.Device",
+    .tp_doc = PyDoc_STR("Device(firmware='fx3-firmware.img', *, loopback=False, throttle=True)"),
+    .tp_basicsize = sizeof(DeviceObject),
+    .tp_itemsize = 0,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = PyType_GenericNew,
+    .tp_init = (initproc) Device_init,
+    .tp_dealloc = (destructor) Device_dealloc,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc) Device_iternext,
+    .tp_methods = Device_methods,
+    .tp_getset = Device_getset,
+};
+
+
+/* module */
+static struct PyModuleDef dfc_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "dfc",
+    .m_doc = PyDoc_STR("stream samples from/to the DFC transceiver (zero-copy blocks)"),
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_dfc(void)
+{
+    if (PyType_Ready(&DeviceType) < 0 || PyType_Ready(&BlockType) < 0) {
+        return NULL;
+    }
+    PyObject *module = PyModule_Create(&dfc_module);
+    if (module == NULL) {
+        return NULL;
+    }
+    Py_INCREF(&DeviceType);
+    if (PyModule_AddObject(module, "Device", (PyObject *) &DeviceType) < 0) {
+        Py_DECREF(&DeviceType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    Py_INCREF(&BlockType);
+    if (PyModule_AddObject(module, "Block", (PyObject *) &BlockType) < 0) {
+        Py_DECREF(&BlockType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    for (size_t i = 0; i < sizeof(dfc_mode_names) / sizeof(dfc_mode_names[0]); i++) {
+        char constant[32];
+        size_t j;
+        for (j = 0; dfc_mode_names[i].name[j] != '\0' && j < sizeof(constant) - 1; j++) {
+            constant[j] = dfc_mode_names[i].name[j] == '-' ? '_' : dfc_mode_names[i].name[j];
+        }
+        constant[j] = '\0';
+        if (PyModule_AddIntConstant(module, constant, dfc_mode_names[i].mode) < 0) {
+            Py_DECREF(module);
+            return NULL;
+        }
+    }
+    return module;
+}
+
+
+/* internal functions */
+static int device_check_open(DeviceObject *self)
+{
+    if (self->device == NULL || self->closing) {
+        PyErr_SetString(PyExc_ValueError, "the device is closed");
+        return -1;
+    }
+    return 0;
+}
+
+static void device_free_if_unused(DeviceObject *self)
+{
+    if (self->closing && self->outstanding == 0 && self->waiting == 0) {
+        device_free(self);
+    }
+    return;
+}
+
+static void device_free(DeviceObject *self)
+{
+    if (self->device != NULL) {
+        libdfc_device_t *device = self->device;
+        self->device = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        libdfc_close(device);
+        Py_END_ALLOW_THREADS
+    }
+    return;
+}
+
+/* timeout in seconds (< 0: forever); returns NULL with no exception set
+   when the device was stopped while iterating (StopIteration), None on
+   timeout otherwise */
+static PyObject *device_acquire(DeviceObject *self, double timeout, bool iterating)
+{
+    if (device_check_open(self) == -1) {
+        return NULL;
+    }
+    int index;
+    void *buffer = NULL;
+    int length = 0;
+    if (!self->streaming) {
+        if (iterating) {
+            return NULL;
+        }
+        PyErr_SetString(PyExc_RuntimeError, "the device is not streaming");
+        return NULL;
+    }
+    long remaining_us = timeout < 0 ? -1 : (long) (timeout * 1e6);
+    libdfc_device_t *device = self->device;
+    while (true) {
+        long wait_us = remaining_us < 0 || remaining_us > WAIT_SLICE_US ? WAIT_SLICE_US : remaining_us;
+        /* a close() from another thread meanwhile waits for this one */
+        self->waiting++;
+        Py_BEGIN_ALLOW_THREADS
+        index = libdfc_acquire_buffer(device, &buffer, &length, wait_us);
+        Py_END_ALLOW_THREADS
+        self->waiting--;
+        if (self->closing) {
+            if (index >= 0) {
+                libdfc_release_buffer(device, index, 0);
+            }
+            device_free_if_unused(self);
+            if (iterating) {
+                return NULL;
+            }
+            PyErr_SetString(PyExc_ValueError, "the device is closed");
+            return NULL;
+        }
+        if (index != LIBDFC_TIMEOUT) {
+            break;
+        }
+        if (PyErr_CheckSignals() == -1) {
+            return NULL;
+        }
+        if (remaining_us >= 0) {
+            remaining_us -= wait_us;
+            if (remaining_us <= 0) {
+                Py_RETURN_NONE;
+            }
+        }
+    }
+    if (index < 0) {
+        if (iterating) {
+            return NULL;
+        }
+        PyErr_SetString(PyExc_RuntimeError, "the device is not streaming");
+        return NULL;
+    }
+
+    BlockObject *block = PyObject_New(BlockObject, &BlockType);
+    if (block == NULL) {
+        libdfc_release_buffer(self->device, index, 0);
+        return NULL;
+    }
+    Py_INCREF(self);
+    block->device = self;
+    block->index = index;
+    block->buffer = (uint8_t *) buffer;
+    block->length = length;
+    block->nsamples = length / sizeof(short);
+    block->stride = sizeof(short);
+    block->exports = 0;
+    block->released = false;
+    self->outstanding++;
+    return (PyObject *) block;
+}
+
+/* RX: back to the USB side; TX: send length bytes (0: the buffer is just
+   free again) */
+static void block_give_back(BlockObject *self, int length)
+{
+    DeviceObject *device = self->device;
+    self->released = true;
+    if (device->device == NULL) {
+        return;
+    }
+    libdfc_release_buffer(device->device, self->index, length);
+    return;
+}
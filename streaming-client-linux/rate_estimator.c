@@ -0,0 +1,79 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "rate_estimator.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const double default_warmup = 0.5;   /* seconds */
+static const unsigned long long min_points = 16;
+
+
+int rate_estimator_init(rate_estimator_t *this, double nominal_rate, int samples_per_frame, double reference_ppm)
+{
+    memset(this, 0, sizeof(*this));
+    if (nominal_rate <= 0 || samples_per_frame <= 0) {
+        fprintf(stderr, "rate_estimator_init - invalid nominal rate: %lf\n", nominal_rate);
+        return -1;
+    }
+    this->nominal_rate = nominal_rate;
+    this->samples_per_frame = samples_per_frame;
+    this->reference_ppm = reference_ppm;
+    this->warmup = default_warmup;
+    return 0;
+}
+
+/* called when a transfer with nsamples samples completes */
+void rate_estimator_update(rate_estimator_t *this, int nsamples)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!this->started) {
+        this->started = true;
+        this->start_time = now;
+    }
+    this->frames += nsamples / this->samples_per_frame;
+
+    double t = (now.tv_sec - this->start_time.tv_sec) + 1e-9 * (now.tv_nsec - this->start_time.tv_nsec);
+    if (t < this->warmup) {
+        return;
+    }
+    double x = (double) this->frames;
+
+    this->n++;
+    double dt = t - this->mean_t;
+    this->mean_t += dt / this->n;
+    this->mean_x += (x - this->mean_x) / this->n;
+    this->m2_t += dt * (t - this->mean_t);
+    this->c_tx += dt * (x - this->mean_x);
+    return;
+}
+
+int rate_estimator_estimate(const rate_estimator_t *this, double *rate, double *ppm)
+{
+    if (this->n < min_points || this->m2_t <= 0) {
+        return -1;
+    }
+    *rate = this->c_tx / this->m2_t;
+    *ppm = 1e6 * (*rate / this->nominal_rate - 1.0);
+    return 0;
+}
+
+void rate_estimator_stats(rate_estimator_t *this)
+{
+    double rate;
+    double ppm;
+    if (rate_estimator_estimate(this, &rate, &ppm) == -1) {
+        fprintf(stderr, "estimated sample rate: not enough data\n");
+        return;
+    }
+    fprintf(stderr, "estimated sample rate: %.1lf Hz (%+.2lf ppm vs requested %.1lf Hz)\n", rate, ppm, this->nominal_rate);
+    /* the sample rate is derived from the reference clock, so its error in
+       ppm is the reference clock error not yet corrected by -c */
+    fprintf(stderr, "suggested reference clock correction: -c %.2lf\n", this->reference_ppm + ppm);
+    return;
+}
@@ -0,0 +1,40 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_RATE_ESTIMATOR_H_
+#define _STREAMING_CLIENT_RATE_ESTIMATOR_H_
+
+#include <stdbool.h>
+#include <time.h>
+
+/* actual sample rate estimator: a least squares fit of the cumulative
+   number of samples vs the host time (CLOCK_MONOTONIC) at which each
+   transfer completes; the slope is the sample rate as seen by the host
+   clock. The first warmup seconds are ignored, since the first transfers
+   are completed as fast as the FX3 can empty its buffers */
+
+typedef struct {
+    double nominal_rate;            /* requested sample rate (per ADC/DAC) */
+    int samples_per_frame;          /* 2 in DUAL-ADC mode, 1 otherwise */
+    double reference_ppm;           /* current reference clock correction */
+    double warmup;
+    bool started;
+    struct timespec start_time;
+    unsigned long long frames;      /* frames (samples per ADC/DAC) so far */
+    /* running means and co-moments for the fit (Welford) */
+    unsigned long long n;
+    double mean_t;
+    double mean_x;
+    double m2_t;
+    double c_tx;
+} rate_estimator_t;
+
+int rate_estimator_init(rate_estimator_t *this, double nominal_rate, int samples_per_frame, double reference_ppm);
+void rate_estimator_update(rate_estimator_t *this, int nsamples);
+int rate_estimator_estimate(const rate_estimator_t *this, double *rate, double *ppm);
+void rate_estimator_stats(rate_estimator_t *this);
+
+#endif /* _STREAMING_CLIENT_RATE_ESTIMATOR_H_ */
@@ -0,0 +1,176 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "rx_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int rx_ring_init(rx_ring_t *this, int num_blocks, int block_size, rx_ring_policy_t policy)
+{
+    memset(this, 0, sizeof(*this));
+    if (num_blocks < 2) {
+        fprintf(stderr, "rx_ring_init - invalid number of blocks: %d\n", num_blocks);
+        return -1;
+    }
+    this->num_blocks = num_blocks;
+    this->block_size = block_size;
+    this->policy = policy;
+    this->blocks = (rx_ring_block_t *) calloc(num_blocks, sizeof(rx_ring_block_t));
+    if (this->blocks == NULL) {
+        fprintf(stderr, "rx_ring_init - calloc() failed\n");
+        return -1;
+    }
+    for (int i = 0; i < num_blocks; i++) {
+        this->blocks[i].data = (uint8_t *) malloc(block_size);
+        if (this->blocks[i].data == NULL) {
+            fprintf(stderr, "rx_ring_init - malloc() failed\n");
+            rx_ring_fini(this);
+            return -1;
+        }
+    }
+    this->current.data = (uint8_t *) malloc(block_size);
+    if (this->current.data == NULL) {
+        fprintf(stderr, "rx_ring_init - malloc() failed\n");
+        rx_ring_fini(this);
+        return -1;
+    }
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->not_empty, NULL);
+    pthread_cond_init(&this->not_full, NULL);
+    return 0;
+}
+
+int rx_ring_fini(rx_ring_t *this)
+{
+    if (this->blocks != NULL) {
+        for (int i = 0; i < this->num_blocks; i++) {
+            free(this->blocks[i].data);
+        }
+        free(this->blocks);
+        this->blocks = NULL;
+        free(this->current.data);
+        this->current.data = NULL;
+        pthread_cond_destroy(&this->not_full);
+        pthread_cond_destroy(&this->not_empty);
+        pthread_mutex_destroy(&this->mutex);
+    }
+    return 0;
+}
+
+/* called from the USB callback; returns 1 if a block was dropped */
+int rx_ring_put(rx_ring_t *this, const uint8_t *buffer, int length)
+{
+    if (length > this->block_size) {
+        length = this->block_size;
+    }
+    int nsamples = length / sizeof(short);
+
+    pthread_mutex_lock(&this->mutex);
+    unsigned long long offset = this->next_offset;
+    this->next_offset += nsamples;
+    this->blocks_in++;
+
+    if (this->count == this->num_blocks) {
+        switch (this->policy) {
+        case RX_RING_BLOCK:
+            if (!this->closed) {
+                struct timespec start;
+                struct timespec end;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                while (this->count == this->num_blocks && !this->closed) {
+                    pthread_cond_wait(&this->not_full, &this->mutex);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                this->wait_time += (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+            }
+            break;
+        case RX_RING_DROP_NEWEST:
+            break;
+        case RX_RING_DROP_OLDEST:
+            if (this->count > 0) {
+                rx_ring_block_t *oldest = &this->blocks[this->tail];
+                this->blocks_dropped++;
+                this->samples_dropped += oldest->length / sizeof(short);
+                this->tail = (this->tail + 1) % this->num_blocks;
+                this->count--;
+            }
+            break;
+        }
+    }
+    if (this->closed || this->count == this->num_blocks) {
+        this->blocks_dropped++;
+        this->samples_dropped += nsamples;
+        pthread_mutex_unlock(&this->mutex);
+        return 1;
+    }
+    rx_ring_block_t *block = &this->blocks[this->head];
+    pthread_mutex_unlock(&this->mutex);
+
+    /* the block is not visible to the consumer until count is incremented */
+    memcpy(block->data, buffer, length);
+    block->length = length;
+    block->sample_offset = offset;
+    clock_gettime(CLOCK_REALTIME, &block->timestamp);
+
+    pthread_mutex_lock(&this->mutex);
+    this->head = (this->head + 1) % this->num_blocks;
+    this->count++;
+    if (this->count > this->max_fill) {
+        this->max_fill = this->count;
+    }
+    pthread_cond_signal(&this->not_empty);
+    pthread_mutex_unlock(&this->mutex);
+    return 0;
+}
+
+/* called from the consumer thread; the block is valid until the next call.
+   Returns NULL once the ring is closed and empty */
+rx_ring_block_t *rx_ring_get(rx_ring_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    while (this->count == 0 && !this->closed) {
+        pthread_cond_wait(&this->not_empty, &this->mutex);
+    }
+    if (this->count == 0) {
+        pthread_mutex_unlock(&this->mutex);
+        return NULL;
+    }
+    /* take the block out of the ring by swapping buffers with it */
+    rx_ring_block_t *block = &this->blocks[this->tail];
+    uint8_t *data = this->current.data;
+    this->current = *block;
+    block->data = data;
+    this->tail = (this->tail + 1) % this->num_blocks;
+    this->count--;
+    pthread_cond_signal(&this->not_full);
+    pthread_mutex_unlock(&this->mutex);
+    return &this->current;
+}
+
+/* no more blocks: the consumer drains the ring and the producer never waits */
+void rx_ring_close(rx_ring_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    this->closed = true;
+    pthread_cond_broadcast(&this->not_empty);
+    pthread_cond_broadcast(&this->not_full);
+    pthread_mutex_unlock(&this->mutex);
+    return;
+}
+
+void rx_ring_stats(rx_ring_t *this)
+{
+    static const char *policy_names[] = { "block", "drop-newest", "drop-oldest" };
+    fprintf(stderr, "rx ring: %d blocks (%s) - max fill: %d\n", this->num_blocks, policy_names[this->policy], this->max_fill);
+    fprintf(stderr, "rx ring blocks: %llu in, %llu dropped (%llu samples)\n", this->blocks_in, this->blocks_dropped, this->samples_dropped);
+    if (this->policy == RX_RING_BLOCK) {
+        fprintf(stderr, "rx ring wait time: %.3lf s\n", this->wait_time);
+    }
+    return;
+}
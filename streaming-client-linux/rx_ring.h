@@ -0,0 +1,69 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_RX_RING_H_
+#define _STREAMING_CLIENT_RX_RING_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/* RX ring: decouples the USB callbacks from the processing of the samples.
+   Each completed transfer is copied into a block of the ring (tagged with
+   its sample offset in the stream) and a consumer thread takes the blocks
+   out in order (the consumer swaps its own buffer with the one in the
+   ring, so a block is never copied twice). When the ring is full the policy decides what happens:
+   - block: the USB callback waits for a free block (the backpressure ends
+     up at the FX3, which may then overflow on its own)
+   - drop-newest: the incoming block is discarded
+   - drop-oldest: the oldest block waiting to be processed is discarded
+   Dropped blocks leave a hole in the sample offsets, which the consumer
+   sees as a gap */
+
+typedef enum {
+    RX_RING_BLOCK,
+    RX_RING_DROP_NEWEST,
+    RX_RING_DROP_OLDEST
+} rx_ring_policy_t;
+
+typedef struct {
+    uint8_t *data;
+    int length;
+    unsigned long long sample_offset;
+    struct timespec timestamp;
+} rx_ring_block_t;
+
+typedef struct {
+    int num_blocks;
+    int block_size;
+    rx_ring_policy_t policy;
+    rx_ring_block_t *blocks;
+    rx_ring_block_t current;        /* the block the consumer is working on */
+    int head;                       /* next block to be filled */
+    int tail;                       /* next block to be consumed */
+    int count;                      /* blocks waiting to be consumed */
+    bool closed;
+    unsigned long long next_offset; /* sample offset of the next incoming block */
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    /* stats */
+    unsigned long long blocks_in;
+    unsigned long long blocks_dropped;
+    unsigned long long samples_dropped;
+    int max_fill;
+    double wait_time;               /* time spent waiting with the block policy */
+} rx_ring_t;
+
+int rx_ring_init(rx_ring_t *this, int num_blocks, int block_size, rx_ring_policy_t policy);
+int rx_ring_fini(rx_ring_t *this);
+int rx_ring_put(rx_ring_t *this, const uint8_t *buffer, int length);
+rx_ring_block_t *rx_ring_get(rx_ring_t *this);
+void rx_ring_close(rx_ring_t *this);
+void rx_ring_stats(rx_ring_t *this);
+
+#endif /* _STREAMING_CLIENT_RX_RING_H_ */
@@ -0,0 +1,179 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "sample_kernels.h"
+
+#include <limits.h>
+#include <stdio.h>
+
+static const int SIXTEEN_BITS_OFFSET = 32768;   /* histogram bin of sample 0 */
+
+/* internal functions */
+static void range_single_adc(const short *samples, int nsamples, sample_range_t *range);
+static void range_dual_adc(const short *samples, int nsamples, sample_range_t *range);
+static void histogram_single_adc(const short *samples, int nsamples, unsigned long long *histograms[2]);
+static void histogram_dual_adc(const short *samples, int nsamples, unsigned long long *histograms[2]);
+static inline int float_to_dac(const float *samples, int stride, short *dac_words, int nsamples);
+
+
+int sample_kernels_init(sample_kernels_t *this, sample_layout_t layout)
+{
+    this->layout = layout;
+    switch (layout) {
+    case SAMPLE_LAYOUT_SINGLE_ADC:
+        this->num_channels = 1;
+        this->range = range_single_adc;
+        this->histogram = histogram_single_adc;
+        break;
+    case SAMPLE_LAYOUT_DUAL_ADC:
+        this->num_channels = 2;
+        this->range = range_dual_adc;
+        this->histogram = histogram_dual_adc;
+        break;
+    case SAMPLE_LAYOUT_DAC:
+        /* nothing to analyze in the TX stream */
+        this->num_channels = 1;
+        this->range = NULL;
+        this->histogram = NULL;
+        break;
+    default:
+        fprintf(stderr, "sample_kernels_init - invalid sample layout: %d\n", layout);
+        return -1;
+    }
+    return 0;
+}
+
+void sample_range_reset(sample_range_t *this)
+{
+    for (int c = 0; c < 2; c++) {
+        this->min[c] = SHRT_MAX;
+        this->max[c] = SHRT_MIN;
+    }
+    return;
+}
+
+void sample_range_merge(sample_range_t *this, const sample_range_t *other)
+{
+    for (int c = 0; c < 2; c++) {
+        this->min[c] = other->min[c] < this->min[c] ? other->min[c] : this->min[c];
+        this->max[c] = other->max[c] > this->max[c] ? other->max[c] : this->max[c];
+    }
+    return;
+}
+
+void sample_kernels_to_dac(short *samples, int nsamples)
+{
+    for (int i = 0; i < nsamples; i++) {
+        samples[i] = (short) ((unsigned short) samples[i] << 2);
+    }
+    return;
+}
+
+int sample_kernels_s16_to_dac(const short *samples, short *dac_words, int nsamples)
+{
+    int clipped = 0;
+    for (int i = 0; i < nsamples; i++) {
+        int sample = samples[i];
+        clipped += (sample < -8192) | (sample > 8191);
+        sample = sample < -8192 ? -8192 : sample > 8191 ? 8191 : sample;
+        dac_words[i] = (short) ((unsigned short) sample << 2);
+    }
+    return clipped;
+}
+
+/* one loop for each stride, so that the loads are contiguous (f32) or a
+   plain even/odd deinterleave (cf32) */
+int sample_kernels_float_to_dac(const float *samples, int stride, short *dac_words, int nsamples)
+{
+    if (stride == 2) {
+        return float_to_dac(samples, 2, dac_words, nsamples);
+    }
+    return float_to_dac(samples, 1, dac_words, nsamples);
+}
+
+
+/* internal functions */
+static void range_single_adc(const short *samples, int nsamples, sample_range_t *range)
+{
+    short min = SHRT_MAX;
+    short max = SHRT_MIN;
+    for (int i = 0; i < nsamples; i++) {
+        min = samples[i] < min ? samples[i] : min;
+        max = samples[i] > max ? samples[i] : max;
+    }
+    sample_range_reset(range);
+    range->min[0] = min;
+    range->max[0] = max;
+    return;
+}
+
+static void range_dual_adc(const short *samples, int nsamples, sample_range_t *range)
+{
+    short min_a = SHRT_MAX;
+    short max_a = SHRT_MIN;
+    short min_b = SHRT_MAX;
+    short max_b = SHRT_MIN;
+    int npairs = nsamples / 2;
+    for (int i = 0; i < npairs; i++) {
+        short a = samples[2 * i];
+        short b = samples[2 * i + 1];
+        min_a = a < min_a ? a : min_a;
+        max_a = a > max_a ? a : max_a;
+        min_b = b < min_b ? b : min_b;
+        max_b = b > max_b ? b : max_b;
+    }
+    if (nsamples % 2 != 0) {
+        short a = samples[nsamples - 1];
+        min_a = a < min_a ? a : min_a;
+        max_a = a > max_a ? a : max_a;
+    }
+    range->min[0] = min_a;
+    range->max[0] = max_a;
+    range->min[1] = min_b;
+    range->max[1] = max_b;
+    return;
+}
+
+static void histogram_single_adc(const short *samples, int nsamples, unsigned long long *histograms[2])
+{
+    unsigned long long *histogram = histograms[0];
+    for (int i = 0; i < nsamples; i++) {
+        histogram[samples[i] + SIXTEEN_BITS_OFFSET]++;
+    }
+    return;
+}
+
+static void histogram_dual_adc(const short *samples, int nsamples, unsigned long long *histograms[2])
+{
+    unsigned long long *histogram_a = histograms[0];
+    unsigned long long *histogram_b = histograms[1];
+    int npairs = nsamples / 2;
+    for (int i = 0; i < npairs; i++) {
+        histogram_a[samples[2 * i] + SIXTEEN_BITS_OFFSET]++;
+        histogram_b[samples[2 * i + 1] + SIXTEEN_BITS_OFFSET]++;
+    }
+    if (nsamples % 2 != 0) {
+        histogram_a[samples[nsamples - 1] + SIXTEEN_BITS_OFFSET]++;
+    }
+    return;
+}
+
+/* scale, saturation (NaNs go to the negative full scale), round to
+   nearest, and shift; GCC only vectorizes the float comparisons with
+   -fno-trapping-math */
+static inline int float_to_dac(const float *samples, int stride, short *dac_words, int nsamples)
+{
+    int clipped = 0;
+    for (int i = 0; i < nsamples; i++) {
+        float value = samples[i * stride] * 8191.0f;
+        clipped += !(value >= -8192.0f) | (value > 8191.0f);
+        value = value > -8192.0f ? value : -8192.0f;
+        value = value < 8191.0f ? value : 8191.0f;
+        int sample = (int) (value + (value >= 0.0f ? 0.5f : -0.5f));
+        dac_words[i] = (short) ((unsigned short) sample << 2);
+    }
+    return clipped;
+}
@@ -0,0 +1,47 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SAMPLE_KERNELS_H_
+#define _STREAMING_CLIENT_SAMPLE_KERNELS_H_
+
+#include "types.h"
+
+/* per sample layout (i.e. per DFC mode) kernels for the sample stream: the
+   layout is fixed when the stream starts, so each one gets its own loops,
+   without i % 2 tests or mode checks inside; sample_kernels_init() picks
+   the ones for the layout.
+   Channel 0 is the only ADC (SINGLE-ADC) or ADC A (DUAL-ADC, even samples),
+   channel 1 is ADC B (DUAL-ADC, odd samples) */
+
+typedef struct {
+    short min[2];
+    short max[2];
+} sample_range_t;
+
+typedef struct {
+    sample_layout_t layout;
+    int num_channels;
+    /* sample range of each channel in a block */
+    void (*range)(const short *samples, int nsamples, sample_range_t *range);
+    /* adds the samples of each channel to its histogram (65536 bins) */
+    void (*histogram)(const short *samples, int nsamples, unsigned long long *histograms[2]);
+} sample_kernels_t;
+
+int sample_kernels_init(sample_kernels_t *this, sample_layout_t layout);
+void sample_range_reset(sample_range_t *this);
+void sample_range_merge(sample_range_t *this, const sample_range_t *other);
+/* TX: 14 bit samples to DAC words (bits 2:15), in place */
+void sample_kernels_to_dac(short *samples, int nsamples);
+/* TX: 16 bit samples to DAC words, with saturation to the 14 bit range
+   (samples and dac_words can be the same buffer); returns the number of
+   samples that were clipped */
+int sample_kernels_s16_to_dac(const short *samples, short *dac_words, int nsamples);
+/* TX: float samples (full scale +/-1.0; stride 2 takes the real part of
+   complex samples) to DAC words, with saturation; returns the number of
+   samples that were clipped */
+int sample_kernels_float_to_dac(const float *samples, int stride, short *dac_words, int nsamples);
+
+#endif /* _STREAMING_CLIENT_SAMPLE_KERNELS_H_ */
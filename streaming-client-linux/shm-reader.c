@@ -0,0 +1,141 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+/* example client of the shared memory ring: attach to the RX stream
+   published by streaming-client --shm NAME and write it to a file (or
+   stdout), reporting the blocks lost because this reader was too slow */
+
+#include "shm_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static volatile bool stop = false;
+
+static void sig_stop(int signum);
+static int write_all(int fileno, const void *buffer, size_t length);
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL;
+    int delay = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "o:d:")) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case 'd':
+            /* simulate a slow reader (for testing) */
+            if (sscanf(optarg, "%d", &delay) != 1 || delay < 0) {
+                fprintf(stderr, "invalid delay (us): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case '?':
+            /* invalid option */
+            return EXIT_FAILURE;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-o output file|-] [-d delay (us)] <shared memory name>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int output_fileno = -1;
+    if (output != NULL) {
+        if (strcmp(output, "-") == 0) {
+            output_fileno = STDOUT_FILENO;
+        } else {
+            output_fileno = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (output_fileno == -1) {
+                fprintf(stderr, "open(%s) for writing failed: %s\n", output, strerror(errno));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    shm_reader_t reader;
+    if (shm_reader_open(&reader, argv[optind]) == -1) {
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "attached to %s - sample rate: %.0lf Hz, %d sample(s) per frame\n", argv[optind], shm_reader_sample_rate(&reader), shm_reader_samples_per_frame(&reader));
+
+    struct sigaction sigact;
+    sigact.sa_handler = sig_stop;
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    (void)sigaction(SIGINT, &sigact, NULL);
+    (void)sigaction(SIGTERM, &sigact, NULL);
+
+    unsigned long long samples = 0;
+    unsigned long long invalid = 0;
+    while (!stop) {
+        shm_reader_block_t block;
+        shm_reader_status_t status = shm_reader_next(&reader, &block, 1000);
+        if (status == SHM_READER_END || status == SHM_READER_ERROR) {
+            break;
+        } else if (status == SHM_READER_TIMEOUT) {
+            continue;
+        }
+        if (block.lost > 0) {
+            fprintf(stderr, "overrun: %llu blocks lost before sample %llu\n", (unsigned long long) block.lost, (unsigned long long) block.sample_offset);
+        }
+        if (output_fileno >= 0) {
+            if (write_all(output_fileno, block.samples, block.nsamples * sizeof(short)) == -1) {
+                break;
+            }
+        }
+        if (delay > 0) {
+            usleep(delay);
+        }
+        if (!shm_reader_valid(&reader, &block)) {
+            /* the writer overwrote the block while we were using it */
+            invalid++;
+        }
+        samples += block.nsamples;
+    }
+
+    fprintf(stderr, "blocks: %llu - samples: %llu - lost blocks: %llu - overwritten while in use: %llu\n",
+            (unsigned long long) reader.blocks, samples, (unsigned long long) reader.overruns, invalid);
+    shm_reader_close(&reader);
+    if (output_fileno >= 0 && output_fileno != STDOUT_FILENO) {
+        close(output_fileno);
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/* internal functions */
+static void sig_stop(int signum __attribute__((unused)))
+{
+    stop = true;
+}
+
+static int write_all(int fileno, const void *buffer, size_t length)
+{
+    const char *data = (const char *) buffer;
+    while (length > 0) {
+        ssize_t written = write(fileno, data, length);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "write to output file failed - error: %s\n", strerror(errno));
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SHM_LAYOUT_H_
+#define _STREAMING_CLIENT_SHM_LAYOUT_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* layout of the shared memory ring with the RX stream (see shm_ring.h for
+   the writer and shm_reader.h for the readers).
+   The object starts with a header (readable and writable by everybody,
+   since the readers keep their cursors there) followed by the block
+   descriptors; the block data starts at header_size (page aligned) and is
+   mapped read-only by the readers.
+   Blocks are published with a sequence number; the descriptor of a block
+   holds its sequence number while the block is valid, and SHM_SEQUENCE_BUSY
+   while the writer is overwriting it (a sequence lock), so a reader can
+   always tell if the block it is looking at has been overwritten */
+
+#define SHM_MAGIC "DFCRING"
+#define SHM_VERSION 1
+#define SHM_MAX_READERS 16
+#define SHM_SEQUENCE_BUSY UINT64_MAX
+
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the shared memory ring needs lock free 64 bit atomics");
+
+typedef struct {
+    _Atomic uint32_t in_use;            /* claimed with a compare and swap */
+    int32_t pid;
+    _Atomic uint64_t cursor;            /* next block the reader wants */
+    _Atomic uint64_t overruns;          /* blocks overwritten before the reader got to them */
+} shm_reader_slot_t;
+
+typedef struct {
+    _Atomic uint64_t sequence;
+    uint64_t sample_offset;             /* raw samples in the stream before this block */
+    uint32_t length;                    /* bytes */
+    uint32_t reserved;
+    double timestamp;                   /* host time (s since the epoch) */
+} shm_block_descriptor_t;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;               /* offset of the block data */
+    uint32_t num_blocks;
+    uint32_t block_size;                /* bytes */
+    uint32_t samples_per_frame;         /* 2 in DUAL-ADC mode (interleaved), 1 otherwise */
+    uint32_t reserved;
+    double sample_rate;                 /* per ADC */
+    _Atomic uint64_t write_sequence;    /* blocks published so far */
+    _Atomic uint32_t futex;             /* bumped at every block, for the readers to wait on */
+    _Atomic uint32_t waiters;           /* readers waiting on the futex */
+    _Atomic uint32_t closed;            /* the writer is gone */
+    uint32_t reserved2;
+    shm_reader_slot_t readers[SHM_MAX_READERS];
+    shm_block_descriptor_t blocks[];    /* num_blocks */
+} shm_ring_header_t;
+
+#endif /* _STREAMING_CLIENT_SHM_LAYOUT_H_ */
@@ -0,0 +1,198 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "shm_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+int shm_reader_open(shm_reader_t *this, const char *name)
+{
+    memset(this, 0, sizeof(*this));
+    this->fd = -1;
+    this->slot = -1;
+
+    char shm_name[256];
+    snprintf(shm_name, sizeof(shm_name), "%s%s", name[0] == '/' ? "" : "/", name);
+    this->fd = shm_open(shm_name, O_RDWR, 0);
+    if (this->fd == -1) {
+        fprintf(stderr, "shm_reader_open - shm_open(%s) failed: %s\n", shm_name, strerror(errno));
+        return -1;
+    }
+
+    /* map the header first to find out the layout */
+    struct stat st;
+    if (fstat(this->fd, &st) == -1 || (size_t) st.st_size < sizeof(shm_ring_header_t)) {
+        fprintf(stderr, "shm_reader_open - %s is not a DFC shared memory ring\n", shm_name);
+        shm_reader_close(this);
+        return -1;
+    }
+    shm_ring_header_t *header = (shm_ring_header_t *) mmap(NULL, sizeof(shm_ring_header_t), PROT_READ, MAP_SHARED, this->fd, 0);
+    if (header == MAP_FAILED) {
+        fprintf(stderr, "shm_reader_open - mmap() failed: %s\n", strerror(errno));
+        shm_reader_close(this);
+        return -1;
+    }
+    bool ok = memcmp(header->magic, SHM_MAGIC, sizeof(header->magic)) == 0 && header->version == SHM_VERSION;
+    atomic_thread_fence(memory_order_acquire);
+    size_t header_size = header->header_size;
+    this->size = header_size + (size_t) header->num_blocks * header->block_size;
+    munmap(header, sizeof(shm_ring_header_t));
+    if (!ok || (size_t) st.st_size < this->size) {
+        fprintf(stderr, "shm_reader_open - %s is not a DFC shared memory ring (or it is still being created)\n", shm_name);
+        shm_reader_close(this);
+        return -1;
+    }
+
+    /* the header is writable (for the reader cursor), the samples are not */
+    void *base = mmap(NULL, this->size, PROT_READ, MAP_SHARED, this->fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "shm_reader_open - mmap() failed: %s\n", strerror(errno));
+        shm_reader_close(this);
+        return -1;
+    }
+    this->header = (shm_ring_header_t *) base;
+    this->data = (const uint8_t *) base + header_size;
+    if (mprotect(base, header_size, PROT_READ | PROT_WRITE) == -1) {
+        fprintf(stderr, "shm_reader_open - mprotect() failed: %s\n", strerror(errno));
+        shm_reader_close(this);
+        return -1;
+    }
+
+    /* claim a reader slot; reading starts from the most recent block */
+    for (int i = 0; i < SHM_MAX_READERS; i++) {
+        uint32_t expected = 0;
+        if (atomic_compare_exchange_strong(&this->header->readers[i].in_use, &expected, 1)) {
+            this->slot = i;
+            break;
+        }
+    }
+    if (this->slot == -1) {
+        fprintf(stderr, "shm_reader_open - too many readers on %s\n", shm_name);
+        shm_reader_close(this);
+        return -1;
+    }
+    shm_reader_slot_t *reader = &this->header->readers[this->slot];
+    this->cursor = atomic_load(&this->header->write_sequence);
+    reader->pid = getpid();
+    atomic_store(&reader->overruns, 0);
+    atomic_store(&reader->cursor, this->cursor);
+    return 0;
+}
+
+int shm_reader_close(shm_reader_t *this)
+{
+    if (this->header != NULL) {
+        if (this->slot >= 0) {
+            atomic_store(&this->header->readers[this->slot].in_use, 0);
+            this->slot = -1;
+        }
+        munmap(this->header, this->size);
+        this->header = NULL;
+    }
+    if (this->fd >= 0) {
+        close(this->fd);
+        this->fd = -1;
+    }
+    return 0;
+}
+
+/* wait up to timeout_ms (-1 = forever) for the next block */
+shm_reader_status_t shm_reader_next(shm_reader_t *this, shm_reader_block_t *block, int timeout_ms)
+{
+    shm_ring_header_t *header = this->header;
+    uint64_t num_blocks = header->num_blocks;
+    uint64_t lost = 0;
+
+    while (true) {
+        uint32_t futex = atomic_load(&header->futex);
+        uint64_t write_sequence = atomic_load_explicit(&header->write_sequence, memory_order_acquire);
+        if (this->cursor < write_sequence) {
+            /* the slot of write_sequence - num_blocks may be being overwritten */
+            if (write_sequence - this->cursor >= num_blocks) {
+                uint64_t skip = write_sequence - this->cursor - (num_blocks - 1);
+                lost += skip;
+                this->cursor += skip;
+                continue;
+            }
+            const shm_block_descriptor_t *descriptor = &header->blocks[this->cursor % num_blocks];
+            if (atomic_load_explicit(&descriptor->sequence, memory_order_acquire) != this->cursor) {
+                /* overwritten in the meantime */
+                lost++;
+                this->cursor++;
+                continue;
+            }
+            block->samples = (const short *) (this->data + (this->cursor % num_blocks) * header->block_size);
+            block->nsamples = descriptor->length / sizeof(short);
+            block->sequence = this->cursor;
+            block->sample_offset = descriptor->sample_offset;
+            block->timestamp = descriptor->timestamp;
+            block->lost = lost;
+            if (!shm_reader_valid(this, block)) {
+                lost++;
+                this->cursor++;
+                continue;
+            }
+            this->cursor++;
+            this->blocks++;
+            this->overruns += lost;
+            shm_reader_slot_t *reader = &header->readers[this->slot];
+            atomic_store(&reader->cursor, this->cursor);
+            if (lost > 0) {
+                atomic_fetch_add(&reader->overruns, lost);
+            }
+            return SHM_READER_OK;
+        }
+        if (atomic_load(&header->closed)) {
+            return SHM_READER_END;
+        }
+        if (timeout_ms == 0) {
+            return SHM_READER_TIMEOUT;
+        }
+
+        struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        atomic_fetch_add(&header->waiters, 1);
+        long status = syscall(SYS_futex, &header->futex, FUTEX_WAIT, futex, timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+        atomic_fetch_sub(&header->waiters, 1);
+        if (status == -1 && errno == ETIMEDOUT) {
+            return SHM_READER_TIMEOUT;
+        }
+    }
+}
+
+/* true if the block returned by shm_reader_next() has not been overwritten
+   (yet); call it after using the samples */
+bool shm_reader_valid(const shm_reader_t *this, const shm_reader_block_t *block)
+{
+    const shm_block_descriptor_t *descriptor = &this->header->blocks[block->sequence % this->header->num_blocks];
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&descriptor->sequence, memory_order_relaxed) == block->sequence;
+}
+
+/* blocks published but not read yet */
+uint64_t shm_reader_lag(const shm_reader_t *this)
+{
+    return atomic_load(&this->header->write_sequence) - this->cursor;
+}
+
+double shm_reader_sample_rate(const shm_reader_t *this)
+{
+    return this->header->sample_rate;
+}
+
+int shm_reader_samples_per_frame(const shm_reader_t *this)
+{
+    return this->header->samples_per_frame;
+}
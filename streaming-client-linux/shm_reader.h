@@ -0,0 +1,68 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SHM_READER_H_
+#define _STREAMING_CLIENT_SHM_READER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "shm_layout.h"
+
+/* client library for the shared memory ring published by
+   streaming-client --shm NAME. The samples are mapped read-only and are
+   not copied: shm_reader_next() returns a pointer into the ring, which is
+   valid until the writer comes around again; shm_reader_valid() tells if
+   that happened while the block was being used.
+
+   Typical use:
+       shm_reader_t reader;
+       shm_reader_open(&reader, "dfc-rx");
+       shm_reader_block_t block;
+       while (shm_reader_next(&reader, &block, 1000) != SHM_READER_END) {
+           ... use block.samples ...
+           if (!shm_reader_valid(&reader, &block)) { ... overwritten ... }
+       }
+       shm_reader_close(&reader);
+*/
+
+typedef enum {
+    SHM_READER_ERROR = -1,
+    SHM_READER_OK = 0,
+    SHM_READER_TIMEOUT = 1,
+    SHM_READER_END = 2          /* the writer is gone and everything was read */
+} shm_reader_status_t;
+
+typedef struct {
+    const short *samples;
+    int nsamples;
+    uint64_t sequence;
+    uint64_t sample_offset;
+    double timestamp;
+    uint64_t lost;              /* blocks lost just before this one */
+} shm_reader_block_t;
+
+typedef struct {
+    int fd;
+    size_t size;
+    shm_ring_header_t *header;
+    const uint8_t *data;
+    int slot;
+    uint64_t cursor;
+    /* stats */
+    uint64_t blocks;
+    uint64_t overruns;
+} shm_reader_t;
+
+int shm_reader_open(shm_reader_t *this, const char *name);
+int shm_reader_close(shm_reader_t *this);
+shm_reader_status_t shm_reader_next(shm_reader_t *this, shm_reader_block_t *block, int timeout_ms);
+bool shm_reader_valid(const shm_reader_t *this, const shm_reader_block_t *block);
+uint64_t shm_reader_lag(const shm_reader_t *this);
+double shm_reader_sample_rate(const shm_reader_t *this);
+int shm_reader_samples_per_frame(const shm_reader_t *this);
+
+#endif /* _STREAMING_CLIENT_SHM_READER_H_ */
@@ -0,0 +1,149 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+
+int shm_ring_init(shm_ring_t *this, const char *name, int num_blocks, int block_size, double sample_rate, int samples_per_frame)
+{
+    memset(this, 0, sizeof(*this));
+    this->fd = -1;
+    if (num_blocks < 2 || block_size <= 0) {
+        fprintf(stderr, "shm_ring_init - invalid number of blocks/block size: %d/%d\n", num_blocks, block_size);
+        return -1;
+    }
+    /* POSIX shared memory object names start with a slash */
+    snprintf(this->name, sizeof(this->name), "%s%s", name[0] == '/' ? "" : "/", name);
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    size_t header_size = sizeof(shm_ring_header_t) + num_blocks * sizeof(shm_block_descriptor_t);
+    header_size = (header_size + page_size - 1) / page_size * page_size;
+    this->size = header_size + (size_t) num_blocks * block_size;
+
+    /* a stale object from a previous run would have the wrong layout */
+    shm_unlink(this->name);
+    this->fd = shm_open(this->name, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (this->fd == -1) {
+        fprintf(stderr, "shm_ring_init - shm_open(%s) failed: %s\n", this->name, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(this->fd, this->size) == -1) {
+        fprintf(stderr, "shm_ring_init - ftruncate() failed: %s\n", strerror(errno));
+        shm_ring_fini(this);
+        return -1;
+    }
+    void *base = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "shm_ring_init - mmap() failed: %s\n", strerror(errno));
+        shm_ring_fini(this);
+        return -1;
+    }
+    this->header = (shm_ring_header_t *) base;
+    this->data = (uint8_t *) base + header_size;
+
+    /* the object is zero filled, so every reader slot is free; the magic
+       is written last, so a reader never sees a half initialized header */
+    shm_ring_header_t *header = this->header;
+    header->version = SHM_VERSION;
+    header->header_size = header_size;
+    header->num_blocks = num_blocks;
+    header->block_size = block_size;
+    header->samples_per_frame = samples_per_frame;
+    header->sample_rate = sample_rate;
+    for (int i = 0; i < num_blocks; i++) {
+        atomic_init(&header->blocks[i].sequence, SHM_SEQUENCE_BUSY);
+    }
+    atomic_thread_fence(memory_order_release);
+    memcpy(header->magic, SHM_MAGIC, sizeof(header->magic));
+    return 0;
+}
+
+int shm_ring_fini(shm_ring_t *this)
+{
+    if (this->header != NULL) {
+        /* tell the readers that there is nothing more coming */
+        atomic_store(&this->header->closed, 1);
+        atomic_fetch_add(&this->header->futex, 1);
+        syscall(SYS_futex, &this->header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        munmap(this->header, this->size);
+        this->header = NULL;
+    }
+    if (this->fd >= 0) {
+        close(this->fd);
+        this->fd = -1;
+        /* the readers that are still attached keep their mapping */
+        shm_unlink(this->name);
+    }
+    return 0;
+}
+
+/* copy a block into the ring and make it visible to the readers */
+int shm_ring_publish(shm_ring_t *this, const void *data, int length)
+{
+    shm_ring_header_t *header = this->header;
+    if (length > (int) header->block_size) {
+        length = header->block_size;
+    }
+    uint64_t sequence = this->write_sequence;
+    int slot = sequence % header->num_blocks;
+    shm_block_descriptor_t *descriptor = &header->blocks[slot];
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    atomic_store_explicit(&descriptor->sequence, SHM_SEQUENCE_BUSY, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(this->data + (size_t) slot * header->block_size, data, length);
+    descriptor->sample_offset = this->sample_offset;
+    descriptor->length = length;
+    descriptor->timestamp = now.tv_sec + 1e-9 * now.tv_nsec;
+    atomic_store_explicit(&descriptor->sequence, sequence, memory_order_release);
+    atomic_store_explicit(&header->write_sequence, sequence + 1, memory_order_release);
+
+    this->write_sequence = sequence + 1;
+    this->sample_offset += length / sizeof(short);
+    this->blocks++;
+
+    /* only bother the kernel if somebody is waiting */
+    atomic_fetch_add(&header->futex, 1);
+    if (atomic_load(&header->waiters) > 0) {
+        syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        this->wakeups++;
+    }
+    return 0;
+}
+
+/* pipeline stage: the context is the shared memory ring */
+int shm_ring_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    return shm_ring_publish((shm_ring_t *) stage->context, block->samples, block->nsamples * sizeof(short));
+}
+
+void shm_ring_stats(shm_ring_t *this)
+{
+    shm_ring_header_t *header = this->header;
+    fprintf(stderr, "shared memory ring %s: %llu blocks published (%u blocks of %u B)\n", this->name, this->blocks, header->num_blocks, header->block_size);
+    for (int i = 0; i < SHM_MAX_READERS; i++) {
+        shm_reader_slot_t *reader = &header->readers[i];
+        if (atomic_load(&reader->in_use)) {
+            uint64_t cursor = atomic_load(&reader->cursor);
+            fprintf(stderr, "shared memory reader %d (pid %d): lag %llu blocks, %llu blocks lost\n", i, reader->pid,
+                    (unsigned long long) (this->write_sequence - cursor), (unsigned long long) atomic_load(&reader->overruns));
+        }
+    }
+    return;
+}
@@ -0,0 +1,40 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SHM_RING_H_
+#define _STREAMING_CLIENT_SHM_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pipeline.h"
+#include "shm_layout.h"
+
+/* writer side of the shared memory ring: the RX blocks are copied into a
+   POSIX shared memory object that any number of local processes can attach
+   to with the shm_reader library. The writer never waits for the readers:
+   a reader that falls more than num_blocks behind loses blocks (and is told
+   so) */
+
+typedef struct {
+    char name[256];
+    int fd;
+    size_t size;
+    shm_ring_header_t *header;
+    uint8_t *data;
+    uint64_t write_sequence;
+    unsigned long long sample_offset;
+    /* stats */
+    unsigned long long blocks;
+    unsigned long long wakeups;
+} shm_ring_t;
+
+int shm_ring_init(shm_ring_t *this, const char *name, int num_blocks, int block_size, double sample_rate, int samples_per_frame);
+int shm_ring_fini(shm_ring_t *this);
+int shm_ring_publish(shm_ring_t *this, const void *data, int length);
+int shm_ring_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+void shm_ring_stats(shm_ring_t *this);
+
+#endif /* _STREAMING_CLIENT_SHM_RING_H_ */
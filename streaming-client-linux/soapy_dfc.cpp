@@ -0,0 +1,663 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+/* SoapySDR module for the DFC transceiver (driver=dfc), on top of libdfc.h.
+
+   Device arguments:
+     serial     FX3 serial number (default: the first DFC transceiver found)
+     firmware   FX3 firmware image (default: fx3-firmware.img; with serial,
+                the FX3s in DFU mode are flashed only if it is given)
+     mode       SINGLE-ADC (default for RX), DUAL-ADC, SINGLE-ADC-FX3-CLOCK,
+                DAC (default for TX), DAC-FX3-CLOCK
+     reference  reference clock in Hz (default: 27e6)
+     ppm        reference clock correction in ppm (default: 0)
+     backend    hardware (default) or loopback (no hardware: the RX samples
+                are a ramp and the TX samples are discarded)
+     throttle   loopback: run at the sample rate (default: true); with
+                throttle=false the loopback goes as fast as the application
+
+   Stream arguments: packets (per transfer, default: 16) and transfers
+   (default: 16).
+
+   One channel in each direction. The native formats are the ones of the
+   transfer buffers, so they are available with the direct buffer access
+   API (acquireReadBuffer()/acquireWriteBuffer()) without any copy:
+     RX single ADC: S16 (real samples)
+     RX dual ADC:   CS16 (ADC A as I, ADC B as Q - that is how the samples
+                    are interleaved in the transfers)
+     TX:            S16 (14 bit samples; the 2 bit shift for the DAC is done
+                    in place when the buffer is released)
+   F32/CF32 are also available with readStream()/writeStream(). */
+
+#include "libdfc.h"
+
+#include <libusb-1.0/libusb.h>
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <SoapySDR/Registry.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* TX sample conversions from sample_kernels.h (a C only header) */
+extern "C" int sample_kernels_s16_to_dac(const short *samples, short *dac_words, int nsamples);
+extern "C" int sample_kernels_float_to_dac(const float *samples, int stride, short *dac_words, int nsamples);
+
+static const double DEFAULT_SAMPLE_RATE = 32e6;
+static const double DEFAULT_REFERENCE_CLOCK = 27e6;
+static const double MIN_SAMPLE_RATE = 1e6;
+static const double MAX_SAMPLE_RATE = 130e6;
+
+struct dfc_mode_name {
+    const char *name;
+    libdfc_mode_t mode;
+};
+
+static const dfc_mode_name dfc_mode_names[] = {
+    { "SINGLE-ADC", LIBDFC_SINGLE_ADC },
+    { "DUAL-ADC", LIBDFC_DUAL_ADC },
+    { "DAC", LIBDFC_DAC },
+    { "SINGLE-ADC-FX3-CLOCK", LIBDFC_SINGLE_ADC_FX3_CLOCK },
+    { "DAC-FX3-CLOCK", LIBDFC_DAC_FX3_CLOCK }
+};
+
+static bool is_rx_mode(libdfc_mode_t mode)
+{
+    return !(mode == LIBDFC_DAC || mode == LIBDFC_DAC_FX3_CLOCK);
+}
+
+static std::string get_arg(const SoapySDR::Kwargs &args, const std::string &key, const std::string &default_value)
+{
+    auto it = args.find(key);
+    return it != args.end() ? it->second : default_value;
+}
+
+class SoapyDFC : public SoapySDR::Device
+{
+public:
+    SoapyDFC(const SoapySDR::Kwargs &args);
+    ~SoapyDFC(void);
+
+    /* identification */
+    std::string getDriverKey(void) const { return "dfc"; }
+    std::string getHardwareKey(void) const { return loopback ? "DFC (loopback)" : "DFC"; }
+    SoapySDR::Kwargs getHardwareInfo(void) const;
+
+    /* channels */
+    size_t getNumChannels(const int direction) const;
+    bool getFullDuplex(const int, const size_t) const { return false; }
+
+    /* stream API */
+    std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const;
+    std::string getNativeStreamFormat(const int direction, const size_t channel, double &fullScale) const;
+    SoapySDR::ArgInfoList getStreamArgsInfo(const int direction, const size_t channel) const;
+    SoapySDR::Stream *setupStream(const int direction, const std::string &format, const std::vector<size_t> &channels = std::vector<size_t>(), const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+    void closeStream(SoapySDR::Stream *stream);
+    size_t getStreamMTU(SoapySDR::Stream *stream) const;
+    int activateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0, const size_t numElems = 0);
+    int deactivateStream(SoapySDR::Stream *stream, const int flags = 0, const long long timeNs = 0);
+    int readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs = 100000);
+    int writeStream(SoapySDR::Stream *stream, const void * const *buffs, const size_t numElems, int &flags, const long long timeNs = 0, const long timeoutUs = 100000);
+
+    /* direct buffer access */
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream);
+    int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs);
+    int acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs, int &flags, long long &timeNs, const long timeoutUs = 100000);
+    void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle);
+    int acquireWriteBuffer(SoapySDR::Stream *stream, size_t &handle, void **buffs, const long timeoutUs = 100000);
+    void releaseWriteBuffer(SoapySDR::Stream *stream, const size_t handle, const size_t numElems, int &flags, const long long timeNs = 0);
+
+    /* antennas (fixed) */
+    std::vector<std::string> listAntennas(const int direction, const size_t channel) const;
+    std::string getAntenna(const int direction, const size_t channel) const;
+    void setAntenna(const int, const size_t, const std::string &) {}
+
+    /* frequency: direct sampling, no tuner */
+    void setFrequency(const int, const size_t, const double, const SoapySDR::Kwargs & = SoapySDR::Kwargs()) {}
+    double getFrequency(const int, const size_t) const { return 0.0; }
+    SoapySDR::RangeList getFrequencyRange(const int, const size_t) const;
+
+    /* sample rate */
+    void setSampleRate(const int direction, const size_t channel, const double rate);
+    double getSampleRate(const int direction, const size_t channel) const;
+    std::vector<double> listSampleRates(const int direction, const size_t channel) const;
+    SoapySDR::RangeList getSampleRateRange(const int direction, const size_t channel) const;
+
+private:
+    libdfc_mode_t stream_mode(const int direction) const;
+    size_t element_size(void) const;
+    int configure(void);
+    void flush_write_buffer(void);
+
+    libdfc_device_t *device;
+    bool loopback;
+    libdfc_mode_t mode;
+    double sample_rate;
+    double reference_clock;
+    double reference_ppm;
+    mutable std::mutex mutex;
+
+    /* the (only) stream */
+    bool stream_setup;
+    bool stream_active;
+    int stream_direction;
+    std::string stream_format;
+    libdfc_mode_t current_mode;
+    int num_packets;
+    int num_transfers;
+
+    /* readStream()/writeStream(): the buffer being consumed/filled */
+    int buffer_index;
+    short *buffer_samples;
+    size_t buffer_elements;
+    size_t buffer_position;
+};
+
+SoapyDFC::SoapyDFC(const SoapySDR::Kwargs &args) :
+    device(nullptr),
+    loopback(false),
+    mode(LIBDFC_SINGLE_ADC),
+    sample_rate(DEFAULT_SAMPLE_RATE),
+    reference_clock(DEFAULT_REFERENCE_CLOCK),
+    reference_ppm(0.0),
+    stream_setup(false),
+    stream_active(false),
+    stream_direction(SOAPY_SDR_RX),
+    current_mode(LIBDFC_SINGLE_ADC),
+    num_packets(16),
+    num_transfers(16),
+    buffer_index(-1),
+    buffer_samples(nullptr),
+    buffer_elements(0),
+    buffer_position(0)
+{
+    std::string mode_name = get_arg(args, "mode", "SINGLE-ADC");
+    bool found = false;
+    for (const auto &m : dfc_mode_names) {
+        if (mode_name == m.name) {
+            mode = m.mode;
+            found = true;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("SoapyDFC: invalid mode: " + mode_name);
+    }
+    reference_clock = std::stod(get_arg(args, "reference", std::to_string(DEFAULT_REFERENCE_CLOCK)));
+    reference_ppm = std::stod(get_arg(args, "ppm", "0"));
+
+    loopback = get_arg(args, "backend", "hardware") == "loopback";
+    if (loopback) {
+        device = libdfc_open_loopback(get_arg(args, "throttle", "true") != "false");
+    } else {
+        std::string serial_number = get_arg(args, "serial", "");
+        std::string firmware_file = get_arg(args, "firmware", "fx3-firmware.img");
+        if (serial_number.empty()) {
+            device = libdfc_open(firmware_file.c_str());
+        } else {
+            device = libdfc_open_serial(serial_number.c_str(), args.count("firmware") != 0 ? firmware_file.c_str() : nullptr);
+        }
+    }
+    if (device == nullptr) {
+        throw std::runtime_error("SoapyDFC: unable to open the DFC transceiver");
+    }
+}
+
+SoapyDFC::~SoapyDFC(void)
+{
+    if (stream_active) {
+        deactivateStream(reinterpret_cast<SoapySDR::Stream *>(this));
+    }
+    libdfc_close(device);
+}
+
+SoapySDR::Kwargs SoapyDFC::getHardwareInfo(void) const
+{
+    SoapySDR::Kwargs info;
+    info["backend"] = loopback ? "loopback" : "hardware";
+    for (const auto &m : dfc_mode_names) {
+        if (m.mode == mode) {
+            info["mode"] = m.name;
+        }
+    }
+    return info;
+}
+
+size_t SoapyDFC::getNumChannels(const int) const
+{
+    return 1;
+}
+
+std::vector<std::string> SoapyDFC::getStreamFormats(const int direction, const size_t) const
+{
+    if (direction == SOAPY_SDR_RX && stream_mode(direction) == LIBDFC_DUAL_ADC) {
+        return { SOAPY_SDR_CS16, SOAPY_SDR_CF32 };
+    }
+    return { SOAPY_SDR_S16, SOAPY_SDR_F32 };
+}
+
+std::string SoapyDFC::getNativeStreamFormat(const int direction, const size_t, double &fullScale) const
+{
+    if (direction == SOAPY_SDR_TX) {
+        fullScale = 8192;
+        return SOAPY_SDR_S16;
+    }
+    fullScale = 32768;
+    return stream_mode(direction) == LIBDFC_DUAL_ADC ? SOAPY_SDR_CS16 : SOAPY_SDR_S16;
+}
+
+SoapySDR::ArgInfoList SoapyDFC::getStreamArgsInfo(const int, const size_t) const
+{
+    SoapySDR::ArgInfoList args;
+
+    SoapySDR::ArgInfo packets;
+    packets.key = "packets";
+    packets.value = "16";
+    packets.name = "Packets per transfer";
+    packets.description = "Number of USB packets (16kB) in each transfer buffer.";
+    packets.type = SoapySDR::ArgInfo::INT;
+    args.push_back(packets);
+
+    SoapySDR::ArgInfo transfers;
+    transfers.key = "transfers";
+    transfers.value = "16";
+    transfers.name = "Concurrent transfers";
+    transfers.description = "Number of transfer buffers (also the number of direct access buffers).";
+    transfers.type = SoapySDR::ArgInfo::INT;
+    args.push_back(transfers);
+
+    return args;
+}
+
+SoapySDR::Stream *SoapyDFC::setupStream(const int direction, const std::string &format, const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stream_setup) {
+        throw std::runtime_error("SoapyDFC: only one stream at a time (no full-duplex)");
+    }
+    if (channels.size() > 1 || (channels.size() == 1 && channels[0] != 0)) {
+        throw std::runtime_error("SoapyDFC: invalid channel selection");
+    }
+    std::vector<std::string> formats = getStreamFormats(direction, 0);
+    if (std::find(formats.begin(), formats.end(), format) == formats.end()) {
+        throw std::runtime_error("SoapyDFC: invalid stream format: " + format);
+    }
+    num_packets = std::stoi(get_arg(args, "packets", "16"));
+    num_transfers = std::stoi(get_arg(args, "transfers", "16"));
+    if (num_packets <= 0 || num_transfers <= 0) {
+        throw std::runtime_error("SoapyDFC: invalid packets/transfers");
+    }
+    stream_direction = direction;
+    stream_format = format;
+    current_mode = stream_mode(direction);
+    if (configure() == -1) {
+        throw std::runtime_error("SoapyDFC: unable to configure the DFC transceiver");
+    }
+    stream_setup = true;
+    return reinterpret_cast<SoapySDR::Stream *>(this);
+}
+
+void SoapyDFC::closeStream(SoapySDR::Stream *stream)
+{
+    if (stream_active) {
+        deactivateStream(stream);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    stream_setup = false;
+}
+
+size_t SoapyDFC::getStreamMTU(SoapySDR::Stream *) const
+{
+    /* the buffers are allocated by activateStream(); before that, the size
+       they will have with num_packets USB packets each */
+    int buffer_size = stream_active ? libdfc_buffer_size(device) : num_packets * libdfc_packet_size(device);
+    return buffer_size / element_size();
+}
+
+int SoapyDFC::activateStream(SoapySDR::Stream *, const int flags, const long long, const size_t)
+{
+    if (flags != 0) {
+        return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stream_active) {
+        return 0;
+    }
+    if (libdfc_start(device, num_packets, num_transfers) == -1) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    buffer_index = -1;
+    buffer_position = 0;
+    stream_active = true;
+    return 0;
+}
+
+int SoapyDFC::deactivateStream(SoapySDR::Stream *, const int flags, const long long)
+{
+    if (flags != 0) {
+        return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!stream_active) {
+        return 0;
+    }
+    if (buffer_index >= 0) {
+        if (stream_direction == SOAPY_SDR_TX) {
+            flush_write_buffer();
+        } else {
+            libdfc_release_buffer(device, buffer_index, 0);
+            buffer_index = -1;
+        }
+    }
+    stream_active = false;
+    return libdfc_stop(device) == -1 ? SOAPY_SDR_STREAM_ERROR : 0;
+}
+
+int SoapyDFC::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems, int &flags, long long &timeNs, const long timeoutUs)
+{
+    if (stream_direction != SOAPY_SDR_RX) {
+        return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    if (buffer_index < 0) {
+        size_t handle;
+        const void *addrs[1];
+        int ret = acquireReadBuffer(stream, handle, addrs, flags, timeNs, timeoutUs);
+        if (ret < 0) {
+            return ret;
+        }
+        buffer_index = handle;
+        buffer_samples = (short *) addrs[0];
+        buffer_elements = ret;
+        buffer_position = 0;
+    }
+
+    size_t n = std::min(numElems, buffer_elements - buffer_position);
+    const short *in = buffer_samples + buffer_position * (element_size() / sizeof(short));
+    if (stream_format == SOAPY_SDR_S16 || stream_format == SOAPY_SDR_CS16) {
+        std::memcpy(buffs[0], in, n * element_size());
+    } else {
+        /* F32/CF32: scaled to +/-1.0 */
+        float *out = (float *) buffs[0];
+        size_t nvalues = n * (element_size() / sizeof(short));
+        for (size_t i = 0; i < nvalues; i++) {
+            out[i] = in[i] * (1.0f / 32768.0f);
+        }
+    }
+    buffer_position += n;
+    flags = 0;
+    timeNs = 0;
+    if (buffer_position == buffer_elements) {
+        releaseReadBuffer(stream, buffer_index);
+        buffer_index = -1;
+    } else {
+        flags |= SOAPY_SDR_MORE_FRAGMENTS;
+    }
+    return n;
+}
+
+int SoapyDFC::writeStream(SoapySDR::Stream *stream, const void * const *buffs, const size_t numElems, int &flags, const long long, const long timeoutUs)
+{
+    if (stream_direction != SOAPY_SDR_TX) {
+        return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    if (buffer_index < 0) {
+        size_t handle;
+        void *addrs[1];
+        int ret = acquireWriteBuffer(stream, handle, addrs, timeoutUs);
+        if (ret < 0) {
+            return ret;
+        }
+        buffer_index = handle;
+        buffer_samples = (short *) addrs[0];
+        buffer_elements = ret;
+        buffer_position = 0;
+    }
+
+    /* the samples go in already shifted for the DAC */
+    size_t n = std::min(numElems, buffer_elements - buffer_position);
+    short *out = buffer_samples + buffer_position;
+    if (stream_format == SOAPY_SDR_S16) {
+        sample_kernels_s16_to_dac((const short *) buffs[0], out, n);
+    } else {
+        /* F32: +/-1.0 is the full scale of the 14 bit DAC */
+        sample_kernels_float_to_dac((const float *) buffs[0], 1, out, n);
+    }
+    buffer_position += n;
+    if (buffer_position == buffer_elements || (flags & SOAPY_SDR_END_BURST)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        flush_write_buffer();
+    }
+    return n;
+}
+
+size_t SoapyDFC::getNumDirectAccessBuffers(SoapySDR::Stream *)
+{
+    return num_transfers;
+}
+
+int SoapyDFC::getDirectAccessBufferAddrs(SoapySDR::Stream *, const size_t handle, void **buffs)
+{
+    void *buffer = libdfc_buffer(device, handle);
+    if (buffer == nullptr) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    buffs[0] = buffer;
+    return 0;
+}
+
+int SoapyDFC::acquireReadBuffer(SoapySDR::Stream *, size_t &handle, const void **buffs, int &flags, long long &timeNs, const long timeoutUs)
+{
+    if (stream_direction != SOAPY_SDR_RX || !stream_active) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    flags = 0;
+    timeNs = 0;
+    if (libdfc_overflow(device)) {
+        SoapySDR::log(SOAPY_SDR_SSI, "O");
+        return SOAPY_SDR_OVERFLOW;
+    }
+    void *buffer;
+    int length;
+    int index = libdfc_acquire_buffer(device, &buffer, &length, timeoutUs);
+    if (index == LIBDFC_TIMEOUT) {
+        return SOAPY_SDR_TIMEOUT;
+    } else if (index < 0) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    handle = index;
+    buffs[0] = buffer;
+    return length / element_size();
+}
+
+void SoapyDFC::releaseReadBuffer(SoapySDR::Stream *, const size_t handle)
+{
+    libdfc_release_buffer(device, handle, 0);
+}
+
+int SoapyDFC::acquireWriteBuffer(SoapySDR::Stream *, size_t &handle, void **buffs, const long timeoutUs)
+{
+    if (stream_direction != SOAPY_SDR_TX || !stream_active) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    if (libdfc_overflow(device)) {
+        SoapySDR::log(SOAPY_SDR_SSI, "U");
+        return SOAPY_SDR_UNDERFLOW;
+    }
+    void *buffer;
+    int length;
+    int index = libdfc_acquire_buffer(device, &buffer, &length, timeoutUs);
+    if (index == LIBDFC_TIMEOUT) {
+        return SOAPY_SDR_TIMEOUT;
+    } else if (index < 0) {
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    handle = index;
+    buffs[0] = buffer;
+    return length / element_size();
+}
+
+void SoapyDFC::releaseWriteBuffer(SoapySDR::Stream *, const size_t handle, const size_t numElems, int &, const long long)
+{
+    /* saturate and shift in place: the DAC is connected to bits 2:15 */
+    short *samples = (short *) libdfc_buffer(device, handle);
+    if (samples == nullptr) {
+        return;
+    }
+    sample_kernels_s16_to_dac(samples, samples, numElems);
+    libdfc_release_buffer(device, handle, numElems * sizeof(short));
+}
+
+std::vector<std::string> SoapyDFC::listAntennas(const int direction, const size_t) const
+{
+    return { direction == SOAPY_SDR_RX ? "RX" : "TX" };
+}
+
+std::string SoapyDFC::getAntenna(const int direction, const size_t) const
+{
+    return direction == SOAPY_SDR_RX ? "RX" : "TX";
+}
+
+SoapySDR::RangeList SoapyDFC::getFrequencyRange(const int, const size_t) const
+{
+    return { SoapySDR::Range(0.0, 0.0) };
+}
+
+void SoapyDFC::setSampleRate(const int, const size_t, const double rate)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (rate < MIN_SAMPLE_RATE || rate > MAX_SAMPLE_RATE) {
+        throw std::runtime_error("SoapyDFC: sample rate out of range");
+    }
+    if (stream_active) {
+        throw std::runtime_error("SoapyDFC: the sample rate cannot be changed while streaming");
+    }
+    sample_rate = rate;
+    /* the clock is programmed when the stream is set up */
+    if (stream_setup && configure() == -1) {
+        throw std::runtime_error("SoapyDFC: unable to set the sample rate");
+    }
+}
+
+double SoapyDFC::getSampleRate(const int, const size_t) const
+{
+    return sample_rate;
+}
+
+std::vector<double> SoapyDFC::listSampleRates(const int, const size_t) const
+{
+    return { 16e6, 32e6, 64e6, 100e6, 128e6 };
+}
+
+SoapySDR::RangeList SoapyDFC::getSampleRateRange(const int, const size_t) const
+{
+    return { SoapySDR::Range(MIN_SAMPLE_RATE, MAX_SAMPLE_RATE) };
+}
+
+
+/* internal functions */
+
+/* the device mode if it matches the direction, otherwise the default one */
+libdfc_mode_t SoapyDFC::stream_mode(const int direction) const
+{
+    if ((direction == SOAPY_SDR_RX) == is_rx_mode(mode)) {
+        return mode;
+    }
+    return direction == SOAPY_SDR_RX ? LIBDFC_SINGLE_ADC : LIBDFC_DAC;
+}
+
+/* bytes per stream element in the transfer buffers */
+size_t SoapyDFC::element_size(void) const
+{
+    return current_mode == LIBDFC_DUAL_ADC && stream_direction == SOAPY_SDR_RX ? 2 * sizeof(short) : sizeof(short);
+}
+
+int SoapyDFC::configure(void)
+{
+    return libdfc_configure(device, current_mode, sample_rate, reference_clock, reference_ppm);
+}
+
+/* send the (possibly partial) TX buffer; the caller holds the mutex */
+void SoapyDFC::flush_write_buffer(void)
+{
+    if (buffer_index < 0) {
+        return;
+    }
+    libdfc_release_buffer(device, buffer_index, buffer_position * sizeof(short));
+    buffer_index = -1;
+    buffer_position = 0;
+}
+
+
+/* registration */
+static std::string get_serial_number(libusb_device *device, uint8_t iSerialNumber)
+{
+    libusb_device_handle *device_handle;
+    if (iSerialNumber == 0 || libusb_open(device, &device_handle) != LIBUSB_SUCCESS) {
+        return "";
+    }
+    char serial_number[64];
+    int status = libusb_get_string_descriptor_ascii(device_handle, iSerialNumber, (unsigned char *) serial_number, sizeof(serial_number));
+    libusb_close(device_handle);
+    return status > 0 ? serial_number : "";
+}
+
+static SoapySDR::KwargsList find_dfc(const SoapySDR::Kwargs &args)
+{
+    SoapySDR::KwargsList results;
+    /* the loopback backend is only there when asked for */
+    if (get_arg(args, "backend", "hardware") == "loopback") {
+        SoapySDR::Kwargs result = args;
+        result["label"] = "DFC transceiver (loopback)";
+        results.push_back(result);
+        return results;
+    }
+    /* the FX3 is either running the streamer firmware or waiting for it in DFU mode */
+    libusb_context *context;
+    if (libusb_init(&context) != LIBUSB_SUCCESS) {
+        return results;
+    }
+    libusb_device **devices;
+    ssize_t num_devices = libusb_get_device_list(context, &devices);
+    for (ssize_t i = 0; i < num_devices; i++) {
+        struct libusb_device_descriptor descriptor;
+        if (libusb_get_device_descriptor(devices[i], &descriptor) != LIBUSB_SUCCESS) {
+            continue;
+        }
+        if (descriptor.idVendor == 0x04b4 && (descriptor.idProduct == 0x00f1 || descriptor.idProduct == 0x00f3)) {
+            SoapySDR::Kwargs result = args;
+            result["label"] = descriptor.idProduct == 0x00f1 ? "DFC transceiver" : "DFC transceiver (FX3 in DFU mode)";
+            /* the serial number comes from the streamer firmware, so one
+               in DFU mode could still be the one asked for */
+            if (descriptor.idProduct == 0x00f1) {
+                std::string serial_number = get_serial_number(devices[i], descriptor.iSerialNumber);
+                if (args.count("serial") != 0 && serial_number != args.at("serial")) {
+                    continue;
+                }
+                if (!serial_number.empty()) {
+                    result["serial"] = serial_number;
+                    result["label"] += " " + serial_number;
+                }
+            }
+            results.push_back(result);
+        }
+    }
+    if (num_devices >= 0) {
+        libusb_free_device_list(devices, 1);
+    }
+    libusb_exit(context);
+    return results;
+}
+
+static SoapySDR::Device *make_dfc(const SoapySDR::Kwargs &args)
+{
+    return new SoapyDFC(args);
+}
+
+static SoapySDR::Registry register_dfc("dfc", &find_dfc, &make_dfc, SOAPY_SDR_ABI_VERSION);
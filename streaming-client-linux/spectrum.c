@@ -0,0 +1,362 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "spectrum.h"
+#include "io.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float sample_scale = 1.0f / 8192.0f;   /* 14 bit ADC full scale */
+
+/* internal functions */
+static void *spectrum_worker(void *arg);
+static void process_block(spectrum_t *this, const spectrum_block_t *block);
+static void process_segment(spectrum_t *this);
+static void accumulate_fft(spectrum_t *this, const float *real, const float *imag);
+static int emit_frame(spectrum_t *this);
+
+
+int spectrum_init(spectrum_t *this, int fft_size, double overlap, sample_select_t input, unsigned long long interval_samples, spectrum_format_t format, int output_fileno, int queue_depth)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (!(overlap >= 0.0 && overlap < 1.0)) {
+        fprintf(stderr, "spectrum_init - overlap must be in [0,1): %lf\n", overlap);
+        return -1;
+    }
+    if (queue_depth <= 0) {
+        fprintf(stderr, "spectrum_init - invalid queue depth: %d\n", queue_depth);
+        return -1;
+    }
+    if (fft_init(&this->fft, fft_size) == -1) {
+        return -1;
+    }
+
+    this->fft_size = fft_size;
+    this->hop_size = fft_size - (int)(overlap * fft_size);
+    if (this->hop_size <= 0) {
+        this->hop_size = 1;
+    }
+    this->input = input;
+    this->interval_samples = interval_samples > 0 ? interval_samples : 1;
+    this->format = format;
+    this->output_fileno = output_fileno;
+
+    int num_bins = fft_size / 2 + 1;
+    this->window = (float *) malloc(fft_size * sizeof(float));
+    this->segment = (float *) malloc(fft_size * sizeof(float));
+    this->pending = (float *) malloc(fft_size * sizeof(float));
+    this->fft_buffer = (fft_complex_t *) malloc(fft_size * sizeof(fft_complex_t));
+    this->power = (double *) calloc(num_bins, sizeof(double));
+    this->frame_output = (float *) malloc(num_bins * sizeof(float));
+    this->csv_line = (char *) malloc(num_bins * 16 + 128);
+    this->num_blocks = queue_depth;
+    this->blocks = (spectrum_block_t *) calloc(queue_depth, sizeof(spectrum_block_t));
+    if (this->window == NULL || this->segment == NULL || this->pending == NULL || this->fft_buffer == NULL ||
+        this->power == NULL || this->frame_output == NULL || this->csv_line == NULL || this->blocks == NULL) {
+        fprintf(stderr, "spectrum_init - malloc() failed\n");
+        spectrum_fini(this);
+        return -1;
+    }
+
+    /* 4-term Blackman-Harris window */
+    double window_sum = 0.0;
+    for (int i = 0; i < fft_size; i++) {
+        double x = 2.0 * M_PI * i / fft_size;
+        double w = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) - 0.01168 * cos(3.0 * x);
+        this->window[i] = w;
+        window_sum += w;
+    }
+    /* one-sided power, scaled so a full scale sine reads 1.0 (0 dBFS) */
+    this->power_scale = 4.0 / (window_sum * window_sum);
+
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->cond, NULL);
+
+    return 0;
+}
+
+int spectrum_fini(spectrum_t *this)
+{
+    if (this->running) {
+        spectrum_stop(this);
+    }
+    if (this->blocks != NULL) {
+        for (int i = 0; i < this->num_blocks; i++) {
+            free(this->blocks[i].samples);
+        }
+        pthread_cond_destroy(&this->cond);
+        pthread_mutex_destroy(&this->mutex);
+    }
+    free(this->blocks);
+    free(this->csv_line);
+    free(this->frame_output);
+    free(this->power);
+    free(this->fft_buffer);
+    free(this->pending);
+    free(this->segment);
+    free(this->window);
+    this->blocks = NULL;
+    this->csv_line = NULL;
+    this->frame_output = NULL;
+    this->power = NULL;
+    this->fft_buffer = NULL;
+    this->pending = NULL;
+    this->segment = NULL;
+    this->window = NULL;
+    fft_fini(&this->fft);
+    return 0;
+}
+
+int spectrum_start(spectrum_t *this)
+{
+    this->stop = false;
+    int status = pthread_create(&this->worker, NULL, spectrum_worker, this);
+    if (status != 0) {
+        fprintf(stderr, "spectrum_start - pthread_create() failed: %s\n", strerror(status));
+        return -1;
+    }
+    this->running = true;
+    return 0;
+}
+
+int spectrum_stop(spectrum_t *this)
+{
+    if (!this->running) {
+        return 0;
+    }
+    pthread_mutex_lock(&this->mutex);
+    this->stop = true;
+    pthread_cond_signal(&this->cond);
+    pthread_mutex_unlock(&this->mutex);
+    pthread_join(this->worker, NULL);
+    this->running = false;
+
+    /* write out the last (partial) frame */
+    if (this->num_averages > 0 || this->has_pending) {
+        if (emit_frame(this) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* called from the USB callback: never waits for the worker */
+void spectrum_submit(spectrum_t *this, const short *samples, int nsamples)
+{
+    int stride = this->input == SAMPLE_SELECT_ALL ? 1 : 2;
+    unsigned long long sample_offset = this->input_samples / stride;
+    this->input_samples += nsamples;
+
+    pthread_mutex_lock(&this->mutex);
+    bool full = this->queue_count == this->num_blocks;
+    int slot = (this->queue_head + this->queue_count) % this->num_blocks;
+    pthread_mutex_unlock(&this->mutex);
+    if (full) {
+        this->blocks_skipped++;
+        return;
+    }
+
+    /* the slot is not visible to the worker until queue_count is incremented */
+    spectrum_block_t *block = &this->blocks[slot];
+    if (nsamples > block->capacity) {
+        short *buffer = (short *) realloc(block->samples, nsamples * sizeof(short));
+        if (buffer == NULL) {
+            this->blocks_skipped++;
+            return;
+        }
+        block->samples = buffer;
+        block->capacity = nsamples;
+    }
+    memcpy(block->samples, samples, nsamples * sizeof(short));
+    block->nsamples = nsamples;
+    block->sample_offset = sample_offset;
+    clock_gettime(CLOCK_REALTIME, &block->timestamp);
+
+    pthread_mutex_lock(&this->mutex);
+    this->queue_count++;
+    pthread_cond_signal(&this->cond);
+    pthread_mutex_unlock(&this->mutex);
+    return;
+}
+
+void spectrum_stats(spectrum_t *this)
+{
+    fprintf(stderr, "spectrum: %llu blocks processed, %llu blocks skipped, %llu frames\n", this->blocks_processed, this->blocks_skipped, this->frames);
+    return;
+}
+
+
+/* internal functions */
+static void *spectrum_worker(void *arg)
+{
+    spectrum_t *this = (spectrum_t *) arg;
+
+    while (true) {
+        pthread_mutex_lock(&this->mutex);
+        while (this->queue_count == 0 && !this->stop) {
+            pthread_cond_wait(&this->cond, &this->mutex);
+        }
+        if (this->queue_count == 0) {
+            pthread_mutex_unlock(&this->mutex);
+            break;
+        }
+        spectrum_block_t *block = &this->blocks[this->queue_head];
+        pthread_mutex_unlock(&this->mutex);
+
+        process_block(this, block);
+        this->blocks_processed++;
+
+        pthread_mutex_lock(&this->mutex);
+        this->queue_head = (this->queue_head + 1) % this->num_blocks;
+        this->queue_count--;
+        pthread_mutex_unlock(&this->mutex);
+    }
+
+    return NULL;
+}
+
+static void process_block(spectrum_t *this, const spectrum_block_t *block)
+{
+    int start = this->input == SAMPLE_SELECT_ODD ? 1 : 0;
+    int stride = this->input == SAMPLE_SELECT_ALL ? 1 : 2;
+
+    /* skipped blocks break the overlap with the previous segment */
+    if (block->sample_offset != this->next_offset) {
+        this->segment_fill = 0;
+    }
+    this->next_offset = block->sample_offset + (block->nsamples - start + stride - 1) / stride;
+
+    if (!this->frame_started) {
+        this->frame_started = true;
+        this->frame_offset = block->sample_offset;
+        this->frame_timestamp = block->timestamp;
+    }
+
+    unsigned long long offset = block->sample_offset;
+    for (int i = start; i < block->nsamples; ) {
+        int n = this->fft_size - this->segment_fill;
+        int available = (block->nsamples - i + stride - 1) / stride;
+        if (n > available) {
+            n = available;
+        }
+        float *segment = this->segment + this->segment_fill;
+        const short *samples = block->samples + i;
+        for (int j = 0; j < n; j++) {
+            segment[j] = samples[j * stride] * sample_scale;
+        }
+        this->segment_fill += n;
+        i += n * stride;
+        offset += n;
+
+        if (this->segment_fill == this->fft_size) {
+            process_segment(this);
+            int keep = this->fft_size - this->hop_size;
+            memmove(this->segment, this->segment + this->hop_size, keep * sizeof(float));
+            this->segment_fill = keep;
+
+            if (offset - this->frame_offset >= this->interval_samples) {
+                emit_frame(this);
+                this->frame_offset = offset;
+                this->frame_timestamp = block->timestamp;
+            }
+        }
+    }
+
+    return;
+}
+
+/* window the segment; segments are paired so two real FFTs are computed
+   with a single complex FFT */
+static void process_segment(spectrum_t *this)
+{
+    if (!this->has_pending) {
+        for (int i = 0; i < this->fft_size; i++) {
+            this->pending[i] = this->segment[i] * this->window[i];
+        }
+        this->has_pending = true;
+        return;
+    }
+
+    accumulate_fft(this, this->pending, this->segment);
+    this->has_pending = false;
+    return;
+}
+
+/* power of FFT(real) + power of FFT(imag), with the imaginary part
+   windowed here (imag may be NULL) */
+static void accumulate_fft(spectrum_t *this, const float *real, const float *imag)
+{
+    int fft_size = this->fft_size;
+    fft_complex_t *x = this->fft_buffer;
+
+    for (int i = 0; i < fft_size; i++) {
+        x[i].re = real[i];
+        x[i].im = imag != NULL ? imag[i] * this->window[i] : 0.0f;
+    }
+    fft_forward(&this->fft, x);
+
+    /* for z = a + j b: |A[k]|^2 + |B[k]|^2 = (|Z[k]|^2 + |Z[N-k]|^2) / 2 */
+    double *power = this->power;
+    for (int k = 0; k <= fft_size / 2; k++) {
+        int nk = (fft_size - k) & (fft_size - 1);
+        double p = (double) x[k].re * x[k].re + (double) x[k].im * x[k].im;
+        double pn = (double) x[nk].re * x[nk].re + (double) x[nk].im * x[nk].im;
+        power[k] += imag != NULL ? 0.5 * (p + pn) : p;
+    }
+    this->num_averages += imag != NULL ? 2 : 1;
+    return;
+}
+
+static int emit_frame(spectrum_t *this)
+{
+    if (this->has_pending) {
+        accumulate_fft(this, this->pending, NULL);
+        this->has_pending = false;
+    }
+    if (this->num_averages == 0) {
+        return 0;
+    }
+
+    int num_bins = this->fft_size / 2 + 1;
+    double scale = this->power_scale / this->num_averages;
+    for (int k = 0; k < num_bins; k++) {
+        this->frame_output[k] = this->power[k] * scale;
+        this->power[k] = 0.0;
+    }
+    double timestamp = this->frame_timestamp.tv_sec + 1e-9 * this->frame_timestamp.tv_nsec;
+
+    int status = 0;
+    if (this->format == SPECTRUM_FORMAT_BINARY) {
+        spectrum_frame_header_t header;
+        memcpy(header.magic, "DFCS", sizeof(header.magic));
+        header.fft_size = this->fft_size;
+        header.num_bins = num_bins;
+        header.num_averages = this->num_averages;
+        header.sample_offset = this->frame_offset;
+        header.timestamp = timestamp;
+        status = io_write_all(this->output_fileno, &header, sizeof(header));
+        if (status == 0) {
+            status = io_write_all(this->output_fileno, this->frame_output, num_bins * sizeof(float));
+        }
+    } else {
+        /* timestamp,sample_offset,num_averages,power[0] (dBFS),...,power[N/2] */
+        char *p = this->csv_line;
+        p += sprintf(p, "%.6f,%llu,%u", timestamp, this->frame_offset, this->num_averages);
+        for (int k = 0; k < num_bins; k++) {
+            p += sprintf(p, ",%.2f", 10.0 * log10(this->frame_output[k] + 1e-20));
+        }
+        *p++ = '\n';
+        status = io_write_all(this->output_fileno, this->csv_line, p - this->csv_line);
+    }
+
+    this->num_averages = 0;
+    this->frames++;
+    return status;
+}
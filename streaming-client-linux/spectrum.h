@@ -0,0 +1,95 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SPECTRUM_H_
+#define _STREAMING_CLIENT_SPECTRUM_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "fft.h"
+#include "types.h"
+
+/* Welch spectrum estimator: windowed (Blackman-Harris), overlapped FFTs of
+   the RX stream are computed on a worker thread and their power is averaged
+   over a fixed number of samples; every interval an averaged spectrum frame
+   is written to the output file (fft_size/2+1 bins, from DC to fs/2).
+   Blocks are handed to the worker through a small queue; when the queue is
+   full the block is skipped (and accounted for), so the USB side never waits */
+
+typedef enum {
+    SPECTRUM_FORMAT_BINARY,
+    SPECTRUM_FORMAT_CSV
+} spectrum_format_t;
+
+/* binary frame: this header followed by num_bins float32 power values
+   (linear, full scale sine = 1.0) */
+typedef struct {
+    char magic[4];                  /* "DFCS" */
+    uint32_t fft_size;
+    uint32_t num_bins;
+    uint32_t num_averages;
+    uint64_t sample_offset;         /* first sample in the averaging interval */
+    double timestamp;               /* host time (s since the epoch) */
+} spectrum_frame_header_t;
+
+typedef struct {
+    short *samples;
+    int nsamples;
+    int capacity;
+    unsigned long long sample_offset;
+    struct timespec timestamp;
+} spectrum_block_t;
+
+typedef struct {
+    int fft_size;
+    int hop_size;
+    sample_select_t input;
+    unsigned long long interval_samples;
+    spectrum_format_t format;
+    int output_fileno;
+    fft_t fft;
+    float *window;
+    float power_scale;
+    float *segment;                 /* input samples for the current segment */
+    int segment_fill;
+    float *pending;                 /* windowed segment waiting to be paired */
+    bool has_pending;
+    fft_complex_t *fft_buffer;
+    double *power;                  /* power accumulator for the current frame */
+    uint32_t num_averages;
+    unsigned long long frame_offset;
+    struct timespec frame_timestamp;
+    bool frame_started;
+    unsigned long long next_offset; /* expected offset of the next block */
+    float *frame_output;
+    char *csv_line;
+    /* block queue between the USB callback and the worker */
+    int num_blocks;
+    spectrum_block_t *blocks;
+    int queue_head;
+    int queue_count;
+    bool stop;
+    pthread_t worker;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+    /* stats */
+    unsigned long long input_samples;
+    unsigned long long blocks_processed;
+    unsigned long long blocks_skipped;
+    unsigned long long frames;
+} spectrum_t;
+
+int spectrum_init(spectrum_t *this, int fft_size, double overlap, sample_select_t input, unsigned long long interval_samples, spectrum_format_t format, int output_fileno, int queue_depth);
+int spectrum_fini(spectrum_t *this);
+int spectrum_start(spectrum_t *this);
+int spectrum_stop(spectrum_t *this);
+void spectrum_submit(spectrum_t *this, const short *samples, int nsamples);
+void spectrum_stats(spectrum_t *this);
+
+#endif /* _STREAMING_CLIENT_SPECTRUM_H_ */
@@ -0,0 +1,225 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "squelch.h"
+#include "io.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const double full_scale = 8192.0;   /* 14 bit ADC full scale */
+
+/* internal functions */
+static long long sum_squares(const short *samples, int n, int stride);
+static int start_burst(squelch_t *this, unsigned long long window_start);
+static int end_burst(squelch_t *this);
+static int write_span(squelch_t *this, const short *samples, int start, int end);
+static int write_held(squelch_t *this);
+
+
+int squelch_init(squelch_t *this, double threshold_dbfs, sample_select_t input, int window_samples, int hang_samples, int pad_samples, int output_fileno, FILE *index_file)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (window_samples <= 0 || hang_samples < 0 || pad_samples < 0) {
+        fprintf(stderr, "squelch_init - invalid window/hang/pad samples: %d/%d/%d\n", window_samples, hang_samples, pad_samples);
+        return -1;
+    }
+
+    this->input = input;
+    this->stride = input == SAMPLE_SELECT_ALL ? 1 : 2;
+    this->window_samples = window_samples * this->stride;
+    this->hang_samples = (hang_samples + pad_samples) * this->stride;
+    this->pad_samples = pad_samples * this->stride;
+    /* mean square relative to full scale, times the window length */
+    this->threshold_energy = llrint(full_scale * full_scale * pow(10.0, threshold_dbfs / 10.0) * window_samples);
+    this->output_fileno = output_fileno;
+    this->index_file = index_file;
+
+    /* an active window may start in the previous block */
+    if (history_init(&this->history, this->pad_samples + this->window_samples) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int squelch_fini(squelch_t *this)
+{
+    if (this->recording) {
+        end_burst(this);
+    }
+    history_fini(&this->history);
+    return 0;
+}
+
+int squelch_process(squelch_t *this, const short *samples, int nsamples)
+{
+    int channel_offset = this->input == SAMPLE_SELECT_ODD ? 1 : 0;
+    int span_start = this->recording ? 0 : -1;
+
+    int i = 0;
+    while (i < nsamples) {
+        int n = this->window_samples - this->window_fill;
+        if (n > nsamples - i) {
+            n = nsamples - i;
+        }
+        this->window_energy += sum_squares(samples + i + channel_offset, n / this->stride, this->stride);
+        this->window_fill += n;
+        i += n;
+        if (this->window_fill < this->window_samples) {
+            break;
+        }
+
+        bool active = this->window_energy >= this->threshold_energy;
+        this->window_energy = 0;
+        this->window_fill = 0;
+
+        if (!this->recording) {
+            if (active) {
+                unsigned long long window_start = this->stream_offset + i - this->window_samples;
+                if (start_burst(this, window_start) == -1) {
+                    return -1;
+                }
+                span_start = this->burst_start > this->stream_offset ? this->burst_start - this->stream_offset : 0;
+            }
+        } else {
+            if (active) {
+                if (write_held(this) == -1) {
+                    return -1;
+                }
+                this->burst_end = this->stream_offset + i + this->hang_samples;
+            } else if (this->stream_offset + i > this->burst_end) {
+                /* the burst ends hang_samples after the last active window
+                   (nothing past burst_end has been written) */
+                long long end = (long long) this->burst_end - (long long) this->stream_offset;
+                if (end > span_start && write_span(this, samples, span_start, (int) end) == -1) {
+                    return -1;
+                }
+                span_start = -1;
+                if (end_burst(this) == -1) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    if (span_start >= 0) {
+        /* the samples past burst_end are held back (in the history) until
+           the next window tells if the burst goes on */
+        long long end = (long long) this->burst_end - (long long) this->stream_offset;
+        if (end > nsamples) {
+            end = nsamples;
+        }
+        if (end > span_start && write_span(this, samples, span_start, (int) end) == -1) {
+            return -1;
+        }
+    }
+
+    history_update(&this->history, samples, nsamples);
+    this->stream_offset += nsamples;
+    return 0;
+}
+
+void squelch_stats(squelch_t *this)
+{
+    fprintf(stderr, "squelch bursts: %u\n", this->bursts);
+    fprintf(stderr, "squelch samples written: %llu\n", this->written_samples);
+    return;
+}
+
+
+/* internal functions */
+
+static inline long long sum_squares_stride(const short *samples, int n, int stride)
+{
+    long long sum = 0;
+    for (int j = 0; j < n; j++) {
+        int x = samples[j * stride];
+        sum += x * x;
+    }
+    return sum;
+}
+
+static long long sum_squares(const short *samples, int n, int stride)
+{
+    return stride == 1 ? sum_squares_stride(samples, n, 1) : sum_squares_stride(samples, n, 2);
+}
+
+static int start_burst(squelch_t *this, unsigned long long window_start)
+{
+    unsigned long long start = window_start > (unsigned long long) this->pad_samples ? window_start - this->pad_samples : 0;
+    if (start < this->written_end) {
+        start = this->written_end;
+    }
+    if (start < history_start_offset(&this->history)) {
+        start = history_start_offset(&this->history);
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    this->recording = true;
+    this->burst_start = start;
+    this->burst_end = window_start + this->window_samples + this->hang_samples;
+    this->burst_file_offset = this->written_samples;
+    this->burst_timestamp = now.tv_sec + 1e-9 * now.tv_nsec;
+    this->bursts++;
+
+    if (start < this->stream_offset) {
+        int n = history_write(&this->history, this->output_fileno, start);
+        if (n == -1) {
+            return -1;
+        }
+        this->written_samples += n;
+        this->written_end = this->stream_offset;
+    }
+    return 0;
+}
+
+static int end_burst(squelch_t *this)
+{
+    this->recording = false;
+    if (this->index_file != NULL) {
+        fprintf(this->index_file, "%u,%llu,%llu,%llu,%.6f\n", this->bursts,
+                this->burst_start / this->stride, this->burst_file_offset / this->stride,
+                (this->written_samples - this->burst_file_offset) / this->stride,
+                this->burst_timestamp);
+        fflush(this->index_file);
+    }
+    return 0;
+}
+
+static int write_span(squelch_t *this, const short *samples, int start, int end)
+{
+    if (end <= start) {
+        return 0;
+    }
+    if (io_write_all(this->output_fileno, samples + start, (end - start) * sizeof(short)) == -1) {
+        return -1;
+    }
+    this->written_samples += end - start;
+    this->written_end = this->stream_offset + end;
+    return 0;
+}
+
+/* writes the samples of the burst held back at the end of the previous
+   blocks, when an active window shows that the burst goes on */
+static int write_held(squelch_t *this)
+{
+    unsigned long long start = this->written_end > this->burst_start ? this->written_end : this->burst_start;
+    if (start >= this->stream_offset) {
+        return 0;
+    }
+    int n = history_write(&this->history, this->output_fileno, start);
+    if (n == -1) {
+        return -1;
+    }
+    this->written_samples += n;
+    this->written_end = this->stream_offset;
+    return 0;
+}
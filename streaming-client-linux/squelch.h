@@ -0,0 +1,52 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_SQUELCH_H_
+#define _STREAMING_CLIENT_SQUELCH_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "history.h"
+#include "types.h"
+
+/* squelch (burst) recording: the mean power of the selected channel is
+   computed over short windows and only the windows above the threshold are
+   written, plus pad_samples before each burst and hang_samples + pad_samples
+   after it (sample counts are per channel; in DUAL-ADC mode both channels are
+   written, still interleaved); each burst is described by a line in the
+   index file:
+       burst number,stream sample offset,output file sample offset,length,host timestamp */
+
+typedef struct {
+    long long threshold_energy;         /* sum of squares over a window */
+    sample_select_t input;
+    int stride;
+    int window_samples;                 /* raw samples */
+    int hang_samples;                   /* raw samples (including post padding) */
+    int pad_samples;                    /* raw samples */
+    int output_fileno;
+    FILE *index_file;
+    history_t history;
+    long long window_energy;
+    int window_fill;
+    bool recording;
+    unsigned long long burst_end;       /* raw offset where the burst ends without another active window */
+    unsigned long long stream_offset;   /* raw samples before the current block */
+    unsigned long long written_end;     /* raw offset after the last sample written */
+    unsigned long long burst_start;     /* raw offset of the current burst */
+    unsigned long long burst_file_offset;
+    double burst_timestamp;
+    /* stats */
+    unsigned int bursts;
+    unsigned long long written_samples;
+} squelch_t;
+
+int squelch_init(squelch_t *this, double threshold_dbfs, sample_select_t input, int window_samples, int hang_samples, int pad_samples, int output_fileno, FILE *index_file);
+int squelch_fini(squelch_t *this);
+int squelch_process(squelch_t *this, const short *samples, int nsamples);
+void squelch_stats(squelch_t *this);
+
+#endif /* _STREAMING_CLIENT_SQUELCH_H_ */
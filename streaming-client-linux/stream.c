@@ -5,8 +5,10 @@
 //
 
 #include "stream.h"
+#include "io.h"
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -17,25 +19,48 @@
 static const unsigned int timeout = 5000;  /* timeout (in ms) for each transfer */
 
 static atomic_int active_transfers;
-static bool stop_transfers = false;
+static atomic_bool stop_transfers = false;
 /* stream stats */
 /* TODO: move them to their own structure inside a stream structure */
 static unsigned int success_count = 0;         // number of successful transfers
 static unsigned int failure_count = 0;         // number of failed transfers
 static unsigned long long transfer_size = 0;   // total size of data transfers
-static short sample_even_min = SHRT_MAX;       // minimum even sample value
-static short sample_even_max = SHRT_MIN;       // maximum even sample value
-static short sample_odd_min = SHRT_MAX;        // minimum odd sample value
-static short sample_odd_max = SHRT_MIN;        // maximum odd sample value
+static sample_range_t sample_range = { { SHRT_MAX, SHRT_MAX }, { SHRT_MIN, SHRT_MIN } };   // sample range of each channel
+static unsigned long long live_transfer_size = 0;  // total size at the last live stats
+static double live_elapsed = 0;                    // elapsed time at the last live stats
+static unsigned int gap_count = 0;             // number of gaps (runs of dropped blocks)
+static unsigned long long gap_samples = 0;     // samples lost in the gaps
 
 static const int SIXTEEN_BITS_SIZE = 65536;
-static unsigned long long *histogram_even = NULL;   // histogram for even samples
-static unsigned long long *histogram_odd = NULL;    // histogram for odd samples
+static unsigned long long *histograms[2] = { NULL, NULL };  // histogram for each channel (even/odd samples in DUAL-ADC mode)
 
-static uint8_t *read_buffer = NULL;
+static pthread_t rx_consumer;                  // RX ring consumer thread
+static pthread_t tx_reader;                    // TX ring reader thread
+static uint8_t *gap_buffer = NULL;             // zeros for the gap fill
+static unsigned long long pipeline_offset = 0; // samples sent down the RX pipeline
+static pthread_t event_handler;                // libusb event handling thread
+static atomic_bool stop_events = false;
 
 
+/* per-block results of the block independent stages */
+typedef struct {
+    unsigned int clipped[2];
+    sample_range_t range;
+} stream_rx_block_result_t;
+
 static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer) ;
+static void *stream_rx_consumer(void *arg);
+static void *stream_tx_reader(void *arg);
+static void *stream_event_handler(void *arg);
+static void stream_direct_put(stream_t *this, struct libusb_transfer *transfer);
+static void stream_direct_queue(stream_t *this, int index);
+static int stream_rx_process(void *context, uint8_t *buffer, int length, void *result);
+static int stream_rx_release(void *context, uint8_t *buffer, int length, void *result);
+static int stream_build_pipeline(stream_t *this);
+static void stream_reset_stats(void);
+static int stream_spectrum_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+static int stream_channelizer_stage(pipeline_stage_t *stage, pipeline_block_t *block);
+static int stream_output_stage(pipeline_stage_t *stage, pipeline_block_t *block);
 
 
 int stream_init(stream_t *this, stream_direction_t direction, int read_write_fileno, usb_device_t *usb_device, int num_packets_per_transfer, int num_concurrent_transfers, bool show_histogram)
@@ -46,6 +71,40 @@ int stream_init(stream_t *this, stream_direction_t direction, int read_write_fil
     this->num_packets_per_transfer = num_packets_per_transfer;
     this->num_concurrent_transfers = num_concurrent_transfers;
     this->transfer_size = num_packets_per_transfer * usb_device->packet_size;
+    this->channelizer = NULL;
+    this->spectrum = NULL;
+    this->trigger = NULL;
+    this->squelch = NULL;
+    this->overload = NULL;
+    this->correction = NULL;
+    this->rate_estimator = NULL;
+    this->rx_ring = NULL;
+    this->tx_ring = NULL;
+    this->tx_loop = NULL;
+    this->generator = NULL;
+    this->tx_converter = NULL;
+    this->worker_pool = NULL;
+    this->output_queue_depth = 0;
+    pipeline_stage_init(&this->pipeline, "rx", NULL, NULL);
+    pipeline_stage_init(&this->output_stage, "output", stream_output_stage, this);
+    this->gap_log = NULL;
+    this->gap_fill = false;
+    this->max_samples = 0;
+    this->num_samples = 0;
+    this->direct = false;
+    this->event_thread = false;
+    this->direct_head = 0;
+    this->direct_count = 0;
+    this->direct_overflow = false;
+    this->direct_overflows = 0;
+    this->direct_queue = (int *) malloc(num_concurrent_transfers * sizeof(int));
+    this->direct_callback = NULL;
+    this->direct_context = NULL;
+    /* DUAL-ADC keeps the even and odd samples apart, whatever the RX mode */
+    this->layout = direction == STREAM_RX ? SAMPLE_LAYOUT_DUAL_ADC : SAMPLE_LAYOUT_DAC;
+    sample_kernels_init(&this->kernels, this->layout);
+    pthread_mutex_init(&this->direct_mutex, NULL);
+    pthread_cond_init(&this->direct_ready, NULL);
 
     /* allocate transfer buffers for zerocopy USB bulk transfers */
     this->buffers = (uint8_t **)malloc(num_concurrent_transfers * sizeof(uint8_t *));
@@ -60,11 +119,6 @@ int stream_init(stream_t *this, stream_direction_t direction, int read_write_fil
         }
     }
 
-    /* allocate read buffer if direction is STREAM_TX */
-    if (direction == STREAM_TX) {
-        read_buffer = (uint8_t *)malloc(this->transfer_size);
-    }
-
     /* populate the required libusb_transfer fields */
     this->transfers = (struct libusb_transfer **)malloc(num_concurrent_transfers * sizeof(struct libusb_transfer *));
     for (int i = 0; i < num_concurrent_transfers; i++) {
@@ -80,13 +134,8 @@ int stream_init(stream_t *this, stream_direction_t direction, int read_write_fil
     }
 
     if (show_histogram) {
-        histogram_even = (unsigned long long *) malloc(SIXTEEN_BITS_SIZE * sizeof(unsigned long long));
-        histogram_odd = (unsigned long long *) malloc(SIXTEEN_BITS_SIZE * sizeof(unsigned long long));
-        for (int i = 0; i < SIXTEEN_BITS_SIZE; i++) {
-            histogram_even[i] = 0;
-        }   
-        for (int i = 0; i < SIXTEEN_BITS_SIZE; i++) {
-            histogram_odd[i] = 0;
+        for (int c = 0; c < 2; c++) {
+            histograms[c] = (unsigned long long *) calloc(SIXTEEN_BITS_SIZE, sizeof(unsigned long long));
         }
     }
 
@@ -109,26 +158,111 @@ int stream_fini(stream_t *this)
         free(this->buffers);
     }
 
-    if (histogram_even != NULL) {
-        free(histogram_even);
-    }
-    if (histogram_odd != NULL) {
-        free(histogram_odd);
+    for (int c = 0; c < 2; c++) {
+        free(histograms[c]);
+        histograms[c] = NULL;
     }
 
-    if (read_buffer != NULL) {
-        free(read_buffer);
+    if (gap_buffer != NULL) {
+        free(gap_buffer);
+        gap_buffer = NULL;
     }
 
+    pipeline_stage_fini(&this->output_stage);
+
+    free(this->direct_queue);
+    this->direct_queue = NULL;
+    pthread_cond_destroy(&this->direct_ready);
+    pthread_mutex_destroy(&this->direct_mutex);
+
+    return 0;
+}
+
+/* process the RX blocks on num_workers threads (see stream_rx_process()) */
+int stream_init_worker_pool(stream_t *this, worker_pool_t *worker_pool, int num_workers)
+{
+    if (this->direction != STREAM_RX) {
+        fprintf(stderr, "stream_init_worker_pool - the worker pool is only for RX streams\n");
+        return -1;
+    }
+    int num_slots = 4 * num_workers;
+    if (num_slots < this->num_concurrent_transfers) {
+        num_slots = this->num_concurrent_transfers;
+    }
+    if (worker_pool_init(worker_pool, num_workers, num_slots, this->transfer_size, sizeof(stream_rx_block_result_t), stream_rx_process, stream_rx_release, this) == -1) {
+        return -1;
+    }
+    this->worker_pool = worker_pool;
     return 0;
 }
 
 int stream_start(stream_t *this)
 {
+    /* the loops for the sample layout of this DFC mode */
+    if (sample_kernels_init(&this->kernels, this->layout) == -1) {
+        return -1;
+    }
+
+    /* a restarted stream (libdfc_stop()/libdfc_start()) starts over */
+    stream_reset_stats();
+
     /* submit all the transfers */
     stop_transfers = false;
     atomic_init(&active_transfers, 0);
+
+    if (this->direction == STREAM_RX) {
+        if (stream_build_pipeline(this) == -1) {
+            return -1;
+        }
+        if (pipeline_start(&this->pipeline) == -1) {
+            return -1;
+        }
+    }
+
+    if (this->direction == STREAM_RX && this->worker_pool != NULL) {
+        if (worker_pool_start(this->worker_pool) == -1) {
+            return -1;
+        }
+    }
+
+    /* with the RX ring the samples are processed by a consumer thread */
+    if (this->direction == STREAM_RX && this->rx_ring != NULL) {
+        if (this->gap_fill && gap_buffer == NULL) {
+            gap_buffer = (uint8_t *) malloc(this->transfer_size);
+            if (gap_buffer == NULL) {
+                fprintf(stderr, "stream_start - malloc() failed\n");
+                return -1;
+            }
+        }
+        int status = pthread_create(&rx_consumer, NULL, stream_rx_consumer, this);
+        if (status != 0) {
+            fprintf(stderr, "stream_start - pthread_create() failed: %s\n", strerror(status));
+            return -1;
+        }
+    }
+
+    /* with the TX ring the samples are read by a thread of their own, which
+       fills the ring before the first transfer is sent */
+    if (this->direction == STREAM_TX && this->tx_ring != NULL) {
+        int status = pthread_create(&tx_reader, NULL, stream_tx_reader, this);
+        if (status != 0) {
+            fprintf(stderr, "stream_start - pthread_create() failed: %s\n", strerror(status));
+            this->tx_ring = NULL;
+            return -1;
+        }
+        tx_ring_wait_full(this->tx_ring, 5.0);
+    }
+
+    this->direct_head = 0;
+    this->direct_count = 0;
+    this->direct_overflow = false;
+
     for (int i = 0; i < this->num_concurrent_transfers; i++) {
+        if (this->direct && this->direction == STREAM_TX) {
+            /* TX direct access: the user fills the buffers first */
+            stream_direct_put(this, this->transfers[i]);
+            continue;
+        }
         int status = libusb_submit_transfer(this->transfers[i]);
         if (status != LIBUSB_SUCCESS) {
             fprintf(stderr, "stream_start - error in libusb_submit_transfer(): %s\n", libusb_strerror(status));
@@ -137,6 +271,16 @@ int stream_start(stream_t *this)
         atomic_fetch_add(&active_transfers, 1);
     }
 
+    if (this->event_thread) {
+        stop_events = false;
+        int status = pthread_create(&event_handler, NULL, stream_event_handler, this);
+        if (status != 0) {
+            fprintf(stderr, "stream_start - pthread_create() failed: %s\n", strerror(status));
+            this->event_thread = false;
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -166,79 +310,266 @@ int stream_stop(stream_t *this)
     }
 #endif
     while (active_transfers > 0) {
-        libusb_handle_events(NULL);
+        if (!this->event_thread) {
+            libusb_handle_events(NULL);
+        }
         usleep(100);
     }
+    if (this->event_thread) {
+        stop_events = true;
+        pthread_join(event_handler, NULL);
+    }
+
+    /* wake up the users waiting for a buffer */
+    if (this->direct) {
+        pthread_mutex_lock(&this->direct_mutex);
+        pthread_cond_broadcast(&this->direct_ready);
+        pthread_mutex_unlock(&this->direct_mutex);
+    }
+
+    /* stop the TX ring reader (it may be waiting for the producer in read()) */
+    if (this->direction == STREAM_TX && this->tx_ring != NULL) {
+        tx_ring_close(this->tx_ring);
+        pthread_cancel(tx_reader);
+        pthread_join(tx_reader, NULL);
+    }
+
+    /* let the consumer thread process what is left in the RX ring */
+    if (this->direction == STREAM_RX && this->rx_ring != NULL) {
+        rx_ring_close(this->rx_ring);
+        pthread_join(rx_consumer, NULL);
+    }
+
+    /* wait for the blocks still in the worker pool */
+    if (this->direction == STREAM_RX && this->worker_pool != NULL) {
+        if (worker_pool_stop(this->worker_pool) == -1) {
+            ok = false;
+        }
+    }
+
+    /* and for those still queued in the pipeline stages */
+    if (this->direction == STREAM_RX) {
+        if (pipeline_stop(&this->pipeline) == -1) {
+            ok = false;
+        }
+    }
 
     return ok ? 0 : - 1;
 }
 
+/* true once the stream has ended on its own (sample count reached, EOF, errors) */
+bool stream_done(__attribute__ ((unused)) stream_t *this)
+{
+    return stop_transfers;
+}
+
 void stream_stats(stream_t *this, double elapsed)
 {
     fprintf(stderr, "success count: %u\n", success_count);
     fprintf(stderr, "failure count: %u\n", failure_count);
     fprintf(stderr, "transfer size: %llu B\n", transfer_size);
     fprintf(stderr, "transfer rate: %.0lf kB/s\n", (double) transfer_size / elapsed / 1024.0);
+    if (this->rate_estimator != NULL) {
+        rate_estimator_stats(this->rate_estimator);
+    }
+    if (this->direct) {
+        fprintf(stderr, "%s: %llu\n", this->direction == STREAM_RX ? "overflows" : "underflows", this->direct_overflows);
+    }
+    if (this->direction == STREAM_TX && this->tx_ring != NULL) {
+        tx_ring_stats(this->tx_ring);
+    }
+    if (this->direction == STREAM_TX && this->tx_loop != NULL) {
+        tx_loop_stats(this->tx_loop);
+    }
+    if (this->direction == STREAM_TX && this->tx_converter != NULL) {
+        tx_converter_stats(this->tx_converter);
+    }
     if (this->direction == STREAM_RX) {
-        fprintf(stderr, "even samples range: [%hd,%hd]\n", sample_even_min, sample_even_max);
-        fprintf(stderr, "odd samples range: [%hd,%hd]\n", sample_odd_min, sample_odd_max);
+        fprintf(stderr, "samples: %llu\n", this->num_samples);
+        if (this->kernels.num_channels == 1) {
+            fprintf(stderr, "samples range: [%hd,%hd]\n", sample_range.min[0], sample_range.max[0]);
+        } else {
+            fprintf(stderr, "even samples range: [%hd,%hd]\n", sample_range.min[0], sample_range.max[0]);
+            fprintf(stderr, "odd samples range: [%hd,%hd]\n", sample_range.min[1], sample_range.max[1]);
+        }
+        if (this->overload != NULL) {
+            overload_stats(this->overload);
+        }
+        if (this->correction != NULL) {
+            correction_stats(this->correction);
+        }
+        if (this->worker_pool != NULL) {
+            worker_pool_stats(this->worker_pool);
+        }
+        pipeline_stats(&this->pipeline);
+        if (this->rx_ring != NULL) {
+            rx_ring_stats(this->rx_ring);
+            fprintf(stderr, "gaps: %u (%llu samples)%s\n", gap_count, gap_samples, this->gap_fill ? " - filled with zeros" : "");
+        }
 
-        if (histogram_even != NULL) {
+        for (int c = 0; c < this->kernels.num_channels && histograms[c] != NULL; c++) {
+            unsigned long long *histogram = histograms[c];
+            /* DUAL-ADC: channel 0 is the even samples, channel 1 the odd ones */
+            const char *title = this->kernels.num_channels == 1 ? "Samples" : c == 0 ? "Even samples" : "Odd samples";
+            const char *name = this->kernels.num_channels == 1 ? "" : c == 0 ? "even " : "odd ";
             int histogram_min = -1;
             int histogram_max = -1;
             unsigned long long total_histogram_samples = 0;
             for (int i = 0; i < SIXTEEN_BITS_SIZE; i++) {
-                if (histogram_even[i] > 0) {
+                if (histogram[i] > 0) {
                     if (histogram_min < 0) {
                         histogram_min = i;
                     }
                     histogram_max = i;
-                    total_histogram_samples += histogram_even[i];
+                    total_histogram_samples += histogram[i];
                 }
             }
             if (total_histogram_samples > 0) {
-                fprintf(stdout, "# Even samples histogram\n");
+                fprintf(stdout, "# %s histogram\n", title);
                 for (int i = histogram_min; i <= histogram_max; i++) {
                     fprintf(stdout, "%d\t%llu\n", i - SIXTEEN_BITS_SIZE / 2,
-                            histogram_even[i]);
+                            histogram[i]);
                 }
                 fprintf(stdout, "\n");
             }
-            fprintf(stderr, "total even histogram samples: %llu\n", total_histogram_samples);
+            fprintf(stderr, "total %shistogram samples: %llu\n", name, total_histogram_samples);
         }
 
-        if (histogram_odd != NULL) {
-            int histogram_min = -1;
-            int histogram_max = -1;
-            unsigned long long total_histogram_samples = 0;
-            for (int i = 0; i < SIXTEEN_BITS_SIZE; i++) {
-                if (histogram_odd[i] > 0) {
-                    if (histogram_min < 0) {
-                        histogram_min = i;
-                    }
-                    histogram_max = i;
-                    total_histogram_samples += histogram_odd[i];
-                }
-            }
-            if (total_histogram_samples > 0) {
-                fprintf(stdout, "# Odd samples histogram\n");
-                for (int i = histogram_min; i <= histogram_max; i++) {
-                    fprintf(stdout, "%d\t%llu\n", i - SIXTEEN_BITS_SIZE / 2,
-                            histogram_odd[i]);
-                }
-                fprintf(stdout, "\n");
-            }
-            fprintf(stderr, "total odd histogram samples: %llu\n", total_histogram_samples);
+        if (this->channelizer != NULL) {
+            channelizer_stats(this->channelizer);
+        }
+        if (this->spectrum != NULL) {
+            spectrum_stats(this->spectrum);
+        }
+        if (this->trigger != NULL) {
+            trigger_stats(this->trigger);
+        }
+        if (this->squelch != NULL) {
+            squelch_stats(this->squelch);
         }
     }
 
     return;
 }
 
+/* one line progress report, called periodically while streaming */
+void stream_live_stats(stream_t *this, double elapsed)
+{
+    double rate = elapsed > live_elapsed ? (double) (transfer_size - live_transfer_size) / (elapsed - live_elapsed) / 1024.0 : 0.0;
+    fprintf(stderr, "[%.1fs] %u transfers (%u failed) - %.0lf kB/s", elapsed, success_count, failure_count, rate);
+    if (this->direction == STREAM_RX && this->overload != NULL) {
+        fprintf(stderr, " - clip rate: %.3g%%%s", 100.0 * overload_clip_rate(this->overload), this->overload->overloaded ? " OVERLOAD" : "");
+    }
+    double estimated_rate;
+    double ppm;
+    if (this->rate_estimator != NULL && rate_estimator_estimate(this->rate_estimator, &estimated_rate, &ppm) == 0) {
+        fprintf(stderr, " - sample rate: %.1lf Hz (%+.2lf ppm)", estimated_rate, ppm);
+    }
+    if (this->direction == STREAM_RX && this->rx_ring != NULL) {
+        fprintf(stderr, " - dropped: %llu blocks", this->rx_ring->blocks_dropped);
+    }
+    if (this->direction == STREAM_TX && this->tx_ring != NULL) {
+        fprintf(stderr, " - underruns: %llu", this->tx_ring->underruns);
+    }
+    if (this->direction == STREAM_TX && this->tx_loop != NULL) {
+        fprintf(stderr, " - loops: %llu", this->tx_loop->loops);
+    }
+    if (this->direction == STREAM_TX && this->tx_converter != NULL) {
+        fprintf(stderr, " - clipped: %llu", this->tx_converter->clipped);
+    }
+    fprintf(stderr, "\n");
+    live_transfer_size = transfer_size;
+    live_elapsed = elapsed;
+    return;
+}
+
+/* direct buffer access (see stream.h) */
+int stream_acquire_buffer(stream_t *this, uint8_t **buffer, int *length, long timeout_us)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&this->direct_mutex);
+    while (this->direct_count == 0) {
+        if (stop_transfers) {
+            pthread_mutex_unlock(&this->direct_mutex);
+            return -1;
+        }
+        if (pthread_cond_timedwait(&this->direct_ready, &this->direct_mutex, &deadline) == ETIMEDOUT) {
+            if (this->direct_count > 0) {
+                break;
+            }
+            pthread_mutex_unlock(&this->direct_mutex);
+            return STREAM_TIMEOUT;
+        }
+    }
+    int index = this->direct_queue[this->direct_head];
+    this->direct_head = (this->direct_head + 1) % this->num_concurrent_transfers;
+    this->direct_count--;
+    pthread_mutex_unlock(&this->direct_mutex);
+
+    struct libusb_transfer *transfer = this->transfers[index];
+    *buffer = transfer->buffer;
+    *length = this->direction == STREAM_RX ? transfer->actual_length : this->transfer_size;
+    return index;
+}
+
+int stream_release_buffer(stream_t *this, int index, int length)
+{
+    if (index < 0 || index >= this->num_concurrent_transfers) {
+        fprintf(stderr, "stream_release_buffer - invalid buffer index: %d\n", index);
+        return -1;
+    }
+    if (stop_transfers) {
+        return 0;
+    }
+    if (this->direction == STREAM_TX && length == 0) {
+        /* nothing to send: the buffer is free again */
+        stream_direct_queue(this, index);
+        return 0;
+    }
+    struct libusb_transfer *transfer = this->transfers[index];
+    /* nothing in flight: the FX3 had nowhere to put the RX samples, or
+       nothing to send to the DAC (once TX has started) */
+    if (active_transfers == 0 && (this->direction == STREAM_RX || transfer_size > 0)) {
+        this->direct_overflow = true;
+        this->direct_overflows++;
+    }
+    if (this->direction == STREAM_TX) {
+        transfer->length = length;
+        transfer_size += length;
+    }
+    int status = libusb_submit_transfer(transfer);
+    if (status != LIBUSB_SUCCESS) {
+        fprintf(stderr, "stream_release_buffer - error in libusb_submit_transfer(): %s\n", libusb_strerror(status));
+        return -1;
+    }
+    atomic_fetch_add(&active_transfers, 1);
+    return 0;
+}
+
+/* direct access: true (once) if samples were lost (RX) or the DAC ran out
+   of samples (TX) since the last call */
+bool stream_overflow(stream_t *this)
+{
+    bool overflow = this->direct_overflow;
+    this->direct_overflow = false;
+    return overflow;
+}
+
 
 /* internal functions */
 static int stream_rx_callback(stream_t *this, uint8_t *buffer, int length);
+static int stream_rx_gap(stream_t *this, unsigned long long stream_offset, unsigned long long length, const struct timespec *timestamp);
 static int stream_tx_callback(stream_t *this, uint8_t *buffer, int length);
+static int stream_tx_fill(stream_t *this, uint8_t *buffer, int length);
+static int stream_tx_read(stream_t *this, uint8_t *buffer, int length);
 
 static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer) 
 {
@@ -248,9 +579,23 @@ static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer)
         /* success!!! */
         success_count++;
         stream_t *stream = (stream_t *)transfer->user_data;
+        if (stream->rate_estimator != NULL) {
+            rate_estimator_update(stream->rate_estimator, transfer->actual_length / sizeof(short));
+        }
+        if (stream->direct) {
+            /* the user gets the buffer and resubmits it when done */
+            if (stream->direction == STREAM_RX) {
+                stream->num_samples += transfer->actual_length / sizeof(short);
+                transfer_size += transfer->actual_length;
+            }
+            stream_direct_put(stream, transfer);
+            return;
+        }
         switch (stream->direction) {
         case STREAM_RX:
-            if (stream_rx_callback(stream, transfer->buffer, transfer->actual_length) == -1) {
+            if (stream->rx_ring != NULL) {
+                rx_ring_put(stream->rx_ring, transfer->buffer, transfer->actual_length);
+            } else if (stream_rx_callback(stream, transfer->buffer, transfer->actual_length) == -1) {
                 stop_transfers = true;
             }
             break;
@@ -274,6 +619,17 @@ static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer)
     } else {
         failure_count++;
         fprintf(stderr, "transfer_callback - error in transfer->status: %s\n", libusb_error_name(transfer->status));
+        stream_t *stream = (stream_t *)transfer->user_data;
+        if (stream->direct && !stop_transfers) {
+            /* keep the buffer in circulation */
+            if (stream->direction == STREAM_RX) {
+                if (libusb_submit_transfer(transfer) == LIBUSB_SUCCESS) {
+                    atomic_fetch_add(&active_transfers, 1);
+                }
+            } else {
+                stream_direct_put(stream, transfer);
+            }
+        }
 
 #if 0
         /* cancel all the active transfers */
@@ -294,43 +650,91 @@ static void LIBUSB_CALL transfer_callback(struct libusb_transfer *transfer)
 
 static int stream_rx_callback(stream_t *this, uint8_t *buffer, int length)
 {
-    transfer_size += length;
     short *samples = (short *)buffer;
     int nsamples = length / sizeof(samples[0]);
-    for (int i = 0; i < nsamples; i++) {
-        if (i % 2 == 0) {
-            sample_even_min = samples[i] < sample_even_min ? samples[i] : sample_even_min;
-            sample_even_max = samples[i] > sample_even_max ? samples[i] : sample_even_max;
-        } else {
-            sample_odd_min = samples[i] < sample_odd_min ? samples[i] : sample_odd_min;
-            sample_odd_max = samples[i] > sample_odd_max ? samples[i] : sample_odd_max;
+
+    /* trim the last transfer to the exact number of samples requested */
+    if (this->max_samples > 0) {
+        if (this->num_samples >= this->max_samples) {
+            return 0;
+        }
+        if ((unsigned long long) nsamples >= this->max_samples - this->num_samples) {
+            nsamples = this->max_samples - this->num_samples;
+            length = nsamples * sizeof(samples[0]);
+            stop_transfers = true;
         }
     }
+    this->num_samples += nsamples;
+    transfer_size += length;
 
-    if (histogram_even != NULL) {
-        for (int i = 0; i < nsamples; i += 2) {
-            histogram_even[samples[i] + SIXTEEN_BITS_SIZE / 2]++;
-        }
+    /* with the worker pool the block is processed in parallel with the
+       following ones, and released to the rest of the chain in order */
+    if (this->worker_pool != NULL) {
+        return worker_pool_submit(this->worker_pool, buffer, length);
     }
-    if (histogram_odd != NULL) {
-        for (int i = 1; i < nsamples; i += 2) {
-            histogram_odd[samples[i] + SIXTEEN_BITS_SIZE / 2]++;
-        }
+
+    stream_rx_block_result_t result;
+    if (stream_rx_process(this, buffer, length, &result) == -1) {
+        return -1;
     }
+    return stream_rx_release(this, buffer, length, &result);
+}
 
-    if (this->read_write_fileno >= 0) {
-        size_t remaining = length;
-        while (remaining > 0) {
-            ssize_t written = write(this->read_write_fileno, buffer + (length - remaining), remaining);
-            if (written == -1) {
-                fprintf(stderr, "write to output file failed - error: %s\n", strerror(errno));
-                /* if there's any error stop writing to output file */
-                this->read_write_fileno = -1;
-                break;
-            } else {
-                remaining -= written;
-            }
-        }
+/* block independent stages: they only look at the block itself */
+static int stream_rx_process(void *context, uint8_t *buffer, int length, void *result)
+{
+    stream_t *this = (stream_t *) context;
+    stream_rx_block_result_t *block_result = (stream_rx_block_result_t *) result;
+    short *samples = (short *)buffer;
+    int nsamples = length / sizeof(samples[0]);
+
+    /* overload detection looks at the raw samples */
+    if (this->overload != NULL) {
+        overload_count(this->overload, samples, nsamples, block_result->clipped);
+    }
+
+    /* DC offset and gain correction (in place) before anything else */
+    if (this->correction != NULL && !this->correction->calibrating) {
+        correction_process(this->correction, samples, nsamples);
+    }
+
+    this->kernels.range(samples, nsamples, &block_result->range);
+
+    return 0;
+}
+
+/* stages that depend on the previous blocks: they see the blocks in order */
+static int stream_rx_release(void *context, uint8_t *buffer, int length, void *result)
+{
+    stream_t *this = (stream_t *) context;
+    const stream_rx_block_result_t *block_result = (const stream_rx_block_result_t *) result;
+    short *samples = (short *)buffer;
+    int nsamples = length / sizeof(samples[0]);
+
+    if (this->overload != NULL) {
+        overload_update(this->overload, block_result->clipped, nsamples);
+    }
+
+    /* the DC offsets are measured on the raw samples */
+    if (this->correction != NULL && this->correction->calibrating) {
+        correction_measure(this->correction, samples, nsamples);
+    }
+
+    sample_range_merge(&sample_range, &block_result->range);
+
+    if (histograms[0] != NULL) {
+        this->kernels.histogram(samples, nsamples, histograms);
+    }
+
+    /* the rest of the processing is done by the stages of the pipeline */
+    pipeline_block_t block = {
+        .samples = samples,
+        .nsamples = nsamples,
+        .sample_offset = pipeline_offset
+    };
+    pipeline_offset += nsamples;
+    if (pipeline_emit(&this->pipeline, &block) == -1) {
+        return -1;
     }
 
 #ifdef _BUFFER_INDEX_CHECK_
@@ -362,38 +766,301 @@ static int stream_rx_callback(stream_t *this, uint8_t *buffer, int length)
     return 0;
 }
 
+/* the built-in stages of the RX pipeline; other sinks (e.g. a monitor
+   stream) can be connected to stream->pipeline before stream_start() */
+/* the stats, the gap counters and the pipeline offset are per run */
+static void stream_reset_stats(void)
+{
+    success_count = 0;
+    failure_count = 0;
+    transfer_size = 0;
+    sample_range_reset(&sample_range);
+    live_transfer_size = 0;
+    live_elapsed = 0;
+    gap_count = 0;
+    gap_samples = 0;
+    pipeline_offset = 0;
+    for (int c = 0; c < 2; c++) {
+        if (histograms[c] != NULL) {
+            memset(histograms[c], 0, SIXTEEN_BITS_SIZE * sizeof(unsigned long long));
+        }
+    }
+    return;
+}
+
+static int stream_build_pipeline(stream_t *this)
+{
+    if (this->spectrum != NULL) {
+        pipeline_stage_init(&this->spectrum_stage, "spectrum", stream_spectrum_stage, this->spectrum);
+        if (pipeline_connect(&this->pipeline, &this->spectrum_stage) == -1) {
+            return -1;
+        }
+    }
+    if (this->channelizer != NULL) {
+        pipeline_stage_init(&this->channelizer_stage, "channelizer", stream_channelizer_stage, this->channelizer);
+        if (pipeline_connect(&this->pipeline, &this->channelizer_stage) == -1) {
+            return -1;
+        }
+    }
+    if (this->trigger != NULL || this->squelch != NULL || this->read_write_fileno >= 0) {
+        if (this->output_queue_depth > 0) {
+            if (pipeline_stage_set_worker(&this->output_stage, this->output_queue_depth, this->transfer_size / sizeof(short), false) == -1) {
+                return -1;
+            }
+        }
+        if (pipeline_connect(&this->pipeline, &this->output_stage) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int stream_spectrum_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    /* the spectrum estimator has its own worker and queue */
+    spectrum_submit((spectrum_t *) stage->context, block->samples, block->nsamples);
+    return 0;
+}
+
+static int stream_channelizer_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    return channelizer_process((channelizer_t *) stage->context, block->samples, block->nsamples);
+}
+
+/* the output file: everything, or what the trigger or the squelch let through */
+static int stream_output_stage(pipeline_stage_t *stage, pipeline_block_t *block)
+{
+    stream_t *this = (stream_t *) stage->context;
+    if (this->trigger != NULL) {
+        if (trigger_process(this->trigger, block->samples, block->nsamples) == -1) {
+            return -1;
+        }
+        if (this->trigger->state == TRIGGER_DONE) {
+            /* single shot capture is complete */
+            stop_transfers = true;
+        }
+    } else if (this->squelch != NULL) {
+        if (squelch_process(this->squelch, block->samples, block->nsamples) == -1) {
+            return -1;
+        }
+    } else if (this->read_write_fileno >= 0) {
+        if (io_write_all(this->read_write_fileno, block->samples, block->nsamples * sizeof(short)) == -1) {
+            /* if there's any error stop writing to output file */
+            this->read_write_fileno = -1;
+        }
+    }
+    return 0;
+}
+
+static void *stream_event_handler(void *arg __attribute__((unused)))
+{
+    while (!stop_events) {
+        struct timeval timeout = { 0, 100000 };
+        libusb_handle_events_timeout_completed(NULL, &timeout, NULL);
+    }
+    return NULL;
+}
+
+/* direct access: the transfer is ready for the user */
+static void stream_direct_put(stream_t *this, struct libusb_transfer *transfer)
+{
+    int index = 0;
+    while (this->transfers[index] != transfer) {
+        index++;
+    }
+    if (this->direct_callback != NULL) {
+        int length = this->direct_callback(this->direct_context, transfer->buffer, this->direction == STREAM_RX ? transfer->actual_length : this->transfer_size);
+        if (length == STREAM_HOLD) {
+            return;
+        }
+        if (length < 0) {
+            stop_transfers = true;
+            return;
+        }
+        if (this->direction == STREAM_TX && length == 0) {
+            return;
+        }
+        stream_release_buffer(this, index, length);
+        return;
+    }
+    stream_direct_queue(this, index);
+    return;
+}
+
+static void stream_direct_queue(stream_t *this, int index)
+{
+    pthread_mutex_lock(&this->direct_mutex);
+    this->direct_queue[(this->direct_head + this->direct_count) % this->num_concurrent_transfers] = index;
+    this->direct_count++;
+    pthread_cond_signal(&this->direct_ready);
+    pthread_mutex_unlock(&this->direct_mutex);
+    return;
+}
+
+static void *stream_rx_consumer(void *arg)
+{
+    stream_t *this = (stream_t *) arg;
+    unsigned long long expected_offset = 0;
+    rx_ring_block_t *block;
+    while ((block = rx_ring_get(this->rx_ring)) != NULL) {
+        int status = 0;
+        if (block->sample_offset != expected_offset) {
+            status = stream_rx_gap(this, expected_offset, block->sample_offset - expected_offset, &block->timestamp);
+        }
+        if (status == 0) {
+            status = stream_rx_callback(this, block->data, block->length);
+        }
+        expected_offset = block->sample_offset + block->length / sizeof(short);
+        if (status == -1) {
+            stop_transfers = true;
+            /* make sure the USB callback never waits for us */
+            rx_ring_close(this->rx_ring);
+            return NULL;
+        }
+    }
+
+    /* blocks dropped at the very end (the ring is closed, so no more puts) */
+    if (this->rx_ring->next_offset > expected_offset) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        stream_rx_gap(this, expected_offset, this->rx_ring->next_offset - expected_offset, &now);
+    }
+    return NULL;
+}
+
+/* dropped samples: record a gap marker and, if requested, replace them with
+   zeros so the output stays aligned with the stream */
+static int stream_rx_gap(stream_t *this, unsigned long long stream_offset, unsigned long long length, const struct timespec *timestamp)
+{
+    gap_count++;
+    gap_samples += length;
+    if (this->gap_log != NULL) {
+        fprintf(this->gap_log, "gap,%llu,%llu,%llu,%.6lf\n", stream_offset, this->num_samples, length,
+                timestamp->tv_sec + 1e-9 * timestamp->tv_nsec);
+        fflush(this->gap_log);
+    }
+    if (this->gap_fill) {
+        int max_samples = this->transfer_size / sizeof(short);
+        while (length > 0) {
+            int nsamples = length < (unsigned long long) max_samples ? (int) length : max_samples;
+            /* zeroed every time, since the correction works in place */
+            memset(gap_buffer, 0, nsamples * sizeof(short));
+            if (stream_rx_callback(this, gap_buffer, nsamples * sizeof(short)) == -1) {
+                return -1;
+            }
+            length -= nsamples;
+        }
+    }
+    return 0;
+}
+
 static int stream_tx_callback(stream_t *this, uint8_t *buffer, int length)
 {
     short *samples = (short *)buffer;
-    int nsamples __attribute__ ((unused)) = length / sizeof(samples[0]);
 
+    if (this->generator != NULL) {
+        /* one period of the waveform (already shifted) after the other */
+        int nsamples = length / sizeof(samples[0]);
+        waveform_fill(this->generator, samples, nsamples);
+        transfer_size += nsamples * sizeof(samples[0]);
+        return 0;
+    }
+
+    if (this->tx_loop != NULL) {
+        /* the samples are ready (and shifted) in memory */
+        int nbytes = tx_loop_get(this->tx_loop, buffer, length);
+        if (nbytes == -1) {
+            return -1;
+        }
+        transfer_size += nbytes;
+        return 0;
+    }
+
+    if (this->tx_ring != NULL) {
+        /* the samples are ready (and shifted) in the ring */
+        int nbytes = tx_ring_get(this->tx_ring, buffer, length);
+        if (nbytes == -1) {
+            return -1;
+        }
+        transfer_size += nbytes;
+        return 0;
+    }
+
+    if (stream_tx_fill(this, buffer, length) == -1) {
+        return -1;
+    }
+
+    int nsamples = length / sizeof(samples[0]);
+    transfer_size += nsamples * sizeof(samples[0]);
+
+    return 0;
+}
+
+/* fills a whole block with DAC words from the input file/stdin (-1 on
+   errors and on EOF) */
+static int stream_tx_fill(stream_t *this, uint8_t *buffer, int length)
+{
+    short *samples = (short *)buffer;
+    int nsamples = length / sizeof(samples[0]);
+
+    if (this->tx_converter != NULL) {
+        /* read into the input buffer of the converter, and convert */
+        if (stream_tx_read(this, this->tx_converter->input, tx_converter_input_length(this->tx_converter, nsamples)) == -1) {
+            return -1;
+        }
+        tx_converter_process(this->tx_converter, samples, nsamples);
+        return 0;
+    }
+
+    /* read straight into the transfer buffer */
+    if (stream_tx_read(this, buffer, length) == -1) {
+        return -1;
+    }
+
+    /* shift the values by 2 bits (in place) because the DAC is comnnected to bits 2:15 */
+    sample_kernels_to_dac(samples, nsamples);
+    return 0;
+}
+
+/* reads a whole block from the input file/stdin (-1 on errors and on EOF) */
+static int stream_tx_read(stream_t *this, uint8_t *buffer, int length)
+{
     size_t remaining = length;
     while (remaining > 0) {
-        ssize_t nread = read(this->read_write_fileno, read_buffer + (length - remaining), remaining);
+        /* the TX ring reader can only be cancelled while it waits here */
+        int cancel_state;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &cancel_state);
+        ssize_t nread = read(this->read_write_fileno, buffer + (length - remaining), remaining);
+        pthread_setcancelstate(cancel_state, NULL);
         if (nread == -1) {
             fprintf(stderr, "read from input file/stdin failed - error: %s\n", strerror(errno));
             /* if there's any error stop reading from input file */
             this->read_write_fileno = -1;
             return -1;
-            break;
         } else if (nread == 0) {
             /* EOF - send a message and exit */
             fprintf(stderr, "EOF from input file/stdin. Done streaming\n");
             return -1;
-            break;
         } else {
             remaining -= nread;
         }
     }
+    return 0;
+}
 
-    /* shift the values by 2 bits because the DAC is comnnected to bits 2:15 */
-    short *read_samples = (short *)read_buffer;
-    int nread_samples = (length - remaining) / sizeof(read_samples[0]);
-    for (int i = 0; i < nread_samples; i++) {
-        samples[i] = read_samples[i] << 2;
+/* TX ring: keeps the ring full of blocks ready to be sent */
+static void *stream_tx_reader(void *arg)
+{
+    stream_t *this = (stream_t *) arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    uint8_t *block;
+    while ((block = tx_ring_reserve(this->tx_ring)) != NULL) {
+        if (stream_tx_fill(this, block, this->transfer_size) == -1) {
+            break;
+        }
+        tx_ring_commit(this->tx_ring);
     }
-
-    transfer_size += nread_samples * sizeof(read_samples[0]);
-
-    return 0;
+    /* EOF: the USB callback ends the stream once the ring is empty */
+    tx_ring_close(this->tx_ring);
+    return NULL;
 }
@@ -7,9 +7,26 @@
 #ifndef _STREAMING_CLIENT_STREAM_H_
 #define _STREAMING_CLIENT_STREAM_H_
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include "channelizer.h"
+#include "correction.h"
+#include "overload.h"
+#include "pipeline.h"
+#include "rate_estimator.h"
+#include "rx_ring.h"
+#include "sample_kernels.h"
+#include "spectrum.h"
+#include "squelch.h"
+#include "trigger.h"
+#include "tx_converter.h"
+#include "tx_loop.h"
+#include "tx_ring.h"
 #include "types.h"
 #include "usb.h"
+#include "waveform.h"
+#include "worker_pool.h"
 
 typedef struct {
     usb_device_t *usb_device;
@@ -20,12 +37,74 @@ typedef struct {
     int transfer_size;
     uint8_t **buffers;
     struct libusb_transfer **transfers;
+    channelizer_t *channelizer;   /* optional (RX only) */
+    spectrum_t *spectrum;         /* optional (RX only) */
+    trigger_t *trigger;           /* optional (RX only) - gates the output file */
+    squelch_t *squelch;           /* optional (RX only) - gates the output file */
+    overload_t *overload;         /* optional (RX only) */
+    correction_t *correction;     /* optional (RX only) */
+    rate_estimator_t *rate_estimator;   /* optional */
+    rx_ring_t *rx_ring;           /* optional (RX only) - process the samples on their own thread */
+    FILE *gap_log;                /* RX ring: where the gaps (dropped blocks) are recorded */
+    bool gap_fill;                /* RX ring: replace the dropped blocks with zeros */
+    worker_pool_t *worker_pool;   /* optional (RX only) - see stream_init_worker_pool() */
+    tx_ring_t *tx_ring;           /* optional (TX only) - read the samples on their own thread */
+    tx_loop_t *tx_loop;           /* optional (TX only) - play the input file from memory, over and over */
+    waveform_t *generator;        /* optional (TX only) - in process signal generator (samples already shifted for the DAC) */
+    tx_converter_t *tx_converter; /* optional (TX only) - input format other than s16, or interpolation */
+    int output_queue_depth;       /* RX: > 0 to write the output file on its own thread */
+    pipeline_stage_t pipeline;    /* RX: root of the processing pipeline */
+    pipeline_stage_t spectrum_stage;
+    pipeline_stage_t channelizer_stage;
+    pipeline_stage_t output_stage;
+    unsigned long long max_samples;   /* RX: stop after this many samples (0 = no limit) */
+    unsigned long long num_samples;   /* RX: samples received so far */
+    sample_layout_t layout;       /* from the DFC mode (default: DUAL-ADC for RX, DAC for TX) */
+    sample_kernels_t kernels;     /* the loops for that layout, picked by stream_start() */
+    bool direct;                  /* direct access to the transfer buffers (see stream_acquire_buffer()) */
+    bool event_thread;            /* handle the libusb events on a thread of its own (library use) */
+    /* direct access: indexes of the transfers that are ready for the user */
+    int *direct_queue;
+    int direct_head;
+    int direct_count;
+    bool direct_overflow;         /* all the buffers were held by the user at some point */
+    unsigned long long direct_overflows;
+    pthread_mutex_t direct_mutex;
+    pthread_cond_t direct_ready;
+    /* direct access with a callback instead of the queue */
+    int (*direct_callback)(void *context, uint8_t *buffer, int length);
+    void *direct_context;
 } stream_t;
 
+/* direct buffer access: with stream->direct set before stream_start() the
+   transfers are not processed nor refilled by the stream; instead
+   stream_acquire_buffer() hands out the next transfer buffer (RX: with the
+   samples just received, TX: free to be filled), and stream_release_buffer()
+   gives it back (RX: resubmitted, TX: submitted with the given length, or
+   free again if the length is 0).
+   stream_acquire_buffer() returns the buffer index, STREAM_TIMEOUT, or -1
+   once the stream is stopped.
+   With stream->direct_callback set as well, each buffer goes to the callback
+   as soon as it is ready (on the thread handling the libusb events) and is
+   given back right after: RX: the callback returns 0, or -1 to end the
+   stream; TX: it fills the buffer and returns the number of bytes to send
+   (0: none, that buffer is out of circulation; -1: end the stream).
+   Or the callback returns STREAM_HOLD to keep the buffer, and gives it back
+   later with stream_release_buffer() */
+
+#define STREAM_TIMEOUT -2
+#define STREAM_HOLD -3
+
 int stream_init(stream_t *this, stream_direction_t direction, int read_write_fileno, usb_device_t *usb_device, int num_packets_per_transfer, int num_concurrent_transfers, bool show_histogram);
 int stream_fini(stream_t *this);
+int stream_init_worker_pool(stream_t *this, worker_pool_t *worker_pool, int num_workers);
 int stream_start(stream_t *this);
 int stream_stop(stream_t *this);
+bool stream_done(stream_t *this);
 void stream_stats(stream_t *this, double elapsed);
+void stream_live_stats(stream_t *this, double elapsed);
+int stream_acquire_buffer(stream_t *this, uint8_t **buffer, int *length, long timeout_us);
+int stream_release_buffer(stream_t *this, int index, int length);
+bool stream_overflow(stream_t *this);
 
 #endif /* _STREAMING_CLIENT_STREAM_H_ */
@@ -4,11 +4,16 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 //
 
+#include "decimator.h"
 #include "dfc.h"
+#include "io.h"
+#include "net_server.h"
+#include "shm_ring.h"
 #include "stream.h"
 
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <stdbool.h>
@@ -18,19 +23,11 @@
 #include <string.h>
 #include <unistd.h>
 
-typedef enum {
-    UART_ONLY,
-    SINGLE_ADC,
-    DUAL_ADC,
-    DAC,
-    SINGLE_ADC_FX3_CLOCK,
-    DAC_FX3_CLOCK,
-    DFC_MODE_UNKNOWN = -1
-} dfc_mode_t;
-
 volatile bool stop_transfers = false;  /* request to stop data transfers */
 
 static void sig_stop(int signum);
+static int parse_int_list(const char *list, int *values, int max_values);
+static int parse_sample_select(const char *select);
 
 
 int main(int argc, char *argv[])
@@ -48,12 +45,193 @@ int main(int argc, char *argv[])
     unsigned int reqsize = 16;
     unsigned int queuedepth = 16;
     unsigned int duration = 100;  /* duration of the test in seconds */
+    bool duration_set = false;
+    unsigned long long num_samples = 0;  /* RX: number of samples to capture (0 = no limit) */
     bool show_histogram = false;
     int write_fileno = -1;
     int read_fileno = -1;
+    int channelizer_channels = 0;
+    int channelizer_oversample = 1;
+    int channelizer_selected[1024];
+    int channelizer_num_selected = 0;
+    const char *channelizer_output = "channel";
+    int channelizer_input = -1;
+    int spectrum_size = 0;
+    double spectrum_overlap = 0.5;
+    double spectrum_interval = 1.0;
+    const char *spectrum_output = "-";
+    spectrum_format_t spectrum_format = SPECTRUM_FORMAT_CSV;
+    int spectrum_input = -1;
+    int spectrum_queue_depth = 4;
+    bool trigger_enabled = false;
+    trigger_type_t trigger_type = TRIGGER_RISING;
+    int trigger_threshold = 0;
+    int trigger_input = -1;
+    int trigger_pre = 1024;
+    int trigger_post = 4096;
+    bool trigger_rearm = false;
+    int trigger_holdoff = 0;
+    const char *output_file = NULL;
+    bool squelch_enabled = false;
+    double squelch_threshold = 0;
+    int squelch_input = -1;
+    int squelch_window = 256;
+    double squelch_hang = 0.01;
+    int squelch_pad = 1024;
+    const char *squelch_index = NULL;
+    int overload_margin = -1;
+    const char *overload_log = NULL;
+    double stats_interval = 0;
+    bool calibrate = false;
+    bool correct = false;
+    double dc_offset[2] = { 0, 0 };
+    bool dc_offset_set = false;
+    double gain[2] = { 1, 1 };
+    bool gain_set = false;
+    const char *calibration_file = NULL;
+    int rx_ring_blocks = 0;
+    rx_ring_policy_t rx_ring_policy = RX_RING_BLOCK;
+    const char *rx_gap_log = NULL;
+    bool rx_gap_fill = false;
+    int tx_ring_blocks = 0;
+    int tx_loops = -1;
+    tx_format_t tx_format = TX_FORMAT_S16;
+    int tx_interpolation = 1;
+    double tx_if = 0.0;
+    bool tx_if_enabled = false;
+    waveform_t generator;
+    bool generator_enabled = false;
+    int num_workers = 0;
+    int output_queue_depth = 0;
+    const char *monitor_output = NULL;
+    int monitor_decimation = 16;
+    int monitor_input = -1;
+    int monitor_queue_depth = 8;
+    const char *shm_name = NULL;
+    int shm_blocks = 256;
+    int net_tcp_port = 0;
+    const char *net_udp_destinations[NET_SERVER_MAX_CLIENTS];
+    int net_udp_num_destinations = 0;
+    const char *net_bind_address = NULL;
+    int net_payload_size = 1440;
+    int net_queue_depth = 16;
+
+    enum {
+        OPT_CHANNELIZER = 256,
+        OPT_CHANNELIZER_CHANNELS,
+        OPT_CHANNELIZER_OUTPUT,
+        OPT_CHANNELIZER_INPUT,
+        OPT_SPECTRUM,
+        OPT_SPECTRUM_OVERLAP,
+        OPT_SPECTRUM_INTERVAL,
+        OPT_SPECTRUM_OUTPUT,
+        OPT_SPECTRUM_FORMAT,
+        OPT_SPECTRUM_INPUT,
+        OPT_SPECTRUM_QUEUE,
+        OPT_TRIGGER,
+        OPT_TRIGGER_INPUT,
+        OPT_TRIGGER_PRE,
+        OPT_TRIGGER_POST,
+        OPT_TRIGGER_REARM,
+        OPT_SQUELCH,
+        OPT_SQUELCH_INPUT,
+        OPT_SQUELCH_WINDOW,
+        OPT_SQUELCH_HANG,
+        OPT_SQUELCH_PAD,
+        OPT_SQUELCH_INDEX,
+        OPT_OVERLOAD,
+        OPT_OVERLOAD_LOG,
+        OPT_STATS_INTERVAL,
+        OPT_CALIBRATE,
+        OPT_CORRECT,
+        OPT_DC_OFFSET,
+        OPT_GAIN,
+        OPT_CALIBRATION_FILE,
+        OPT_RX_RING,
+        OPT_RX_RING_POLICY,
+        OPT_RX_GAP_LOG,
+        OPT_RX_GAP_FILL,
+        OPT_TX_RING,
+        OPT_LOOP,
+        OPT_GEN,
+        OPT_TX_FORMAT,
+        OPT_TX_INTERPOLATION,
+        OPT_TX_IF,
+        OPT_WORKERS,
+        OPT_OUTPUT_QUEUE,
+        OPT_MONITOR,
+        OPT_MONITOR_DECIMATION,
+        OPT_MONITOR_INPUT,
+        OPT_MONITOR_QUEUE,
+        OPT_SHM,
+        OPT_SHM_BLOCKS,
+        OPT_NET_TCP,
+        OPT_NET_UDP,
+        OPT_NET_BIND,
+        OPT_NET_PAYLOAD,
+        OPT_NET_QUEUE,
+    };
+    static const struct option long_options[] = {
+        { "channelizer",          required_argument, NULL, OPT_CHANNELIZER },
+        { "channelizer-channels", required_argument, NULL, OPT_CHANNELIZER_CHANNELS },
+        { "channelizer-output",   required_argument, NULL, OPT_CHANNELIZER_OUTPUT },
+        { "channelizer-input",    required_argument, NULL, OPT_CHANNELIZER_INPUT },
+        { "spectrum",             required_argument, NULL, OPT_SPECTRUM },
+        { "spectrum-overlap",     required_argument, NULL, OPT_SPECTRUM_OVERLAP },
+        { "spectrum-interval",    required_argument, NULL, OPT_SPECTRUM_INTERVAL },
+        { "spectrum-output",      required_argument, NULL, OPT_SPECTRUM_OUTPUT },
+        { "spectrum-format",      required_argument, NULL, OPT_SPECTRUM_FORMAT },
+        { "spectrum-input",       required_argument, NULL, OPT_SPECTRUM_INPUT },
+        { "spectrum-queue",       required_argument, NULL, OPT_SPECTRUM_QUEUE },
+        { "trigger",              required_argument, NULL, OPT_TRIGGER },
+        { "trigger-input",        required_argument, NULL, OPT_TRIGGER_INPUT },
+        { "trigger-pre",          required_argument, NULL, OPT_TRIGGER_PRE },
+        { "trigger-post",         required_argument, NULL, OPT_TRIGGER_POST },
+        { "trigger-rearm",        required_argument, NULL, OPT_TRIGGER_REARM },
+        { "squelch",              required_argument, NULL, OPT_SQUELCH },
+        { "squelch-input",        required_argument, NULL, OPT_SQUELCH_INPUT },
+        { "squelch-window",       required_argument, NULL, OPT_SQUELCH_WINDOW },
+        { "squelch-hang",         required_argument, NULL, OPT_SQUELCH_HANG },
+        { "squelch-pad",          required_argument, NULL, OPT_SQUELCH_PAD },
+        { "squelch-index",        required_argument, NULL, OPT_SQUELCH_INDEX },
+        { "overload",             required_argument, NULL, OPT_OVERLOAD },
+        { "overload-log",         required_argument, NULL, OPT_OVERLOAD_LOG },
+        { "stats-interval",       required_argument, NULL, OPT_STATS_INTERVAL },
+        { "calibrate",            no_argument,       NULL, OPT_CALIBRATE },
+        { "correct",              no_argument,       NULL, OPT_CORRECT },
+        { "dc-offset",            required_argument, NULL, OPT_DC_OFFSET },
+        { "gain",                 required_argument, NULL, OPT_GAIN },
+        { "calibration-file",     required_argument, NULL, OPT_CALIBRATION_FILE },
+        { "rx-ring",              required_argument, NULL, OPT_RX_RING },
+        { "rx-ring-policy",       required_argument, NULL, OPT_RX_RING_POLICY },
+        { "rx-gap-log",           required_argument, NULL, OPT_RX_GAP_LOG },
+        { "rx-gap-fill",          no_argument,       NULL, OPT_RX_GAP_FILL },
+        { "tx-ring",              required_argument, NULL, OPT_TX_RING },
+        { "loop",                 required_argument, NULL, OPT_LOOP },
+        { "gen",                  required_argument, NULL, OPT_GEN },
+        { "tx-format",            required_argument, NULL, OPT_TX_FORMAT },
+        { "tx-interpolation",     required_argument, NULL, OPT_TX_INTERPOLATION },
+        { "tx-if",                required_argument, NULL, OPT_TX_IF },
+        { "workers",              required_argument, NULL, OPT_WORKERS },
+        { "output-queue",         required_argument, NULL, OPT_OUTPUT_QUEUE },
+        { "monitor",              required_argument, NULL, OPT_MONITOR },
+        { "monitor-decimation",   required_argument, NULL, OPT_MONITOR_DECIMATION },
+        { "monitor-input",        required_argument, NULL, OPT_MONITOR_INPUT },
+        { "monitor-queue",        required_argument, NULL, OPT_MONITOR_QUEUE },
+        { "shm",                  required_argument, NULL, OPT_SHM },
+        { "shm-blocks",           required_argument, NULL, OPT_SHM_BLOCKS },
+        { "net-tcp",              required_argument, NULL, OPT_NET_TCP },
+        { "net-udp",              required_argument, NULL, OPT_NET_UDP },
+        { "net-bind",             required_argument, NULL, OPT_NET_BIND },
+        { "net-payload",          required_argument, NULL, OPT_NET_PAYLOAD },
+        { "net-queue",            required_argument, NULL, OPT_NET_QUEUE },
+        { NULL, 0, NULL, 0 }
+    };
+
+    waveform_init(&generator);
 
     int opt;
-    while ((opt = getopt(argc, argv, "f:m:s:x:c:j:e:r:q:t:o:i:CH")) != -1) {
+    while ((opt = getopt_long(argc, argv, "f:m:s:x:c:j:e:r:q:t:n:o:i:CH", long_options, NULL)) != -1) {
         switch (opt) {
         case 'f':
             firmware_file = optarg;
@@ -127,11 +305,19 @@ int main(int argc, char *argv[])
                 fprintf(stderr, "invalid duration: %s\n", optarg);
                 return EXIT_FAILURE;
             }
+            duration_set = true;
+            break;
+        case 'n':
+            if (sscanf(optarg, "%llu", &num_samples) != 1) {
+                fprintf(stderr, "invalid number of samples: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
             break;
         case 'o':
             if (strcmp(optarg, "-") == 0) {
                 write_fileno = STDOUT_FILENO;
             } else {
+                output_file = optarg;
                 write_fileno = open(optarg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
                 if (write_fileno == -1) {
                     fprintf(stderr, "open(%s) for writing failed: %s\n", optarg, strerror(errno));
@@ -156,14 +342,353 @@ int main(int argc, char *argv[])
         case 'H':
             show_histogram = true;
             break;
+        case OPT_CHANNELIZER:
+            if (sscanf(optarg, "%dx%d", &channelizer_channels, &channelizer_oversample) < 1) {
+                fprintf(stderr, "invalid channelizer specification: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_CHANNELIZER_CHANNELS:
+            channelizer_num_selected = parse_int_list(optarg, channelizer_selected, sizeof(channelizer_selected) / sizeof(channelizer_selected[0]));
+            if (channelizer_num_selected <= 0) {
+                fprintf(stderr, "invalid channelizer channels: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_CHANNELIZER_OUTPUT:
+            channelizer_output = optarg;
+            break;
+        case OPT_CHANNELIZER_INPUT:
+            channelizer_input = parse_sample_select(optarg);
+            if (channelizer_input == -1) {
+                fprintf(stderr, "invalid channelizer input: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM:
+            if (sscanf(optarg, "%d", &spectrum_size) != 1) {
+                fprintf(stderr, "invalid spectrum FFT size: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM_OVERLAP:
+            if (sscanf(optarg, "%lf", &spectrum_overlap) != 1) {
+                fprintf(stderr, "invalid spectrum overlap: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM_INTERVAL:
+            if (sscanf(optarg, "%lf", &spectrum_interval) != 1 || spectrum_interval <= 0) {
+                fprintf(stderr, "invalid spectrum interval: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM_OUTPUT:
+            spectrum_output = optarg;
+            break;
+        case OPT_SPECTRUM_FORMAT:
+            if (strcmp(optarg, "csv") == 0) {
+                spectrum_format = SPECTRUM_FORMAT_CSV;
+            } else if (strcmp(optarg, "bin") == 0) {
+                spectrum_format = SPECTRUM_FORMAT_BINARY;
+            } else {
+                fprintf(stderr, "invalid spectrum format: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM_INPUT:
+            spectrum_input = parse_sample_select(optarg);
+            if (spectrum_input == -1) {
+                fprintf(stderr, "invalid spectrum input: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SPECTRUM_QUEUE:
+            if (sscanf(optarg, "%d", &spectrum_queue_depth) != 1) {
+                fprintf(stderr, "invalid spectrum queue depth: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TRIGGER:
+            {
+                char type[16];
+                if (sscanf(optarg, "%15[a-z]:%d", type, &trigger_threshold) != 2) {
+                    fprintf(stderr, "invalid trigger specification: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (strcmp(type, "rising") == 0) {
+                    trigger_type = TRIGGER_RISING;
+                } else if (strcmp(type, "falling") == 0) {
+                    trigger_type = TRIGGER_FALLING;
+                } else if (strcmp(type, "both") == 0) {
+                    trigger_type = TRIGGER_BOTH;
+                } else if (strcmp(type, "slope") == 0) {
+                    trigger_type = TRIGGER_SLOPE;
+                } else {
+                    fprintf(stderr, "invalid trigger type: %s\n", type);
+                    return EXIT_FAILURE;
+                }
+                trigger_enabled = true;
+            }
+            break;
+        case OPT_TRIGGER_INPUT:
+            trigger_input = parse_sample_select(optarg);
+            if (trigger_input == -1) {
+                fprintf(stderr, "invalid trigger input: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TRIGGER_PRE:
+            if (sscanf(optarg, "%d", &trigger_pre) != 1) {
+                fprintf(stderr, "invalid pre-trigger samples: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TRIGGER_POST:
+            if (sscanf(optarg, "%d", &trigger_post) != 1) {
+                fprintf(stderr, "invalid post-trigger samples: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TRIGGER_REARM:
+            if (sscanf(optarg, "%d", &trigger_holdoff) != 1) {
+                fprintf(stderr, "invalid trigger holdoff samples: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            trigger_rearm = true;
+            break;
+        case OPT_SQUELCH:
+            if (sscanf(optarg, "%lf", &squelch_threshold) != 1) {
+                fprintf(stderr, "invalid squelch threshold (dBFS): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            squelch_enabled = true;
+            break;
+        case OPT_SQUELCH_INPUT:
+            squelch_input = parse_sample_select(optarg);
+            if (squelch_input == -1) {
+                fprintf(stderr, "invalid squelch input: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SQUELCH_WINDOW:
+            if (sscanf(optarg, "%d", &squelch_window) != 1) {
+                fprintf(stderr, "invalid squelch window: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SQUELCH_HANG:
+            if (sscanf(optarg, "%lf", &squelch_hang) != 1 || squelch_hang < 0) {
+                fprintf(stderr, "invalid squelch hang time: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SQUELCH_PAD:
+            if (sscanf(optarg, "%d", &squelch_pad) != 1) {
+                fprintf(stderr, "invalid squelch padding: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SQUELCH_INDEX:
+            squelch_index = optarg;
+            break;
+        case OPT_OVERLOAD:
+            if (sscanf(optarg, "%d", &overload_margin) != 1 || overload_margin < 0) {
+                fprintf(stderr, "invalid overload margin: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_OVERLOAD_LOG:
+            overload_log = optarg;
+            break;
+        case OPT_STATS_INTERVAL:
+            if (sscanf(optarg, "%lf", &stats_interval) != 1 || stats_interval < 0) {
+                fprintf(stderr, "invalid stats interval: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_CALIBRATE:
+            calibrate = true;
+            break;
+        case OPT_CORRECT:
+            correct = true;
+            break;
+        case OPT_DC_OFFSET:
+            if (sscanf(optarg, "%lf,%lf", &dc_offset[0], &dc_offset[1]) != 2) {
+                fprintf(stderr, "invalid DC offsets (even,odd): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            dc_offset_set = true;
+            correct = true;
+            break;
+        case OPT_GAIN:
+            if (sscanf(optarg, "%lf,%lf", &gain[0], &gain[1]) != 2) {
+                fprintf(stderr, "invalid gains (even,odd): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            gain_set = true;
+            correct = true;
+            break;
+        case OPT_CALIBRATION_FILE:
+            calibration_file = optarg;
+            break;
+        case OPT_RX_RING:
+            if (sscanf(optarg, "%d", &rx_ring_blocks) != 1 || rx_ring_blocks < 2) {
+                fprintf(stderr, "invalid RX ring size (blocks): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_RX_RING_POLICY:
+            if (strcmp(optarg, "block") == 0) {
+                rx_ring_policy = RX_RING_BLOCK;
+            } else if (strcmp(optarg, "drop-newest") == 0) {
+                rx_ring_policy = RX_RING_DROP_NEWEST;
+            } else if (strcmp(optarg, "drop-oldest") == 0) {
+                rx_ring_policy = RX_RING_DROP_OLDEST;
+            } else {
+                fprintf(stderr, "invalid RX ring policy: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_RX_GAP_LOG:
+            rx_gap_log = optarg;
+            break;
+        case OPT_RX_GAP_FILL:
+            rx_gap_fill = true;
+            break;
+        case OPT_TX_RING:
+            if (sscanf(optarg, "%d", &tx_ring_blocks) != 1 || tx_ring_blocks < 2) {
+                fprintf(stderr, "invalid TX ring size (blocks): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_LOOP:
+            if (sscanf(optarg, "%d", &tx_loops) != 1 || tx_loops < 0) {
+                fprintf(stderr, "invalid number of loops: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_GEN:
+            if (waveform_parse(&generator, optarg) == -1) {
+                return EXIT_FAILURE;
+            }
+            generator_enabled = true;
+            break;
+        case OPT_TX_FORMAT:
+            if (strcmp(optarg, "s16") == 0) {
+                tx_format = TX_FORMAT_S16;
+            } else if (strcmp(optarg, "f32") == 0) {
+                tx_format = TX_FORMAT_F32;
+            } else if (strcmp(optarg, "cf32") == 0) {
+                tx_format = TX_FORMAT_CF32;
+            } else {
+                fprintf(stderr, "invalid TX input format: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TX_INTERPOLATION:
+            if (sscanf(optarg, "%d", &tx_interpolation) != 1 || tx_interpolation < 1) {
+                fprintf(stderr, "invalid TX interpolation factor: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_TX_IF:
+            if (sscanf(optarg, "%lf", &tx_if) != 1) {
+                fprintf(stderr, "invalid TX IF frequency: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            tx_if_enabled = true;
+            break;
+        case OPT_WORKERS:
+            if (sscanf(optarg, "%d", &num_workers) != 1 || num_workers < 0) {
+                fprintf(stderr, "invalid number of workers: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_OUTPUT_QUEUE:
+            if (sscanf(optarg, "%d", &output_queue_depth) != 1 || output_queue_depth < 0) {
+                fprintf(stderr, "invalid output queue depth: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_MONITOR:
+            monitor_output = optarg;
+            break;
+        case OPT_MONITOR_DECIMATION:
+            if (sscanf(optarg, "%d", &monitor_decimation) != 1 || monitor_decimation < 1) {
+                fprintf(stderr, "invalid monitor decimation: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_MONITOR_INPUT:
+            monitor_input = parse_sample_select(optarg);
+            if (monitor_input == -1) {
+                fprintf(stderr, "invalid monitor input: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_MONITOR_QUEUE:
+            if (sscanf(optarg, "%d", &monitor_queue_depth) != 1 || monitor_queue_depth <= 0) {
+                fprintf(stderr, "invalid monitor queue depth: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_SHM:
+            shm_name = optarg;
+            break;
+        case OPT_SHM_BLOCKS:
+            if (sscanf(optarg, "%d", &shm_blocks) != 1 || shm_blocks < 2) {
+                fprintf(stderr, "invalid shared memory ring size (blocks): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_NET_TCP:
+            if (sscanf(optarg, "%d", &net_tcp_port) != 1 || net_tcp_port <= 0 || net_tcp_port > 65535) {
+                fprintf(stderr, "invalid TCP port: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_NET_UDP:
+            if (net_udp_num_destinations == NET_SERVER_MAX_CLIENTS) {
+                fprintf(stderr, "too many UDP destinations (max %d)\n", NET_SERVER_MAX_CLIENTS);
+                return EXIT_FAILURE;
+            }
+            net_udp_destinations[net_udp_num_destinations++] = optarg;
+            break;
+        case OPT_NET_BIND:
+            net_bind_address = optarg;
+            break;
+        case OPT_NET_PAYLOAD:
+            if (sscanf(optarg, "%d", &net_payload_size) != 1 || net_payload_size <= 0 || net_payload_size % 4 != 0) {
+                fprintf(stderr, "invalid network payload size (multiple of 4 bytes): %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case OPT_NET_QUEUE:
+            if (sscanf(optarg, "%d", &net_queue_depth) != 1 || net_queue_depth <= 0) {
+                fprintf(stderr, "invalid network queue depth: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         case '?':
             /* invalid option */
             return EXIT_FAILURE;
         }
     }
 
-    if (read_fileno >= 0 && (write_fileno >= 0 || show_histogram)) {
-        fprintf(stderr, "[ERROR] options -i (read from stdin/file) and -o (write to stdout/file) or -H (show histogram) are exclusive\n");
+    if (generator_enabled && read_fileno >= 0) {
+        fprintf(stderr, "[ERROR] options -i (read from stdin/file) and --gen (signal generator) are mutually exclusive\n");
+        if (read_fileno != STDIN_FILENO) {
+            close(read_fileno);
+        }
+        return EXIT_FAILURE;
+    }
+
+    /* TX: the samples come from stdin/file or from the signal generator */
+    bool transmit = read_fileno >= 0 || generator_enabled;
+
+    if (transmit && (write_fileno >= 0 || show_histogram || channelizer_channels > 0 || spectrum_size > 0 || trigger_enabled || squelch_enabled)) {
+        fprintf(stderr, "[ERROR] options -i (read from stdin/file) or --gen and -o (write to stdout/file), -H (show histogram), --channelizer, --spectrum, --trigger or --squelch are exclusive\n");
         fprintf(stderr, "[ERROR] streaming-client cannot not write and read at the same time (no full-duplex yet)\n");
         if (read_fileno != STDIN_FILENO) {
             close(read_fileno);
@@ -179,12 +704,139 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    if (num_samples > 0 && transmit) {
+        fprintf(stderr, "[ERROR] option -n (number of samples) is only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    /* with -n the capture ends when the sample count is reached; -t is then only a timeout */
+    if (num_samples > 0 && !duration_set) {
+        duration = 0;
+    }
+
+    if (trigger_enabled && write_fileno == -1) {
+        fprintf(stderr, "[ERROR] option --trigger requires -o (write to stdout/file)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (squelch_enabled && write_fileno == -1) {
+        fprintf(stderr, "[ERROR] option --squelch requires -o (write to stdout/file)\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((calibrate || correct) && transmit) {
+        fprintf(stderr, "[ERROR] options --calibrate and --correct are only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    if (rx_ring_blocks > 0 && transmit) {
+        fprintf(stderr, "[ERROR] option --rx-ring is only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_ring_blocks > 0 && read_fileno < 0) {
+        fprintf(stderr, "[ERROR] option --tx-ring is only valid for TX (-i)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_loops >= 0 && (read_fileno < 0 || read_fileno == STDIN_FILENO)) {
+        fprintf(stderr, "[ERROR] option --loop is only valid for TX from a file (-i file)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_loops >= 0 && tx_ring_blocks > 0) {
+        fprintf(stderr, "[ERROR] options --loop and --tx-ring are mutually exclusive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_format != TX_FORMAT_S16 && read_fileno < 0) {
+        fprintf(stderr, "[ERROR] option --tx-format is only valid for TX (-i)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_format != TX_FORMAT_S16 && tx_loops >= 0) {
+        fprintf(stderr, "[ERROR] option --loop requires s16 input (--tx-format s16)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_interpolation > 1 && read_fileno < 0) {
+        fprintf(stderr, "[ERROR] option --tx-interpolation is only valid for TX (-i)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_interpolation > 1 && tx_loops >= 0) {
+        fprintf(stderr, "[ERROR] options --loop and --tx-interpolation are mutually exclusive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_if_enabled && tx_format != TX_FORMAT_CF32) {
+        fprintf(stderr, "[ERROR] option --tx-if requires complex input (--tx-format cf32)\n");
+        return EXIT_FAILURE;
+    }
+
+    if (tx_if_enabled && !(tx_if > 0.0 && tx_if < samplerate / 2)) {
+        fprintf(stderr, "[ERROR] the TX IF frequency must be between 0 and half the sample rate\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((monitor_output != NULL || output_queue_depth > 0 || shm_name != NULL) && transmit) {
+        fprintf(stderr, "[ERROR] options --monitor, --output-queue and --shm are only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((net_tcp_port > 0 || net_udp_num_destinations > 0) && transmit) {
+        fprintf(stderr, "[ERROR] options --net-tcp and --net-udp are only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    if (net_tcp_port > 0 && net_udp_num_destinations > 0) {
+        fprintf(stderr, "[ERROR] options --net-tcp and --net-udp are mutually exclusive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (monitor_output != NULL && strcmp(monitor_output, "-") == 0 && (show_histogram || write_fileno == STDOUT_FILENO || (spectrum_size > 0 && strcmp(spectrum_output, "-") == 0))) {
+        fprintf(stderr, "[ERROR] option --monitor - (write monitor stream to stdout) is exclusive with -H (show histogram), -o - and --spectrum-output -\n");
+        return EXIT_FAILURE;
+    }
+
+    if (num_workers > 0 && transmit) {
+        fprintf(stderr, "[ERROR] option --workers is only valid for RX\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((rx_gap_log != NULL || rx_gap_fill) && rx_ring_blocks == 0) {
+        fprintf(stderr, "[ERROR] options --rx-gap-log and --rx-gap-fill require --rx-ring\n");
+        return EXIT_FAILURE;
+    }
+
+    if (calibrate && correct) {
+        fprintf(stderr, "[ERROR] options --calibrate and --correct (or --dc-offset/--gain) are mutually exclusive\n");
+        return EXIT_FAILURE;
+    }
+
+    char default_calibration_file[1024];
+    if (calibration_file == NULL) {
+        const char *home = getenv("HOME");
+        snprintf(default_calibration_file, sizeof(default_calibration_file), "%s/.dfc-calibration", home != NULL ? home : ".");
+        calibration_file = default_calibration_file;
+    }
+
+    if (squelch_enabled && trigger_enabled) {
+        fprintf(stderr, "[ERROR] options --squelch and --trigger are mutually exclusive\n");
+        return EXIT_FAILURE;
+    }
+
+    if (spectrum_size > 0 && strcmp(spectrum_output, "-") == 0 && (show_histogram || write_fileno == STDOUT_FILENO)) {
+        fprintf(stderr, "[ERROR] option --spectrum-output - (write spectrum to stdout) is exclusive with -H (show histogram) and -o - (write to stdout)\n");
+        return EXIT_FAILURE;
+    }
+
     if (firmware_file == NULL) {
         fprintf(stderr, "missing firmware file\n");
         return EXIT_FAILURE;
     }
 
-    stream_direction_t stream_direction = read_fileno >= 0 ? STREAM_TX : STREAM_RX;
+    stream_direction_t stream_direction = transmit ? STREAM_TX : STREAM_RX;
     int stream_read_write_fileno = read_fileno >= 0 ? read_fileno : write_fileno;
     if (dfc_mode == DFC_MODE_UNKNOWN) {
         switch (stream_direction) {
@@ -209,10 +861,23 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* the signal generator pre-computes one period of the waveform, and
+       shifts it for the DAC once, so that filling a transfer is a copy */
+    if (generator_enabled) {
+        if (waveform_build(&generator) == -1) {
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "signal generator period length: %d\n", generator.period_length);
+        if (generator.num_overflows > 0) {
+            fprintf(stderr, "warning - signal generator overflow/underflow condition for %d samples\n", generator.num_overflows);
+        }
+        sample_kernels_to_dac(generator.samples, generator.period_length);
+    }
+
     dfc_t dfc;
     int status;
 
-    status = usb_init(&dfc.usb_device, firmware_file);
+    status = usb_init(&dfc.usb_device, firmware_file, NULL);
     if (status == -1) {
         return EXIT_FAILURE;
     }
@@ -222,88 +887,374 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    char serial_number[128] = "";
+    if (calibrate || correct) {
+        status = usb_get_serial_number(&dfc.usb_device, serial_number, sizeof(serial_number));
+        if (status == -1) {
+            usb_close(&dfc.usb_device);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "DFC serial number: %s\n", serial_number);
+    }
+
     if (!cypress_example) {
         fprintf(stderr, "DFC FW version: %s\n", dfc_fx3_get_fw_version(&dfc));
 
-        if (!(dfc_mode == DFC_MODE_UNKNOWN || dfc_mode == UART_ONLY)) {
-            const uint8_t SETMODE = 0x90;
-            uint8_t data = dfc_mode;
-            status = usb_control_write(&dfc.usb_device, SETMODE, &data, sizeof(data));
-            if (status != 0) {
-                fprintf(stderr, "set DFC mode to %d failed\n", dfc_mode);
-                return -1;
-            }
+        status = dfc_configure(&dfc, dfc_mode, reference_clock * (1.0 + 1e-6 * reference_ppm), samplerate);
+        if (status == -1) {
+            usb_close(&dfc.usb_device);
+            return EXIT_FAILURE;
         }
+    }
 
-        /* wait a few ms before using the new mode */
-        usleep(20000);
-
-        uint8_t current_dfc_mode = dfc_fx3_get_mode(&dfc);
-        fprintf(stderr, "DFC mode: %hhu\n", current_dfc_mode);
+    if (duration > 0 || num_samples > 0) {
+        stream_t stream;
+        channelizer_t channelizer;
+        spectrum_t spectrum;
+        int spectrum_fileno = -1;
+        trigger_t trigger;
+        squelch_t squelch;
+        FILE *squelch_index_file = NULL;
+        overload_t overload;
+        FILE *overload_log_file = NULL;
+        correction_t correction;
+        rate_estimator_t rate_estimator;
+        rx_ring_t rx_ring;
+        tx_ring_t tx_ring;
+        tx_loop_t tx_loop;
+        tx_converter_t tx_converter;
+        FILE *rx_gap_log_file = NULL;
+        worker_pool_t worker_pool;
+        decimator_t monitor_decimator;
+        pipeline_stage_t monitor_stage;
+        pipeline_stage_t monitor_write_stage;
+        int monitor_fileno = -1;
+        shm_ring_t shm_ring;
+        pipeline_stage_t shm_stage;
+        net_server_t net_server;
+        pipeline_stage_t net_stage;
+        bool net_enabled = net_tcp_port > 0 || net_udp_num_destinations > 0;
 
-        if (current_dfc_mode != dfc_mode) {
-            fprintf(stderr, "[ERROR] Current DFC mode: %hhu - expected: %d\n", current_dfc_mode, dfc_mode);
+        status = stream_init(&stream, stream_direction, stream_read_write_fileno, &dfc.usb_device, reqsize, queuedepth, show_histogram);
+        if (status == -1) {
             usb_close(&dfc.usb_device);
             return EXIT_FAILURE;
         }
 
-        if (dfc_mode == SINGLE_ADC || dfc_mode == DUAL_ADC) {
-            status = dfc_fx3_wakeup_adc(&dfc);
+        if (dfc_mode == SINGLE_ADC || dfc_mode == SINGLE_ADC_FX3_CLOCK) {
+            stream.layout = SAMPLE_LAYOUT_SINGLE_ADC;
+        }
+
+        /* in dual ADC mode -n counts samples per ADC */
+        stream.max_samples = dfc_mode == DUAL_ADC ? 2 * num_samples : num_samples;
+
+        /* the actual sample rate is only meaningful when it comes from the Si5351 */
+        if (!(dfc_mode == SINGLE_ADC_FX3_CLOCK || dfc_mode == DAC_FX3_CLOCK)) {
+            status = rate_estimator_init(&rate_estimator, samplerate, dfc_mode == DUAL_ADC ? 2 : 1, reference_ppm);
             if (status == -1) {
+                stream_fini(&stream);
                 usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
+            stream.rate_estimator = &rate_estimator;
+        }
 
-            status = dfc_fx3_shutdown_dac(&dfc);
+        if (channelizer_channels > 0) {
+            if (channelizer_num_selected == 0) {
+                /* the input is real, so only the first half of the channels is unique */
+                for (int i = 0; i <= channelizer_channels / 2 && i < (int)(sizeof(channelizer_selected) / sizeof(channelizer_selected[0])); i++) {
+                    channelizer_selected[channelizer_num_selected++] = i;
+                }
+            }
+            if (channelizer_input == -1) {
+                channelizer_input = dfc_mode == DUAL_ADC ? SAMPLE_SELECT_EVEN : SAMPLE_SELECT_ALL;
+            }
+            status = channelizer_init(&channelizer, channelizer_channels, channelizer_oversample, channelizer_input, channelizer_selected, channelizer_num_selected, channelizer_output);
             if (status == -1) {
+                stream_fini(&stream);
                 usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
-        } else if (dfc_mode == DAC || dfc_mode == DAC_FX3_CLOCK) {
-            status = dfc_fx3_shutdown_adc(&dfc);
+            stream.channelizer = &channelizer;
+        }
+
+        if (spectrum_size > 0) {
+            if (strcmp(spectrum_output, "-") == 0) {
+                spectrum_fileno = STDOUT_FILENO;
+            } else {
+                spectrum_fileno = open(spectrum_output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (spectrum_fileno == -1) {
+                    fprintf(stderr, "open(%s) for writing failed: %s\n", spectrum_output, strerror(errno));
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            if (spectrum_input == -1) {
+                spectrum_input = dfc_mode == DUAL_ADC ? SAMPLE_SELECT_EVEN : SAMPLE_SELECT_ALL;
+            }
+            status = spectrum_init(&spectrum, spectrum_size, spectrum_overlap, spectrum_input, spectrum_interval * samplerate, spectrum_format, spectrum_fileno, spectrum_queue_depth);
             if (status == -1) {
+                stream_fini(&stream);
                 usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
+            status = spectrum_start(&spectrum);
+            if (status == -1) {
+                spectrum_fini(&spectrum);
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            stream.spectrum = &spectrum;
+        }
 
-            status = dfc_fx3_wakeup_dac(&dfc);
+        if (trigger_enabled) {
+            if (trigger_input == -1) {
+                trigger_input = dfc_mode == DUAL_ADC ? SAMPLE_SELECT_EVEN : SAMPLE_SELECT_ALL;
+            }
+            status = trigger_init(&trigger, trigger_type, trigger_threshold, trigger_input, trigger_pre, trigger_post, trigger_rearm, trigger_holdoff, write_fileno);
             if (status == -1) {
+                stream_fini(&stream);
                 usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
-#define _FX3_CLOCK_TEST_
-#ifdef _FX3_CLOCK_TEST_
-        } else if (dfc_mode == SINGLE_ADC_FX3_CLOCK) {
-            fprintf(stderr, "shutting down ADC\n");
-            status = dfc_fx3_shutdown_adc(&dfc);
+            stream.trigger = &trigger;
+        }
+
+        if (squelch_enabled) {
+            /* by default the burst index goes next to the output file (or to stderr) */
+            char index_path[1024];
+            if (squelch_index == NULL && output_file != NULL) {
+                snprintf(index_path, sizeof(index_path), "%s.idx", output_file);
+                squelch_index = index_path;
+            }
+            if (squelch_index != NULL) {
+                squelch_index_file = fopen(squelch_index, "w");
+                if (squelch_index_file == NULL) {
+                    fprintf(stderr, "fopen(%s) for writing failed: %s\n", squelch_index, strerror(errno));
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            if (squelch_input == -1) {
+                squelch_input = dfc_mode == DUAL_ADC ? SAMPLE_SELECT_EVEN : SAMPLE_SELECT_ALL;
+            }
+            status = squelch_init(&squelch, squelch_threshold, squelch_input, squelch_window, squelch_hang * samplerate, squelch_pad, write_fileno, squelch_index_file != NULL ? squelch_index_file : stderr);
             if (status == -1) {
+                stream_fini(&stream);
                 usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
-#endif  /* _FX3_CLOCK_TEST_ */
+            stream.squelch = &squelch;
         }
 
-        if (!(dfc_mode == SINGLE_ADC_FX3_CLOCK || dfc_mode == DAC_FX3_CLOCK)) {
-            status = clock_start(&dfc.clock, &dfc.usb_device, reference_clock * (1.0 + 1e-6 * reference_ppm), samplerate);
+        if (overload_margin >= 0 && stream_direction == STREAM_RX) {
+            if (overload_log != NULL) {
+                overload_log_file = fopen(overload_log, "w");
+                if (overload_log_file == NULL) {
+                    fprintf(stderr, "fopen(%s) for writing failed: %s\n", overload_log, strerror(errno));
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            status = overload_init(&overload, overload_margin, overload_log_file != NULL ? overload_log_file : stderr);
             if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
                 return EXIT_FAILURE;
             }
+            stream.overload = &overload;
         }
 
-        status = dfc_fx3_start(&dfc);
-        if (status == -1) {
-            usb_close(&dfc.usb_device);
-            return EXIT_FAILURE;
+        if (calibrate || correct) {
+            /* calibration file values first, then the ones from the command line */
+            double offset[2] = { 0, 0 };
+            double gains[2] = { 1, 1 };
+            status = correction_load(calibration_file, serial_number, offset, gains);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            if (status == 1 && correct && !dc_offset_set) {
+                fprintf(stderr, "warning - no calibration for device %s in %s\n", serial_number, calibration_file);
+            }
+            if (dc_offset_set) {
+                offset[0] = dc_offset[0];
+                offset[1] = dc_offset[1];
+            }
+            if (gain_set) {
+                gains[0] = gain[0];
+                gains[1] = gain[1];
+            }
+            status = correction_init(&correction, offset, gains, calibrate);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            stream.correction = &correction;
         }
-    }
 
-    if (duration > 0) {
-        stream_t stream;
+        if (rx_ring_blocks > 0) {
+            if (rx_gap_log != NULL) {
+                rx_gap_log_file = fopen(rx_gap_log, "w");
+                if (rx_gap_log_file == NULL) {
+                    fprintf(stderr, "fopen(%s) for writing failed: %s\n", rx_gap_log, strerror(errno));
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            status = rx_ring_init(&rx_ring, rx_ring_blocks, stream.transfer_size, rx_ring_policy);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            stream.rx_ring = &rx_ring;
+            stream.gap_log = rx_gap_log_file != NULL ? rx_gap_log_file : stderr;
+            stream.gap_fill = rx_gap_fill;
+        }
 
-        status = stream_init(&stream, stream_direction, stream_read_write_fileno, &dfc.usb_device, reqsize, queuedepth, show_histogram);
-        if (status == -1) {
-            usb_close(&dfc.usb_device);
-            return EXIT_FAILURE;
+        if (tx_ring_blocks > 0) {
+            status = tx_ring_init(&tx_ring, tx_ring_blocks, stream.transfer_size);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            stream.tx_ring = &tx_ring;
+        }
+
+        /* looping playback: the whole file is kept in memory */
+        if (tx_loops >= 0) {
+            status = tx_loop_init(&tx_loop, read_fileno, tx_loops);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            stream.tx_loop = &tx_loop;
+        }
+
+        if (generator_enabled) {
+            stream.generator = &generator;
+        }
+
+        if (tx_format != TX_FORMAT_S16 || tx_interpolation > 1) {
+            status = tx_converter_init(&tx_converter, tx_format, tx_interpolation, stream.transfer_size / sizeof(short));
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            if (tx_if_enabled) {
+                status = tx_converter_enable_upconversion(&tx_converter, tx_if, samplerate);
+                if (status == -1) {
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            stream.tx_converter = &tx_converter;
+        }
+
+        stream.output_queue_depth = output_queue_depth;
+
+        /* monitor stream: decimated on its own thread (dropping blocks if it
+           falls behind) and written to its own file */
+        if (monitor_output != NULL) {
+            if (strcmp(monitor_output, "-") == 0) {
+                monitor_fileno = STDOUT_FILENO;
+            } else {
+                monitor_fileno = open(monitor_output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (monitor_fileno == -1) {
+                    fprintf(stderr, "open(%s) for writing failed: %s\n", monitor_output, strerror(errno));
+                    stream_fini(&stream);
+                    usb_close(&dfc.usb_device);
+                    return EXIT_FAILURE;
+                }
+            }
+            if (monitor_input == -1) {
+                monitor_input = dfc_mode == DUAL_ADC ? SAMPLE_SELECT_EVEN : SAMPLE_SELECT_ALL;
+            }
+            status = decimator_init(&monitor_decimator, monitor_decimation, monitor_input, stream.transfer_size / sizeof(short));
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            pipeline_stage_init(&monitor_stage, "monitor", decimator_stage, &monitor_decimator);
+            pipeline_stage_init(&monitor_write_stage, "monitor-output", io_write_stage, &monitor_fileno);
+            status = pipeline_stage_set_worker(&monitor_stage, monitor_queue_depth, stream.transfer_size / sizeof(short), true);
+            if (status == 0) {
+                status = pipeline_connect(&monitor_stage, &monitor_write_stage);
+            }
+            if (status == 0) {
+                status = pipeline_connect(&stream.pipeline, &monitor_stage);
+            }
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+        }
+
+        /* shared memory ring for other local processes (see shm_reader.h) */
+        if (shm_name != NULL) {
+            status = shm_ring_init(&shm_ring, shm_name, shm_blocks, stream.transfer_size, samplerate, dfc_mode == DUAL_ADC ? 2 : 1);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            pipeline_stage_init(&shm_stage, "shm", shm_ring_stage, &shm_ring);
+            status = pipeline_connect(&stream.pipeline, &shm_stage);
+            if (status == -1) {
+                shm_ring_fini(&shm_ring);
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+        }
+
+        /* network server (see vrt.h for the packet format); it runs on its own
+           thread and drops blocks rather than slowing down the stream */
+        if (net_enabled) {
+            status = net_server_init(&net_server, net_tcp_port > 0 ? NET_SERVER_TCP : NET_SERVER_UDP, net_bind_address, net_tcp_port, net_payload_size, stream.transfer_size, dfc_mode);
+            for (int i = 0; status == 0 && i < net_udp_num_destinations; i++) {
+                status = net_server_add_destination(&net_server, net_udp_destinations[i]);
+            }
+            if (status == -1) {
+                net_server_fini(&net_server);
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+            pipeline_stage_init(&net_stage, "net", net_server_stage, &net_server);
+            status = pipeline_stage_set_worker(&net_stage, net_queue_depth, stream.transfer_size / sizeof(short), true);
+            if (status == 0) {
+                status = pipeline_connect(&stream.pipeline, &net_stage);
+            }
+            if (status == -1) {
+                net_server_fini(&net_server);
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (num_workers > 0) {
+            status = stream_init_worker_pool(&stream, &worker_pool, num_workers);
+            if (status == -1) {
+                stream_fini(&stream);
+                usb_close(&dfc.usb_device);
+                return EXIT_FAILURE;
+            }
         }
 
         struct sigaction sigact;
@@ -324,10 +1275,21 @@ int main(int argc, char *argv[])
         struct timespec start_time;
         clock_gettime(CLOCK_REALTIME, &start_time);
 
-        alarm(duration);
+        if (duration > 0) {
+            alarm(duration);
+        }
 
-        while (!stop_transfers) {
+        struct timespec live_stats_time = start_time;
+        while (!(stop_transfers || stream_done(&stream))) {
             libusb_handle_events(NULL);
+            if (stats_interval > 0) {
+                struct timespec now;
+                clock_gettime(CLOCK_REALTIME, &now);
+                if ((now.tv_sec - live_stats_time.tv_sec) + 1e-9 * (now.tv_nsec - live_stats_time.tv_nsec) >= stats_interval) {
+                    stream_live_stats(&stream, (now.tv_sec - start_time.tv_sec) + 1e-9 * (now.tv_nsec - start_time.tv_nsec));
+                    live_stats_time = now;
+                }
+            }
         }
 
         status = stream_stop(&stream);
@@ -336,11 +1298,87 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;
         }
 
+        if (stream.spectrum != NULL) {
+            spectrum_stop(stream.spectrum);
+        }
+
         struct timespec end_time;
         clock_gettime(CLOCK_REALTIME, &end_time);
         double elapsed = (end_time.tv_sec - start_time.tv_sec) + 1e-9 * (end_time.tv_nsec - start_time.tv_nsec);
         stream_stats(&stream, elapsed);
 
+        if (stream.channelizer != NULL) {
+            channelizer_fini(stream.channelizer);
+        }
+        if (stream.trigger != NULL) {
+            trigger_fini(stream.trigger);
+        }
+        if (stream.correction != NULL) {
+            if (stream.correction->calibrating) {
+                /* save the measured offsets, keeping the gains */
+                double offset[2];
+                if (correction_measured_offsets(stream.correction, offset) == 0) {
+                    if (correction_save(calibration_file, serial_number, offset, stream.correction->gain) == 0) {
+                        fprintf(stderr, "calibration for device %s saved to %s\n", serial_number, calibration_file);
+                    }
+                }
+            }
+            correction_fini(stream.correction);
+        }
+        if (stream.worker_pool != NULL) {
+            worker_pool_fini(stream.worker_pool);
+        }
+        if (net_enabled) {
+            net_server_stats(&net_server);
+            pipeline_stage_fini(&net_stage);
+            net_server_fini(&net_server);
+        }
+        if (shm_name != NULL) {
+            shm_ring_stats(&shm_ring);
+            shm_ring_fini(&shm_ring);
+        }
+        if (monitor_output != NULL) {
+            decimator_stats(&monitor_decimator);
+            pipeline_stage_fini(&monitor_stage);
+            decimator_fini(&monitor_decimator);
+            if (monitor_fileno >= 0 && monitor_fileno != STDOUT_FILENO) {
+                close(monitor_fileno);
+            }
+        }
+        if (stream.rx_ring != NULL) {
+            rx_ring_fini(stream.rx_ring);
+            if (rx_gap_log_file != NULL) {
+                fclose(rx_gap_log_file);
+            }
+        }
+        if (stream.tx_ring != NULL) {
+            tx_ring_fini(stream.tx_ring);
+        }
+        if (stream.tx_loop != NULL) {
+            tx_loop_fini(stream.tx_loop);
+        }
+        if (stream.tx_converter != NULL) {
+            tx_converter_fini(stream.tx_converter);
+        }
+        if (stream.overload != NULL) {
+            overload_fini(stream.overload);
+            if (overload_log_file != NULL) {
+                fclose(overload_log_file);
+            }
+        }
+        if (stream.squelch != NULL) {
+            squelch_fini(stream.squelch);
+            if (squelch_index_file != NULL) {
+                fclose(squelch_index_file);
+            }
+        }
+        if (stream.spectrum != NULL) {
+            spectrum_fini(stream.spectrum);
+            if (spectrum_fileno != STDOUT_FILENO) {
+                close(spectrum_fileno);
+            }
+        }
+
         status = stream_fini(&stream);
         if (status == -1) {
             usb_close(&dfc.usb_device);
@@ -362,6 +1400,7 @@ int main(int argc, char *argv[])
     if (!(read_fileno == -1 || read_fileno == STDIN_FILENO)) {
         close(read_fileno);
     }
+    waveform_fini(&generator);
 
     status = usb_close(&dfc.usb_device);
     if (status == -1) {
@@ -376,3 +1415,36 @@ static void sig_stop(int signum) {
     fprintf(stderr, "Abort. Stopping transfers\n");
     stop_transfers = true;
 }
+
+/* parse a comma separated list of integers (i.e. 1,5,9) */
+static int parse_int_list(const char *list, int *values, int max_values) {
+    int nvalues = 0;
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || nvalues >= max_values) {
+            return -1;
+        }
+        values[nvalues++] = value;
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        p = end;
+    }
+    return nvalues;
+}
+
+/* parse a sample selection (all, even, or odd) */
+static int parse_sample_select(const char *select) {
+    if (strcmp(select, "all") == 0) {
+        return SAMPLE_SELECT_ALL;
+    } else if (strcmp(select, "even") == 0) {
+        return SAMPLE_SELECT_EVEN;
+    } else if (strcmp(select, "odd") == 0) {
+        return SAMPLE_SELECT_ODD;
+    }
+    return -1;
+}
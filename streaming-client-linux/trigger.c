@@ -0,0 +1,261 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "trigger.h"
+#include "io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* samples are checked in chunks; only chunks where the chunk check (a
+   count or a min/max over the whole chunk) says a trigger is possible are
+   scanned sample by sample */
+static const int chunk_size = 256;
+
+/* internal functions */
+static int find_trigger(trigger_t *this, const short *samples, int start, int end);
+static bool chunk_may_trigger(const trigger_t *this, const short *samples, int n);
+static int write_pretrigger(trigger_t *this, const short *samples, int frame);
+
+
+int trigger_init(trigger_t *this, trigger_type_t type, int threshold, sample_select_t input, int pre_samples, int post_samples, bool rearm, int holdoff_samples, int output_fileno)
+{
+    memset(this, 0, sizeof(*this));
+
+    if (pre_samples < 0 || post_samples <= 0 || holdoff_samples < 0) {
+        fprintf(stderr, "trigger_init - invalid pre/post/holdoff samples: %d/%d/%d\n", pre_samples, post_samples, holdoff_samples);
+        return -1;
+    }
+    if (type == TRIGGER_SLOPE && threshold == 0) {
+        fprintf(stderr, "trigger_init - slope threshold cannot be 0\n");
+        return -1;
+    }
+
+    this->type = type;
+    this->threshold = threshold;
+    this->input = input;
+    this->stride = input == SAMPLE_SELECT_ALL ? 1 : 2;
+    this->pre_samples = pre_samples * this->stride;
+    this->post_samples = post_samples * this->stride;
+    this->rearm = rearm;
+    this->holdoff_samples = holdoff_samples * this->stride;
+    this->output_fileno = output_fileno;
+    this->state = TRIGGER_ARMED;
+
+    if (history_init(&this->history, this->pre_samples) == -1) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int trigger_fini(trigger_t *this)
+{
+    history_fini(&this->history);
+    return 0;
+}
+
+int trigger_process(trigger_t *this, const short *samples, int nsamples)
+{
+    int channel_offset = this->input == SAMPLE_SELECT_ODD ? 1 : 0;
+
+    int i = 0;
+    while (i < nsamples) {
+        int n = nsamples - i;
+        if (n > this->remaining) {
+            n = this->remaining;
+        }
+
+        switch (this->state) {
+        case TRIGGER_ARMED:
+            {
+                int t = find_trigger(this, samples, i + channel_offset, nsamples);
+                if (t < 0) {
+                    i = nsamples;
+                    break;
+                }
+                int frame = t - channel_offset;
+                this->events++;
+                fprintf(stderr, "trigger event %u at sample %llu\n", this->events, (this->stream_offset + t) / this->stride);
+                if (write_pretrigger(this, samples, frame) == -1) {
+                    return -1;
+                }
+                this->state = TRIGGER_CAPTURING;
+                this->remaining = this->post_samples;
+                i = frame;
+            }
+            break;
+        case TRIGGER_CAPTURING:
+            if (io_write_all(this->output_fileno, samples + i, n * sizeof(short)) == -1) {
+                return -1;
+            }
+            this->written_samples += n;
+            i += n;
+            this->remaining -= n;
+            this->written_end = this->stream_offset + i;
+            if (this->remaining == 0) {
+                if (!this->rearm) {
+                    this->state = TRIGGER_DONE;
+                } else {
+                    this->state = TRIGGER_HOLDOFF;
+                    this->remaining = this->holdoff_samples;
+                }
+            }
+            break;
+        case TRIGGER_HOLDOFF:
+            i += n;
+            this->remaining -= n;
+            if (this->remaining == 0) {
+                this->state = TRIGGER_ARMED;
+                this->has_last_sample = false;
+            }
+            break;
+        case TRIGGER_DONE:
+            i = nsamples;
+            break;
+        }
+    }
+
+    history_update(&this->history, samples, nsamples);
+    this->stream_offset += nsamples;
+    return 0;
+}
+
+void trigger_stats(trigger_t *this)
+{
+    fprintf(stderr, "trigger events: %u\n", this->events);
+    fprintf(stderr, "trigger samples written: %llu\n", this->written_samples);
+    return;
+}
+
+
+/* internal functions */
+
+/* returns the raw index of the triggering sample in [start,end), or -1 */
+static int find_trigger(trigger_t *this, const short *samples, int start, int end)
+{
+    int stride = this->stride;
+    for (int i = start; i < end; i += chunk_size * stride) {
+        int n = (end - i + stride - 1) / stride;
+        if (n > chunk_size) {
+            n = chunk_size;
+        }
+        if (!chunk_may_trigger(this, samples + i, n)) {
+            this->last_sample = samples[i + (n - 1) * stride];
+            this->has_last_sample = true;
+            continue;
+        }
+        int threshold = this->threshold;
+        for (int j = 0; j < n; j++) {
+            short current = samples[i + j * stride];
+            if (this->has_last_sample) {
+                short last = this->last_sample;
+                bool triggered = false;
+                switch (this->type) {
+                case TRIGGER_RISING:
+                    triggered = last < threshold && current >= threshold;
+                    break;
+                case TRIGGER_FALLING:
+                    triggered = last >= threshold && current < threshold;
+                    break;
+                case TRIGGER_BOTH:
+                    triggered = (last < threshold) != (current < threshold);
+                    break;
+                case TRIGGER_SLOPE:
+                    triggered = threshold > 0 ? current - last >= threshold : current - last <= threshold;
+                    break;
+                }
+                if (triggered) {
+                    this->last_sample = current;
+                    return i + j * stride;
+                }
+            }
+            this->last_sample = current;
+            this->has_last_sample = true;
+        }
+    }
+    return -1;
+}
+
+/* chunk checks */
+static inline int count_above(const short *samples, int n, int stride, int threshold)
+{
+    int count = 0;
+    for (int j = 0; j < n; j++) {
+        count += samples[j * stride] >= threshold;
+    }
+    return count;
+}
+
+static inline void diff_range(const short *samples, int n, int stride, int *min_diff, int *max_diff)
+{
+    int dmin = *min_diff;
+    int dmax = *max_diff;
+    for (int j = 1; j < n; j++) {
+        int d = samples[j * stride] - samples[(j - 1) * stride];
+        dmin = d < dmin ? d : dmin;
+        dmax = d > dmax ? d : dmax;
+    }
+    *min_diff = dmin;
+    *max_diff = dmax;
+}
+
+static bool chunk_may_trigger(const trigger_t *this, const short *samples, int n)
+{
+    if (this->type == TRIGGER_SLOPE) {
+        int min_diff = 0;
+        int max_diff = 0;
+        if (this->has_last_sample) {
+            min_diff = max_diff = samples[0] - this->last_sample;
+        }
+        if (this->stride == 1) {
+            diff_range(samples, n, 1, &min_diff, &max_diff);
+        } else {
+            diff_range(samples, n, 2, &min_diff, &max_diff);
+        }
+        return this->threshold > 0 ? max_diff >= this->threshold : min_diff <= this->threshold;
+    }
+
+    /* a level crossing needs both samples below and at/above the threshold */
+    int above = this->stride == 1 ? count_above(samples, n, 1, this->threshold) : count_above(samples, n, 2, this->threshold);
+    int total = n;
+    if (this->has_last_sample) {
+        above += this->last_sample >= this->threshold;
+        total++;
+    }
+    return above > 0 && above < total;
+}
+
+/* write the pre-trigger samples before raw index frame in the current block,
+   taking them from the history for the part before the block */
+static int write_pretrigger(trigger_t *this, const short *samples, int frame)
+{
+    unsigned long long frame_offset = this->stream_offset + frame;
+    unsigned long long start = frame_offset > (unsigned long long) this->pre_samples ? frame_offset - this->pre_samples : 0;
+    if (start < this->written_end) {
+        start = this->written_end;
+    }
+
+    if (start < this->stream_offset) {
+        int n = history_write(&this->history, this->output_fileno, start);
+        if (n == -1) {
+            return -1;
+        }
+        this->written_samples += n;
+        start = this->stream_offset;
+    }
+
+    int block_start = start - this->stream_offset;
+    if (block_start < frame) {
+        if (io_write_all(this->output_fileno, samples + block_start, (frame - block_start) * sizeof(short)) == -1) {
+            return -1;
+        }
+        this->written_samples += frame - block_start;
+    }
+    this->written_end = frame_offset;
+    return 0;
+}
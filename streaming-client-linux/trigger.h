@@ -0,0 +1,63 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_TRIGGER_H_
+#define _STREAMING_CLIENT_TRIGGER_H_
+
+#include <stdbool.h>
+#include "history.h"
+#include "types.h"
+
+/* triggered capture: instead of writing the whole RX stream, wait for a
+   level crossing (or a step between consecutive samples) on the selected
+   channel and write the pre_samples before and post_samples after the
+   trigger point (sample counts are per channel; in DUAL-ADC mode both
+   channels are written, still interleaved); after a capture the trigger
+   re-arms once holdoff_samples have gone by, or stops for a single shot */
+
+typedef enum {
+    TRIGGER_RISING,     /* previous sample < threshold <= current sample */
+    TRIGGER_FALLING,    /* previous sample >= threshold > current sample */
+    TRIGGER_BOTH,       /* either of the above */
+    TRIGGER_SLOPE       /* current - previous >= threshold (threshold > 0)
+                           or current - previous <= threshold (threshold < 0) */
+} trigger_type_t;
+
+typedef enum {
+    TRIGGER_ARMED,
+    TRIGGER_CAPTURING,
+    TRIGGER_HOLDOFF,
+    TRIGGER_DONE
+} trigger_state_t;
+
+typedef struct {
+    trigger_type_t type;
+    int threshold;
+    sample_select_t input;
+    int stride;                         /* raw samples per channel sample */
+    int pre_samples;                    /* raw samples */
+    int post_samples;                   /* raw samples */
+    bool rearm;
+    int holdoff_samples;                /* raw samples */
+    int output_fileno;
+    trigger_state_t state;
+    int remaining;                      /* raw samples left to capture/hold off */
+    history_t history;                  /* last pre_samples raw samples */
+    short last_sample;                  /* previous sample of the selected channel */
+    bool has_last_sample;
+    unsigned long long stream_offset;   /* raw samples before the current block */
+    unsigned long long written_end;     /* raw offset after the last sample written */
+    /* stats */
+    unsigned int events;
+    unsigned long long written_samples;
+} trigger_t;
+
+int trigger_init(trigger_t *this, trigger_type_t type, int threshold, sample_select_t input, int pre_samples, int post_samples, bool rearm, int holdoff_samples, int output_fileno);
+int trigger_fini(trigger_t *this);
+int trigger_process(trigger_t *this, const short *samples, int nsamples);
+void trigger_stats(trigger_t *this);
+
+#endif /* _STREAMING_CLIENT_TRIGGER_H_ */
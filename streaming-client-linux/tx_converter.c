@@ -0,0 +1,226 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "tx_converter.h"
+#include "sample_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* internal functions */
+static void input_to_float(tx_converter_t *this, float *samples, float *samples_q, int nsamples);
+
+
+int tx_converter_init(tx_converter_t *this, tx_format_t format, int interpolation, int max_samples)
+{
+    memset(this, 0, sizeof(*this));
+    switch (format) {
+    case TX_FORMAT_S16:
+        this->input_sample_size = sizeof(short);
+        break;
+    case TX_FORMAT_F32:
+        this->input_sample_size = sizeof(float);
+        break;
+    case TX_FORMAT_CF32:
+        this->input_sample_size = 2 * sizeof(float);
+        break;
+    default:
+        fprintf(stderr, "tx_converter_init - invalid format: %d\n", format);
+        return -1;
+    }
+    this->format = format;
+    this->max_samples = max_samples;
+    this->interpolation = interpolation;
+
+    /* at most max_samples / interpolation input samples (rounded up) for
+       each block */
+    int max_input_samples = (max_samples + interpolation - 1) / interpolation;
+    this->input = (uint8_t *) malloc((size_t) max_input_samples * this->input_sample_size);
+    if (this->input == NULL) {
+        fprintf(stderr, "tx_converter_init - malloc() failed\n");
+        return -1;
+    }
+    if (interpolation > 1) {
+        if (interpolator_init(&this->interpolator, interpolation, max_input_samples) == -1) {
+            tx_converter_fini(this);
+            return -1;
+        }
+        /* one more input sample than needed gives less than interpolation
+           output samples left over */
+        this->output = (float *) malloc((max_samples + interpolation) * sizeof(float));
+        if (this->output == NULL) {
+            fprintf(stderr, "tx_converter_init - malloc() failed\n");
+            tx_converter_fini(this);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int tx_converter_fini(tx_converter_t *this)
+{
+    if (this->upconvert) {
+        nco_fini(&this->nco);
+        if (this->interpolation > 1) {
+            interpolator_fini(&this->interpolator_q);
+        }
+        this->upconvert = false;
+    }
+    free(this->mixed);
+    this->mixed = NULL;
+    free(this->output_q);
+    this->output_q = NULL;
+    if (this->interpolation > 1) {
+        interpolator_fini(&this->interpolator);
+    }
+    free(this->output);
+    this->output = NULL;
+    free(this->input);
+    this->input = NULL;
+    return 0;
+}
+
+/* complex (cf32) input to a real signal at if_frequency (Hz), instead of
+   only its real part */
+int tx_converter_enable_upconversion(tx_converter_t *this, double if_frequency, double sample_rate)
+{
+    if (this->format != TX_FORMAT_CF32) {
+        fprintf(stderr, "tx_converter_enable_upconversion - up-conversion requires complex (cf32) input\n");
+        return -1;
+    }
+    if (nco_init(&this->nco, if_frequency / sample_rate) == -1) {
+        return -1;
+    }
+    this->upconvert = true;
+    this->if_frequency = if_frequency;
+    if (this->interpolation > 1) {
+        if (interpolator_init(&this->interpolator_q, this->interpolation, this->interpolator.max_input_samples) == -1) {
+            tx_converter_fini(this);
+            return -1;
+        }
+        this->output_q = (float *) malloc((this->max_samples + this->interpolation) * sizeof(float));
+    }
+    this->mixed = (float *) malloc(this->max_samples * sizeof(float));
+    if (this->mixed == NULL || (this->interpolation > 1 && this->output_q == NULL)) {
+        fprintf(stderr, "tx_converter_enable_upconversion - malloc() failed\n");
+        tx_converter_fini(this);
+        return -1;
+    }
+    return 0;
+}
+
+/* bytes of input needed for the next nsamples DAC words */
+int tx_converter_input_length(tx_converter_t *this, int nsamples)
+{
+    if (this->interpolation > 1) {
+        /* enough input samples for the output samples that are not left
+           over from the previous block */
+        this->input_samples = (nsamples - this->buffered + this->interpolation - 1) / this->interpolation;
+    } else {
+        this->input_samples = nsamples;
+    }
+    return this->input_samples * this->input_sample_size;
+}
+
+/* converts the input (read by the caller into this->input) to nsamples DAC words */
+void tx_converter_process(tx_converter_t *this, short *dac_words, int nsamples)
+{
+    if (this->interpolation > 1) {
+        int ninput = this->input_samples;
+        const float *samples = this->output;
+        if (this->upconvert) {
+            input_to_float(this, this->interpolator.input, this->interpolator_q.input, ninput);
+            interpolator_process(&this->interpolator, ninput, this->output + this->buffered);
+            interpolator_process(&this->interpolator_q, ninput, this->output_q + this->buffered);
+            nco_mix(&this->nco, this->output, this->output_q, 1, this->mixed, nsamples);
+            samples = this->mixed;
+        } else {
+            input_to_float(this, this->interpolator.input, NULL, ninput);
+            interpolator_process(&this->interpolator, ninput, this->output + this->buffered);
+        }
+        this->clipped += sample_kernels_float_to_dac(samples, 1, dac_words, nsamples);
+        this->buffered += ninput * this->interpolation - nsamples;
+        memmove(this->output, this->output + nsamples, this->buffered * sizeof(float));
+        if (this->upconvert) {
+            memmove(this->output_q, this->output_q + nsamples, this->buffered * sizeof(float));
+        }
+        this->samples += nsamples;
+        return;
+    }
+
+    if (this->upconvert) {
+        /* straight from the interleaved I/Q input */
+        const float *input = (const float *) this->input;
+        nco_mix(&this->nco, input, input + 1, 2, this->mixed, nsamples);
+        this->clipped += sample_kernels_float_to_dac(this->mixed, 1, dac_words, nsamples);
+        this->samples += nsamples;
+        return;
+    }
+
+    switch (this->format) {
+    case TX_FORMAT_S16:
+        memcpy(dac_words, this->input, nsamples * sizeof(short));
+        sample_kernels_to_dac(dac_words, nsamples);
+        break;
+    case TX_FORMAT_F32:
+        this->clipped += sample_kernels_float_to_dac((const float *) this->input, 1, dac_words, nsamples);
+        break;
+    case TX_FORMAT_CF32:
+        this->clipped += sample_kernels_float_to_dac((const float *) this->input, 2, dac_words, nsamples);
+        break;
+    }
+    this->samples += nsamples;
+    return;
+}
+
+void tx_converter_stats(tx_converter_t *this)
+{
+    static const char *format_names[] = { "s16", "f32", "cf32" };
+    if (this->upconvert) {
+        fprintf(stderr, "tx input format: %s - interpolation: %d - IF: %.0fHz - clipped samples: %llu of %llu\n", format_names[this->format], this->interpolation, this->if_frequency, this->clipped, this->samples);
+    } else if (this->interpolation > 1) {
+        fprintf(stderr, "tx input format: %s - interpolation: %d - clipped samples: %llu of %llu\n", format_names[this->format], this->interpolation, this->clipped, this->samples);
+    } else {
+        fprintf(stderr, "tx input format: %s - clipped samples: %llu of %llu\n", format_names[this->format], this->clipped, this->samples);
+    }
+    return;
+}
+
+
+/* internal functions */
+/* low rate input to floats with full scale +/-1.0 (s16 has the same full
+   scale as the float formats when they are converted to DAC words); for
+   cf32 samples_q gets the imaginary part (Q), if it is not NULL */
+static void input_to_float(tx_converter_t *this, float *samples, float *samples_q, int nsamples)
+{
+    switch (this->format) {
+    case TX_FORMAT_S16: {
+        const short *input = (const short *) this->input;
+        for (int i = 0; i < nsamples; i++) {
+            samples[i] = input[i] * (1.0f / 8191.0f);
+        }
+        break;
+    }
+    case TX_FORMAT_F32:
+        memcpy(samples, this->input, nsamples * sizeof(float));
+        break;
+    case TX_FORMAT_CF32: {
+        /* the real part (I) */
+        const float *input = (const float *) this->input;
+        for (int i = 0; i < nsamples; i++) {
+            samples[i] = input[2 * i];
+        }
+        if (samples_q != NULL) {
+            for (int i = 0; i < nsamples; i++) {
+                samples_q[i] = input[2 * i + 1];
+            }
+        }
+        break;
+    }
+    }
+    return;
+}
@@ -0,0 +1,71 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_TX_CONVERTER_H_
+#define _STREAMING_CLIENT_TX_CONVERTER_H_
+
+#include "interpolator.h"
+#include "nco.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* TX input conversion: turns the samples read from the input file/stdin
+   into DAC words, for the input formats other than s16 and for low rate
+   input (s16 samples, 14 bit, at the DAC rate are read straight into the
+   transfers and shifted in place):
+     f32:  float samples with full scale +/-1.0
+     cf32: complex float samples (I/Q) with full scale +/-1.0, of which
+           only the real part (I) goes to the DAC
+   The float samples are scaled to 14 bits with saturation, and the samples
+   that were clipped are counted.
+   With an interpolation factor greater than 1 the input is at a lower rate
+   (the DAC sample rate divided by the factor), and it is interpolated to
+   the DAC rate (as floats, for every input format); the output samples left
+   over at the end of a block go at the beginning of the next one, so the
+   number of input samples changes from block to block.
+   With up-conversion (cf32 only) I and Q are both interpolated, and the
+   NCO mixer turns them into a real signal at the IF frequency, instead of
+   taking only the real part.
+   For each block, tx_converter_input_length() tells how many bytes of
+   input to read into this->input, and tx_converter_process() converts them */
+
+typedef enum {
+    TX_FORMAT_S16,
+    TX_FORMAT_F32,
+    TX_FORMAT_CF32
+} tx_format_t;
+
+typedef struct {
+    tx_format_t format;
+    int input_sample_size;          /* bytes */
+    uint8_t *input;
+    int max_samples;
+    int input_samples;              /* in the current block */
+    int interpolation;
+    interpolator_t interpolator;    /* real part (I) for cf32 */
+    float *output;                  /* interpolated samples */
+    int buffered;                   /* output samples left over from the previous block */
+    /* up-conversion */
+    bool upconvert;
+    double if_frequency;
+    nco_t nco;
+    interpolator_t interpolator_q;  /* imaginary part (Q) */
+    float *output_q;
+    float *mixed;
+    /* stats */
+    unsigned long long samples;
+    unsigned long long clipped;
+} tx_converter_t;
+
+int tx_converter_init(tx_converter_t *this, tx_format_t format, int interpolation, int max_samples);
+int tx_converter_fini(tx_converter_t *this);
+int tx_converter_enable_upconversion(tx_converter_t *this, double if_frequency, double sample_rate);
+int tx_converter_input_length(tx_converter_t *this, int nsamples);
+void tx_converter_process(tx_converter_t *this, short *dac_words, int nsamples);
+void tx_converter_stats(tx_converter_t *this);
+
+#endif /* _STREAMING_CLIENT_TX_CONVERTER_H_ */
@@ -0,0 +1,107 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "tx_loop.h"
+#include "sample_kernels.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+int tx_loop_init(tx_loop_t *this, int fd, int num_loops)
+{
+    memset(this, 0, sizeof(*this));
+    if (num_loops < 0) {
+        fprintf(stderr, "tx_loop_init - invalid number of loops: %d\n", num_loops);
+        return -1;
+    }
+    this->num_loops = num_loops;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        fprintf(stderr, "tx_loop_init - fstat() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (!S_ISREG(statbuf.st_mode)) {
+        fprintf(stderr, "tx_loop_init - the input must be a regular file\n");
+        return -1;
+    }
+    /* whole samples only */
+    this->size = (size_t) statbuf.st_size & ~(size_t) 1;
+    if (this->size == 0) {
+        fprintf(stderr, "tx_loop_init - the input file has no samples\n");
+        return -1;
+    }
+
+    /* private mapping: the shift below is not written back to the file */
+    void *samples = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (samples == MAP_FAILED) {
+        fprintf(stderr, "tx_loop_init - mmap() failed: %s\n", strerror(errno));
+        return -1;
+    }
+    this->samples = (uint8_t *) samples;
+
+    /* shift for the DAC once and for all; this also makes every page of the
+       mapping resident, so there are no page faults while streaming */
+    size_t nsamples = this->size / sizeof(short);
+    const size_t chunk = 1 << 24;
+    for (size_t i = 0; i < nsamples; i += chunk) {
+        size_t n = nsamples - i < chunk ? nsamples - i : chunk;
+        sample_kernels_to_dac((short *) this->samples + i, (int) n);
+    }
+    return 0;
+}
+
+int tx_loop_fini(tx_loop_t *this)
+{
+    if (this->samples != NULL) {
+        munmap(this->samples, this->size);
+        this->samples = NULL;
+    }
+    return 0;
+}
+
+/* called from the USB callback: fills the transfer buffer from the mapping
+   (wrapping around at the end of the file) and returns its length; -1 once
+   all the loops have been sent */
+int tx_loop_get(tx_loop_t *this, uint8_t *buffer, int length)
+{
+    if (this->done) {
+        fprintf(stderr, "TX loop: %llu loops played. Done streaming\n", this->loops);
+        return -1;
+    }
+
+    size_t offset = 0;
+    while (offset < (size_t) length) {
+        size_t n = this->size - this->position;
+        if (n > (size_t) length - offset) {
+            n = (size_t) length - offset;
+        }
+        memcpy(buffer + offset, this->samples + this->position, n);
+        offset += n;
+        this->position += n;
+        if (this->position == this->size) {
+            this->position = 0;
+            this->loops++;
+            if (this->num_loops > 0 && this->loops == (unsigned long long) this->num_loops) {
+                /* silence after the last loop */
+                memset(buffer + offset, 0, length - offset);
+                this->done = true;
+                break;
+            }
+        }
+    }
+    return length;
+}
+
+void tx_loop_stats(tx_loop_t *this)
+{
+    fprintf(stderr, "tx loop: %zu samples - loops played: %llu\n", this->size / sizeof(short), this->loops);
+    return;
+}
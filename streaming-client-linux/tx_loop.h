@@ -0,0 +1,37 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_TX_LOOP_H_
+#define _STREAMING_CLIENT_TX_LOOP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* TX loop: plays the samples of a file over and over (num_loops times, or
+   forever when num_loops is 0). The file is mapped once (privately, so the
+   file itself is not modified) and shifted for the DAC in memory; after
+   that tx_loop_get() only copies from the mapping into the transfers,
+   wrapping around at the end of the file, without any system calls.
+   After the last loop the rest of the transfer is filled with zeros, and
+   then tx_loop_get() returns -1 */
+
+typedef struct {
+    uint8_t *samples;               /* the mapping (already shifted for the DAC) */
+    size_t size;                    /* bytes */
+    size_t position;
+    int num_loops;                  /* 0: forever */
+    bool done;
+    /* stats */
+    unsigned long long loops;       /* completed loops */
+} tx_loop_t;
+
+int tx_loop_init(tx_loop_t *this, int fd, int num_loops);
+int tx_loop_fini(tx_loop_t *this);
+int tx_loop_get(tx_loop_t *this, uint8_t *buffer, int length);
+void tx_loop_stats(tx_loop_t *this);
+
+#endif /* _STREAMING_CLIENT_TX_LOOP_H_ */
@@ -0,0 +1,185 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "tx_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+int tx_ring_init(tx_ring_t *this, int num_blocks, int block_size)
+{
+    memset(this, 0, sizeof(*this));
+    if (num_blocks < 2) {
+        fprintf(stderr, "tx_ring_init - invalid number of blocks: %d\n", num_blocks);
+        return -1;
+    }
+    this->num_blocks = num_blocks;
+    this->block_size = block_size;
+    this->min_fill = num_blocks;
+    this->blocks = (uint8_t **) calloc(num_blocks, sizeof(uint8_t *));
+    if (this->blocks == NULL) {
+        fprintf(stderr, "tx_ring_init - calloc() failed\n");
+        return -1;
+    }
+    for (int i = 0; i < num_blocks; i++) {
+        this->blocks[i] = (uint8_t *) malloc(block_size);
+        if (this->blocks[i] == NULL) {
+            fprintf(stderr, "tx_ring_init - malloc() failed\n");
+            tx_ring_fini(this);
+            return -1;
+        }
+    }
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->not_full, NULL);
+    pthread_cond_init(&this->full, NULL);
+    return 0;
+}
+
+int tx_ring_fini(tx_ring_t *this)
+{
+    if (this->blocks != NULL) {
+        for (int i = 0; i < this->num_blocks; i++) {
+            free(this->blocks[i]);
+        }
+        free(this->blocks);
+        this->blocks = NULL;
+        pthread_cond_destroy(&this->full);
+        pthread_cond_destroy(&this->not_full);
+        pthread_mutex_destroy(&this->mutex);
+    }
+    return 0;
+}
+
+/* called from the reader thread: the next free block (block_size bytes)
+   to be filled in place, or NULL once the ring is closed */
+uint8_t *tx_ring_reserve(tx_ring_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    if (this->count == this->num_blocks && !this->closed) {
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (this->count == this->num_blocks && !this->closed) {
+            pthread_cond_wait(&this->not_full, &this->mutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        this->wait_time += (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    }
+    if (this->closed) {
+        pthread_mutex_unlock(&this->mutex);
+        return NULL;
+    }
+    /* the block is not visible to the USB callback until it is committed */
+    this->reserved = true;
+    uint8_t *block = this->blocks[this->head];
+    pthread_mutex_unlock(&this->mutex);
+    return block;
+}
+
+/* the reserved block is ready to be sent */
+void tx_ring_commit(tx_ring_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    if (this->reserved) {
+        this->reserved = false;
+        this->head = (this->head + 1) % this->num_blocks;
+        this->count++;
+        this->blocks_in++;
+        if (this->count == this->num_blocks) {
+            pthread_cond_broadcast(&this->full);
+        }
+    }
+    pthread_mutex_unlock(&this->mutex);
+    return;
+}
+
+/* waits until the ring is full (or closed), so that the stream starts with
+   as many blocks ready as possible; at most timeout seconds, so that a
+   producer that never starts does not hold up the stream forever */
+void tx_ring_wait_full(tx_ring_t *this, double timeout)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t) timeout;
+    deadline.tv_nsec += (long) ((timeout - (time_t) timeout) * 1e9);
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&this->mutex);
+    int status = 0;
+    while (this->count < this->num_blocks && !this->closed && status == 0) {
+        status = pthread_cond_timedwait(&this->full, &this->mutex, &deadline);
+    }
+    pthread_mutex_unlock(&this->mutex);
+    return;
+}
+
+/* called from the USB callback: copies the oldest ready block into the
+   transfer buffer and returns its length; on an underrun the buffer is
+   zeroed and the length is returned all the same. Returns -1 once the
+   ring is closed and empty */
+int tx_ring_get(tx_ring_t *this, uint8_t *buffer, int length)
+{
+    if (length > this->block_size) {
+        length = this->block_size;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+    if (this->count == 0) {
+        if (this->closed) {
+            pthread_mutex_unlock(&this->mutex);
+            return -1;
+        }
+        this->underruns++;
+        this->underrun_samples += length / sizeof(short);
+        this->min_fill = 0;
+        pthread_mutex_unlock(&this->mutex);
+        memset(buffer, 0, length);
+        return length;
+    }
+    if (this->count < this->min_fill && !this->closed) {
+        this->min_fill = this->count;
+    }
+    uint8_t *block = this->blocks[this->tail];
+    pthread_mutex_unlock(&this->mutex);
+
+    /* the reader does not touch the block until count is decremented */
+    memcpy(buffer, block, length);
+
+    pthread_mutex_lock(&this->mutex);
+    this->tail = (this->tail + 1) % this->num_blocks;
+    this->count--;
+    this->blocks_out++;
+    pthread_cond_signal(&this->not_full);
+    pthread_mutex_unlock(&this->mutex);
+    return length;
+}
+
+/* no more blocks after those already in the ring (EOF, or the stream is
+   stopping); the reader never waits after this */
+void tx_ring_close(tx_ring_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    this->closed = true;
+    this->reserved = false;
+    pthread_cond_broadcast(&this->not_full);
+    pthread_cond_broadcast(&this->full);
+    pthread_mutex_unlock(&this->mutex);
+    return;
+}
+
+void tx_ring_stats(tx_ring_t *this)
+{
+    fprintf(stderr, "tx ring: %d blocks - min fill: %d\n", this->num_blocks, this->min_fill);
+    fprintf(stderr, "tx ring blocks: %llu in, %llu out\n", this->blocks_in, this->blocks_out);
+    fprintf(stderr, "tx ring underruns: %llu (%llu samples of silence)\n", this->underruns, this->underrun_samples);
+    fprintf(stderr, "tx ring reader wait time: %.3lf s\n", this->wait_time);
+    return;
+}
@@ -0,0 +1,55 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_TX_RING_H_
+#define _STREAMING_CLIENT_TX_RING_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* TX ring: decouples the USB callbacks from the producer of the samples.
+   A reader thread keeps the ring full of blocks ready to be sent (already
+   shifted for the DAC): it takes a free block with tx_ring_reserve(), fills
+   it in place and hands it over with tx_ring_commit(); the USB callback
+   copies the oldest ready block into the transfer with tx_ring_get().
+   When a transfer completes and no block is ready (the producer did not
+   keep up), the transfer is sent with zeros and counted as an underrun, so
+   the depth of the ring can be sized for glitch-free transmission.
+   tx_ring_close() marks the end of the samples (EOF): the blocks still in
+   the ring are sent, and then tx_ring_get() returns -1 */
+
+typedef struct {
+    int num_blocks;
+    int block_size;
+    uint8_t **blocks;
+    int head;                       /* next block to be filled */
+    int tail;                       /* next block to be sent */
+    int count;                      /* blocks ready to be sent */
+    bool reserved;                  /* the reader is filling the head block */
+    bool closed;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_full;
+    pthread_cond_t full;
+    /* stats */
+    unsigned long long blocks_in;
+    unsigned long long blocks_out;
+    unsigned long long underruns;
+    unsigned long long underrun_samples;
+    int min_fill;                   /* until EOF */
+    double wait_time;               /* time the reader spent waiting for a free block */
+} tx_ring_t;
+
+int tx_ring_init(tx_ring_t *this, int num_blocks, int block_size);
+int tx_ring_fini(tx_ring_t *this);
+uint8_t *tx_ring_reserve(tx_ring_t *this);
+void tx_ring_commit(tx_ring_t *this);
+void tx_ring_wait_full(tx_ring_t *this, double timeout);
+int tx_ring_get(tx_ring_t *this, uint8_t *buffer, int length);
+void tx_ring_close(tx_ring_t *this);
+void tx_ring_stats(tx_ring_t *this);
+
+#endif /* _STREAMING_CLIENT_TX_RING_H_ */
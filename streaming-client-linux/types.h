@@ -9,4 +9,18 @@
 
 typedef enum { STREAM_RX, STREAM_TX } stream_direction_t;
 
+/* which samples of the RX stream an analysis stage looks at */
+typedef enum {
+    SAMPLE_SELECT_ALL,      /* SINGLE-ADC: every sample */
+    SAMPLE_SELECT_EVEN,     /* DUAL-ADC: even samples only */
+    SAMPLE_SELECT_ODD       /* DUAL-ADC: odd samples only */
+} sample_select_t;
+
+/* how the samples are laid out in the transfers (from the DFC mode) */
+typedef enum {
+    SAMPLE_LAYOUT_SINGLE_ADC,   /* SINGLE-ADC: one ADC, every sample */
+    SAMPLE_LAYOUT_DUAL_ADC,     /* DUAL-ADC: ADC A in the even samples, ADC B in the odd ones */
+    SAMPLE_LAYOUT_DAC           /* DAC: 14 bit samples in bits 2:15 */
+} sample_layout_t;
+
 #endif /* _STREAMING_CLIENT_TYPES_H_ */
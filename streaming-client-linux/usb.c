@@ -20,10 +20,15 @@ static const uint16_t fx3_dfu_mode[]         = { 0x04b4, 0x00f3 };
 
 static const unsigned int timeout = 5000;  /* timeout (in ms) for each command */
 
+static libusb_device_handle *open_fx3_streamer(const char *serial_number);
 static int upload_fx3_firmware(const char *firmware_file, libusb_device_handle *device_handle);
 
 
-int usb_init(usb_device_t *this, const char *firmware_file)
+/* serial_number: the FX3 to use (NULL: the first one found); it is matched
+   first against the FX3s already running the streamer firmware, and only if
+   none has it are the FX3s in DFU mode flashed with firmware_file (NULL: an
+   FX3 in DFU mode is never flashed) */
+int usb_init(usb_device_t *this, const char *firmware_file, const char *serial_number)
 {
     int status;
 
@@ -35,42 +40,58 @@ int usb_init(usb_device_t *this, const char *firmware_file)
 
     /* look for streamer device first; if found return that */
     libusb_device_handle *device_handle;
-    device_handle = libusb_open_device_with_vid_pid(NULL, fx3_streamer_example[0], fx3_streamer_example[1]);
+    device_handle = open_fx3_streamer(serial_number);
     if (device_handle != NULL) {
         this->device_handle = device_handle;
         return 0;
     }
 
-    fprintf(stderr, "FX3 streamer example not found - trying FX3 in DFU mode\n");
-
-    device_handle = libusb_open_device_with_vid_pid(NULL, fx3_dfu_mode[0], fx3_dfu_mode[1]);
-    if (device_handle == NULL) {
-        fprintf(stderr, "usb_init - FX3 in DFU mode not found\n");
+    if (firmware_file == NULL) {
+        if (serial_number == NULL) {
+            fprintf(stderr, "usb_init - FX3 streamer example not found\n");
+        } else {
+            fprintf(stderr, "usb_init - FX3 streamer example with serial number %s not found\n", serial_number);
+        }
         return -1;
     }
 
-    fprintf(stderr, "upload FX3 firmware\n");
+    fprintf(stderr, "FX3 streamer example not found - trying FX3 in DFU mode\n");
 
-    if (upload_fx3_firmware(firmware_file, device_handle) != 0) {
-        fprintf(stderr, "usb_init - FX3 firmware upload failed\n");
-        libusb_close(device_handle);
-        return -1;
-    }
+    /* the serial number comes from the firmware, so when looking for a
+       specific FX3, those in DFU mode are tried one at a time */
+    while (device_handle == NULL) {
+        libusb_device_handle *dfu_device_handle = libusb_open_device_with_vid_pid(NULL, fx3_dfu_mode[0], fx3_dfu_mode[1]);
+        if (dfu_device_handle == NULL) {
+            fprintf(stderr, "usb_init - FX3 in DFU mode not found\n");
+            return -1;
+        }
 
-    /* look again for streamer device */
-    for (int retry = 0; retry < 10; retry++) {
-        device_handle = libusb_open_device_with_vid_pid(NULL, fx3_streamer_example[0], fx3_streamer_example[1]);
-        if (device_handle != NULL) {
-            fprintf(stderr, "FX3 firmware upload OK (retry=%d)\n", retry);
-            break;
+        fprintf(stderr, "upload FX3 firmware\n");
+
+        if (upload_fx3_firmware(firmware_file, dfu_device_handle) != 0) {
+            fprintf(stderr, "usb_init - FX3 firmware upload failed\n");
+            libusb_close(dfu_device_handle);
+            return -1;
+        }
+        libusb_close(dfu_device_handle);
+
+        /* look again for streamer device */
+        for (int retry = 0; retry < 10; retry++) {
+            device_handle = open_fx3_streamer(serial_number);
+            if (device_handle != NULL) {
+                fprintf(stderr, "FX3 firmware upload OK (retry=%d)\n", retry);
+                break;
+            }
+            usleep(100000); /* wait 100ms before checking again */
         }
-        usleep(100000); /* wait 100ms before checking again */
-    }
 
-    if (device_handle == NULL) {
-        fprintf(stderr, "usb_init - FX3 firmware upload failed - FX3 streamer example not found\n");
-        libusb_close(device_handle);
-        return -1;
+        if (device_handle == NULL && serial_number == NULL) {
+            fprintf(stderr, "usb_init - FX3 firmware upload failed - FX3 streamer example not found\n");
+            return -1;
+        }
+        if (device_handle == NULL) {
+            fprintf(stderr, "FX3 serial number is not %s - trying the next FX3 in DFU mode\n", serial_number);
+        }
     }
 
     this->device_handle = device_handle;
@@ -262,8 +283,65 @@ int usb_control_write(const usb_device_t *this, uint8_t control, const uint8_t *
     return 0;
 }
 
+int usb_get_serial_number(const usb_device_t *this, char *serial_number, int size)
+{
+    struct libusb_device_descriptor descriptor;
+    int status = libusb_get_device_descriptor(this->device, &descriptor);
+    if (status != LIBUSB_SUCCESS) {
+        fprintf(stderr, "usb_get_serial_number - error in libusb_get_device_descriptor(): %s\n", libusb_strerror(status));
+        return -1;
+    }
+    if (descriptor.iSerialNumber == 0) {
+        fprintf(stderr, "usb_get_serial_number - device has no serial number\n");
+        return -1;
+    }
+    status = libusb_get_string_descriptor_ascii(this->device_handle, descriptor.iSerialNumber, (unsigned char *)serial_number, size);
+    if (status < 0) {
+        fprintf(stderr, "usb_get_serial_number - error in libusb_get_string_descriptor_ascii(): %s\n", libusb_strerror(status));
+        return -1;
+    }
+    return 0;
+}
+
 
 /* internal functions */
+static libusb_device_handle *open_fx3_streamer(const char *serial_number)
+{
+    if (serial_number == NULL) {
+        return libusb_open_device_with_vid_pid(NULL, fx3_streamer_example[0], fx3_streamer_example[1]);
+    }
+
+    libusb_device **list;
+    ssize_t count = libusb_get_device_list(NULL, &list);
+    if (count < 0) {
+        fprintf(stderr, "open_fx3_streamer - error in libusb_get_device_list(): %s\n", libusb_strerror(count));
+        return NULL;
+    }
+    libusb_device_handle *device_handle = NULL;
+    for (ssize_t i = 0; i < count && device_handle == NULL; i++) {
+        struct libusb_device_descriptor descriptor;
+        if (libusb_get_device_descriptor(list[i], &descriptor) != LIBUSB_SUCCESS) {
+            continue;
+        }
+        if (descriptor.idVendor != fx3_streamer_example[0] || descriptor.idProduct != fx3_streamer_example[1] || descriptor.iSerialNumber == 0) {
+            continue;
+        }
+        libusb_device_handle *candidate;
+        if (libusb_open(list[i], &candidate) != LIBUSB_SUCCESS) {
+            continue;
+        }
+        char candidate_serial_number[64];
+        int status = libusb_get_string_descriptor_ascii(candidate, descriptor.iSerialNumber, (unsigned char *)candidate_serial_number, sizeof(candidate_serial_number));
+        if (status > 0 && strcmp(candidate_serial_number, serial_number) == 0) {
+            device_handle = candidate;
+        } else {
+            libusb_close(candidate);
+        }
+    }
+    libusb_free_device_list(list, 1);
+    return device_handle;
+}
+
 static int upload_fx3_firmware(const char *firmware_file, libusb_device_handle *device_handle)
 {
     const uint8_t bmRequestTypeRead = LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE;
@@ -23,10 +23,11 @@ typedef struct {
     int packet_size;
 } usb_device_t;
 
-int usb_init(usb_device_t *this, const char *firmware_file);
+int usb_init(usb_device_t *this, const char *firmware_file, const char *serial_number);
 int usb_open(usb_device_t *this, int control_interface, int data_interface, int data_interface_altsetting, int endpoint, stream_direction_t stream_direction);
 int usb_close(usb_device_t *this);
 int usb_control_read(const usb_device_t *this, uint8_t control, uint8_t *data, uint16_t size);
 int usb_control_write(const usb_device_t *this, uint8_t control, const uint8_t *data, uint16_t size);
+int usb_get_serial_number(const usb_device_t *this, char *serial_number, int size);
 
 #endif /* _STREAMING_CLIENT_USB_H_ */
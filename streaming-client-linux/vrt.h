@@ -0,0 +1,76 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_VRT_H_
+#define _STREAMING_CLIENT_VRT_H_
+
+#include <arpa/inet.h>
+#include <stdint.h>
+
+/* VITA-49 style IF data packet used by the network server:
+   - header word: packet type 1 (IF data with stream ID), TSI = 1 (UTC),
+     TSF = 3 (free running count), 4 bit packet count, size in 32 bit words
+   - stream ID
+   - integer timestamp: host time (UTC seconds) when the block was received
+   - fractional timestamp (64 bit): stream offset of the first sample, which
+     the receivers use as the sequence number to find lost packets
+   - payload: 16 bit signed samples, big endian (DUAL-ADC: interleaved); an
+     odd number of samples is padded with a zero sample to a whole 32 bit
+     word, and the (reserved in VITA-49.0) header bit 24 is set
+   All the words are in network byte order */
+
+#define VRT_HEADER_WORDS 5
+#define VRT_HEADER_SIZE (VRT_HEADER_WORDS * 4)
+#define VRT_MAX_PACKET_SIZE 65536
+#define VRT_PAD_SAMPLE (1u << 24)
+
+/* returns the packet length (header and payload, including the pad sample) */
+static inline int vrt_write_header(uint8_t *packet, unsigned int packet_count, int nsamples, uint32_t stream_id, uint32_t seconds, uint64_t sample_count)
+{
+    uint32_t words[VRT_HEADER_WORDS];
+    uint32_t pad = nsamples % 2 != 0 ? VRT_PAD_SAMPLE : 0;
+    uint32_t size = VRT_HEADER_WORDS + (nsamples + 1) / 2;
+    words[0] = htonl((1u << 28) | (1u << 22) | (3u << 20) | pad | ((packet_count & 0xf) << 16) | size);
+    words[1] = htonl(stream_id);
+    words[2] = htonl(seconds);
+    words[3] = htonl((uint32_t) (sample_count >> 32));
+    words[4] = htonl((uint32_t) sample_count);
+    __builtin_memcpy(packet, words, sizeof(words));
+    return size * 4;
+}
+
+/* returns the number of samples in the payload (without the pad sample), or
+   -1 if this is not one of our packets */
+static inline int vrt_read_header(const uint8_t *packet, int length, unsigned int *packet_count, uint32_t *stream_id, uint32_t *seconds, uint64_t *sample_count)
+{
+    uint32_t words[VRT_HEADER_WORDS];
+    if (length < VRT_HEADER_SIZE) {
+        return -1;
+    }
+    __builtin_memcpy(words, packet, sizeof(words));
+    uint32_t header = ntohl(words[0]);
+    if ((header >> 28) != 1 || ((header >> 20) & 0xf) != 0x7) {
+        return -1;
+    }
+    int size = (header & 0xffff) * 4;
+    if (size > length || size < VRT_HEADER_SIZE) {
+        return -1;
+    }
+    int nsamples = (size - VRT_HEADER_SIZE) / sizeof(short);
+    if (header & VRT_PAD_SAMPLE) {
+        if (nsamples == 0) {
+            return -1;
+        }
+        nsamples--;
+    }
+    *packet_count = (header >> 16) & 0xf;
+    *stream_id = ntohl(words[1]);
+    *seconds = ntohl(words[2]);
+    *sample_count = ((uint64_t) ntohl(words[3]) << 32) | ntohl(words[4]);
+    return nsamples;
+}
+
+#endif /* _STREAMING_CLIENT_VRT_H_ */
@@ -0,0 +1,220 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* internal functions */
+static void *worker_pool_worker(void *arg);
+
+
+int worker_pool_init(worker_pool_t *this, int num_workers, int num_slots, int block_size, int result_size, worker_pool_function_t process, worker_pool_function_t release, void *context)
+{
+    memset(this, 0, sizeof(*this));
+    if (num_workers <= 0) {
+        fprintf(stderr, "worker_pool_init - invalid number of workers: %d\n", num_workers);
+        return -1;
+    }
+    if (num_slots < num_workers) {
+        fprintf(stderr, "worker_pool_init - invalid number of slots: %d\n", num_slots);
+        return -1;
+    }
+    this->num_workers = num_workers;
+    this->num_slots = num_slots;
+    this->block_size = block_size;
+    this->process = process;
+    this->release = release;
+    this->context = context;
+
+    this->slots = (worker_pool_slot_t *) calloc(num_slots, sizeof(worker_pool_slot_t));
+    /* keep the result areas aligned for any type */
+    int result_stride = (result_size + 15) & ~15;
+    this->results = (uint8_t *) calloc(num_slots, result_stride > 0 ? result_stride : 16);
+    this->workers = (pthread_t *) calloc(num_workers, sizeof(pthread_t));
+    if (this->slots == NULL || this->results == NULL || this->workers == NULL) {
+        fprintf(stderr, "worker_pool_init - calloc() failed\n");
+        worker_pool_fini(this);
+        return -1;
+    }
+    for (int i = 0; i < num_slots; i++) {
+        this->slots[i].data = (uint8_t *) malloc(block_size);
+        if (this->slots[i].data == NULL) {
+            fprintf(stderr, "worker_pool_init - malloc() failed\n");
+            worker_pool_fini(this);
+            return -1;
+        }
+        this->slots[i].result = this->results + i * result_stride;
+    }
+
+    pthread_mutex_init(&this->mutex, NULL);
+    pthread_cond_init(&this->work, NULL);
+    pthread_cond_init(&this->space, NULL);
+    return 0;
+}
+
+int worker_pool_fini(worker_pool_t *this)
+{
+    if (this->slots != NULL) {
+        for (int i = 0; i < this->num_slots; i++) {
+            free(this->slots[i].data);
+        }
+        free(this->slots);
+        this->slots = NULL;
+    }
+    free(this->results);
+    this->results = NULL;
+    if (this->workers != NULL) {
+        free(this->workers);
+        this->workers = NULL;
+        pthread_cond_destroy(&this->space);
+        pthread_cond_destroy(&this->work);
+        pthread_mutex_destroy(&this->mutex);
+    }
+    return 0;
+}
+
+int worker_pool_start(worker_pool_t *this)
+{
+    this->stop = false;
+    for (int i = 0; i < this->num_workers; i++) {
+        int status = pthread_create(&this->workers[i], NULL, worker_pool_worker, this);
+        if (status != 0) {
+            fprintf(stderr, "worker_pool_start - pthread_create() failed: %s\n", strerror(status));
+            worker_pool_stop(this);
+            return -1;
+        }
+        this->num_started++;
+    }
+    return 0;
+}
+
+/* wait until all the submitted blocks have been released, then stop the workers */
+int worker_pool_stop(worker_pool_t *this)
+{
+    pthread_mutex_lock(&this->mutex);
+    while (this->next_release != this->next_submit && this->num_started > 0) {
+        pthread_cond_wait(&this->space, &this->mutex);
+    }
+    this->stop = true;
+    pthread_cond_broadcast(&this->work);
+    pthread_mutex_unlock(&this->mutex);
+    for (int i = 0; i < this->num_started; i++) {
+        pthread_join(this->workers[i], NULL);
+    }
+    this->num_started = 0;
+    return this->failed ? -1 : 0;
+}
+
+/* copy a block into the next free slot (waiting for one if necessary) */
+int worker_pool_submit(worker_pool_t *this, const uint8_t *data, int length)
+{
+    if (length > this->block_size) {
+        length = this->block_size;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+    if (this->next_submit - this->next_release == (unsigned long long) this->num_slots && !this->failed) {
+        struct timespec start;
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        while (this->next_submit - this->next_release == (unsigned long long) this->num_slots && !this->failed) {
+            pthread_cond_wait(&this->space, &this->mutex);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        this->wait_time += (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    }
+    if (this->failed) {
+        pthread_mutex_unlock(&this->mutex);
+        return -1;
+    }
+    worker_pool_slot_t *slot = &this->slots[this->next_submit % this->num_slots];
+    pthread_mutex_unlock(&this->mutex);
+
+    /* the slot is not visible to the workers until next_submit is incremented */
+    memcpy(slot->data, data, length);
+    slot->length = length;
+    slot->done = false;
+
+    pthread_mutex_lock(&this->mutex);
+    this->next_submit++;
+    pthread_cond_signal(&this->work);
+    pthread_mutex_unlock(&this->mutex);
+    return 0;
+}
+
+void worker_pool_stats(worker_pool_t *this)
+{
+    fprintf(stderr, "worker pool: %d workers, %d slots - max blocks in flight: %d\n", this->num_workers, this->num_slots, this->max_in_flight);
+    fprintf(stderr, "worker pool blocks: %llu (%llu completed out of order) - submit wait time: %.3lf s\n", this->blocks, this->out_of_order, this->wait_time);
+    return;
+}
+
+
+/* internal functions */
+static void *worker_pool_worker(void *arg)
+{
+    worker_pool_t *this = (worker_pool_t *) arg;
+
+    pthread_mutex_lock(&this->mutex);
+    while (true) {
+        while (this->next_dispatch == this->next_submit && !this->stop) {
+            pthread_cond_wait(&this->work, &this->mutex);
+        }
+        if (this->next_dispatch == this->next_submit) {
+            break;
+        }
+        unsigned long long sequence = this->next_dispatch++;
+        int in_flight = this->next_dispatch - this->next_release;
+        if (in_flight > this->max_in_flight) {
+            this->max_in_flight = in_flight;
+        }
+        worker_pool_slot_t *slot = &this->slots[sequence % this->num_slots];
+        bool failed = this->failed;
+        pthread_mutex_unlock(&this->mutex);
+
+        int status = failed ? 0 : this->process(this->context, slot->data, slot->length, slot->result);
+
+        pthread_mutex_lock(&this->mutex);
+        if (status == -1) {
+            this->failed = true;
+        }
+        slot->done = true;
+        this->blocks++;
+        if (sequence != this->next_release) {
+            this->out_of_order++;
+        }
+        if (this->releasing) {
+            /* the worker that is releasing will get to this block too */
+            continue;
+        }
+
+        /* release the completed blocks in order */
+        this->releasing = true;
+        while (this->next_release < this->next_dispatch) {
+            worker_pool_slot_t *next = &this->slots[this->next_release % this->num_slots];
+            if (!next->done) {
+                break;
+            }
+            failed = this->failed;
+            pthread_mutex_unlock(&this->mutex);
+            status = failed ? 0 : this->release(this->context, next->data, next->length, next->result);
+            pthread_mutex_lock(&this->mutex);
+            if (status == -1) {
+                this->failed = true;
+            }
+            next->done = false;
+            this->next_release++;
+            pthread_cond_broadcast(&this->space);
+        }
+        this->releasing = false;
+    }
+    pthread_mutex_unlock(&this->mutex);
+    return NULL;
+}
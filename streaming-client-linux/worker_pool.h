@@ -0,0 +1,65 @@
+//
+// Copyright 2024 Franco Venturi
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+
+#ifndef _STREAMING_CLIENT_WORKER_POOL_H_
+#define _STREAMING_CLIENT_WORKER_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* order preserving worker pool: blocks are copied into slots and tagged with
+   a sequence number; the worker threads run the process function on them in
+   parallel (it must only depend on the block itself), and then the release
+   function is called on each block strictly in sequence order, by one worker
+   at a time (the slots are the reorder buffer). Each slot has a result area
+   where the process function can leave its per-block results for the
+   release function */
+
+typedef int (*worker_pool_function_t)(void *context, uint8_t *data, int length, void *result);
+
+typedef struct {
+    uint8_t *data;
+    int length;
+    void *result;
+    bool done;
+} worker_pool_slot_t;
+
+typedef struct {
+    int num_workers;
+    int num_slots;
+    int block_size;
+    worker_pool_function_t process;
+    worker_pool_function_t release;
+    void *context;
+    worker_pool_slot_t *slots;
+    uint8_t *results;
+    unsigned long long next_submit;     /* sequence number of the next block */
+    unsigned long long next_dispatch;   /* next block for the workers */
+    unsigned long long next_release;    /* next block to be released */
+    bool releasing;                     /* a worker is releasing blocks */
+    bool stop;
+    bool failed;
+    pthread_t *workers;
+    int num_started;
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    pthread_cond_t space;
+    /* stats */
+    unsigned long long blocks;
+    unsigned long long out_of_order;    /* blocks done before the previous ones */
+    int max_in_flight;
+    double wait_time;                   /* time the submitter waited for a slot */
+} worker_pool_t;
+
+int worker_pool_init(worker_pool_t *this, int num_workers, int num_slots, int block_size, int result_size, worker_pool_function_t process, worker_pool_function_t release, void *context);
+int worker_pool_fini(worker_pool_t *this);
+int worker_pool_start(worker_pool_t *this);
+int worker_pool_stop(worker_pool_t *this);
+int worker_pool_submit(worker_pool_t *this, const uint8_t *data, int length);
+void worker_pool_stats(worker_pool_t *this);
+
+#endif /* _STREAMING_CLIENT_WORKER_POOL_H_ */